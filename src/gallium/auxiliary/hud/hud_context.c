@@ -1211,6 +1211,12 @@ has_occlusion_query(struct pipe_screen *screen)
    return screen->get_param(screen, PIPE_CAP_OCCLUSION_QUERY) != 0;
 }
 
+static bool
+has_time_elapsed_query(struct pipe_screen *screen)
+{
+   return screen->get_param(screen, PIPE_CAP_QUERY_TIME_ELAPSED) != 0;
+}
+
 static bool
 has_streamout(struct pipe_screen *screen)
 {
@@ -1401,6 +1407,15 @@ hud_parse_env_var(struct hud_context *hud, struct pipe_screen *screen,
                                 PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE,
                                 0);
       }
+      else if (strcmp(name, "gpu-time") == 0 &&
+               has_time_elapsed_query(screen)) {
+         hud_pipe_query_install(&hud->batch_query, pane,
+                                "gpu-time",
+                                PIPE_QUERY_TIME_ELAPSED, 0, 0,
+                                PIPE_DRIVER_QUERY_TYPE_MICROSECONDS,
+                                PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE,
+                                0);
+      }
       else if (strcmp(name, "stdout") == 0) {
          to_stdout = true;
       }
@@ -1644,6 +1659,8 @@ print_help(struct pipe_screen *screen)
       puts("    samples-passed");
    if (has_streamout(screen))
       puts("    primitives-generated");
+   if (has_time_elapsed_query(screen))
+      puts("    gpu-time");
 
    if (has_pipeline_stats_query(screen)) {
       puts("    ia-vertices");
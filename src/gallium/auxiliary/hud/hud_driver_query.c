@@ -247,6 +247,10 @@ query_new_value_normal(struct query_info *info, struct pipe_context *pipe)
                assert(info->result_index == 0);
                info->results_cumulative += (uint64_t) (result.f * 1000.0f);
             }
+            else if (info->query_type == PIPE_QUERY_TIME_ELAPSED) {
+               /* nanoseconds */
+               info->results_cumulative += res64[info->result_index] / 1000;
+            }
             else {
                info->results_cumulative += res64[info->result_index];
             }
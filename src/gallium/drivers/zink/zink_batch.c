@@ -77,9 +77,59 @@ reset_obj_list(struct zink_screen *screen, struct zink_batch_state *bs, struct z
 {
    for (unsigned i = 0; i < list->num_buffers; i++)
       reset_obj(screen, bs, list->objs[i]);
+   /* give back storage from a one-off huge batch once batches are small again */
+   if (list->max_buffers > 256 && list->num_buffers * 8 < list->max_buffers) {
+      unsigned new_max = MAX2(list->num_buffers * 2, 256);
+      struct zink_resource_object **objs = realloc(list->objs, new_max * sizeof(void*));
+      if (objs) {
+         list->objs = objs;
+         list->max_buffers = new_max;
+      }
+   }
    list->num_buffers = 0;
 }
 
+static inline unsigned
+obj_set_hash(const struct zink_resource_object *obj, unsigned size)
+{
+   /* bo ids are sequential, so the low bits already spread well */
+   return obj->bo->unique_id & (size - 1);
+}
+
+static bool
+obj_set_resize(struct zink_batch_obj_set *set, unsigned size)
+{
+   struct zink_batch_obj_set_entry *table = calloc(size, sizeof(*table));
+   if (!table)
+      return false;
+   for (unsigned i = 0; set->count && i < set->size; i++) {
+      if (!set->table[i].obj)
+         continue;
+      unsigned j = obj_set_hash(set->table[i].obj, size);
+      while (table[j].obj)
+         j = (j + 1) & (size - 1);
+      table[j] = set->table[i];
+   }
+   free(set->table);
+   set->table = table;
+   set->size = size;
+   return true;
+}
+
+/* empty the set: this is proportional to the table size, which shrinks to follow the working set */
+static void
+obj_set_clear(struct zink_batch_obj_set *set)
+{
+   if (!set->count)
+      return;
+   unsigned count = set->count;
+   set->count = 0;
+   if (set->size > ZINK_BATCH_OBJ_SET_MIN_SIZE && count * 8 < set->size &&
+       obj_set_resize(set, MAX2(util_next_power_of_two(count * 2), ZINK_BATCH_OBJ_SET_MIN_SIZE)))
+      return;
+   memset(set->table, 0, set->size * sizeof(*set->table));
+}
+
 /* reset a given batch state */
 void
 zink_reset_batch_state(struct zink_context *ctx, struct zink_batch_state *bs)
@@ -93,7 +143,11 @@ zink_reset_batch_state(struct zink_context *ctx, struct zink_batch_state *bs)
    if (result != VK_SUCCESS)
       mesa_loge("ZINK: vkResetCommandPool failed (%s)", vk_Result_to_str(result));
 
+   zink_staging_pool_recycle(ctx, bs);
+   zink_gpu_trace_batch_resolve(ctx, bs);
+
    /* unref/reset all used resources */
+   obj_set_clear(&bs->obj_set);
    reset_obj_list(screen, bs, &bs->real_objs);
    reset_obj_list(screen, bs, &bs->slab_objs);
    reset_obj_list(screen, bs, &bs->sparse_objs);
@@ -146,6 +200,7 @@ zink_reset_batch_state(struct zink_context *ctx, struct zink_batch_state *bs)
    bs->resource_size = 0;
    bs->signal_semaphore = VK_NULL_HANDLE;
    bs->sparse_semaphore = VK_NULL_HANDLE;
+   bs->transfer_wait = 0;
    util_dynarray_clear(&bs->wait_semaphore_stages);
 
    bs->present = VK_NULL_HANDLE;
@@ -304,10 +359,15 @@ zink_batch_state_destroy(struct zink_screen *screen, struct zink_batch_state *bs
    free(bs->real_objs.objs);
    free(bs->slab_objs.objs);
    free(bs->sparse_objs.objs);
+   free(bs->obj_set.table);
    util_dynarray_fini(&bs->freed_sparse_backing_bos);
    util_dynarray_fini(&bs->dead_querypools);
+   zink_gpu_trace_batch_deinit(screen, bs);
    util_dynarray_fini(&bs->swapchain_obj);
    util_dynarray_fini(&bs->zombie_samplers);
+   util_dynarray_foreach(&bs->staging_returns, struct pipe_resource*, pres)
+      pipe_resource_reference(pres, NULL);
+   util_dynarray_fini(&bs->staging_returns);
    util_dynarray_fini(&bs->unref_resources);
    util_dynarray_fini(&bs->bindless_releases[0]);
    util_dynarray_fini(&bs->bindless_releases[1]);
@@ -404,11 +464,13 @@ create_batch_state(struct zink_context *ctx)
    util_dynarray_init(&bs->fd_wait_semaphores, NULL);
    util_dynarray_init(&bs->fences, NULL);
    util_dynarray_init(&bs->dead_querypools, NULL);
+   zink_gpu_trace_batch_init(bs);
    util_dynarray_init(&bs->wait_semaphore_stages, NULL);
    util_dynarray_init(&bs->fd_wait_semaphore_stages, NULL);
    util_dynarray_init(&bs->zombie_samplers, NULL);
    util_dynarray_init(&bs->freed_sparse_backing_bos, NULL);
    util_dynarray_init(&bs->unref_resources, NULL);
+   util_dynarray_init(&bs->staging_returns, NULL);
    util_dynarray_init(&bs->acquires, NULL);
    util_dynarray_init(&bs->acquire_flags, NULL);
    util_dynarray_init(&bs->bindless_releases[0], NULL);
@@ -420,7 +482,8 @@ create_batch_state(struct zink_context *ctx)
    mtx_init(&bs->usage.mtx, mtx_plain);
    simple_mtx_init(&bs->ref_lock, mtx_plain);
    simple_mtx_init(&bs->exportable_lock, mtx_plain);
-   memset(&bs->buffer_indices_hashlist, -1, sizeof(bs->buffer_indices_hashlist));
+   if (!obj_set_resize(&bs->obj_set, ZINK_BATCH_OBJ_SET_MIN_SIZE))
+      goto fail;
 
    if (!zink_batch_descriptor_init(screen, bs))
       goto fail;
@@ -561,6 +624,8 @@ zink_start_batch(struct zink_context *ctx)
    struct zink_batch_state *bs = ctx->bs;
 
    bs->usage.unflushed = true;
+   /* sets cached for reuse came from the previous batch's pools */
+   ctx->dd.set_cache_gen++;
 
    VkCommandBufferBeginInfo cbbi = {0};
    cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -635,16 +700,12 @@ post_submit(void *data, void *gdata, int thread_index)
       /* throttle in case something crazy is happening */
       zink_screen_batch_id_wait(screen, bs->fence.batch_id - 2500, OS_TIMEOUT_INFINITE);
    }
-   /* this resets the buffer hashlist for the state's next use */
-   if (bs->hashlist_min != UINT16_MAX)
-      /* only reset a min/max region */
-      memset(&bs->buffer_indices_hashlist[bs->hashlist_min], -1, (bs->hashlist_max - bs->hashlist_min + 1) * sizeof(int16_t));
-   bs->hashlist_min = bs->hashlist_max = UINT16_MAX;
 }
 
 typedef enum {
    ZINK_SUBMIT_WAIT_ACQUIRE,
    ZINK_SUBMIT_WAIT_FD,
+   ZINK_SUBMIT_WAIT_TRANSFER,
    ZINK_SUBMIT_CMDBUF,
    ZINK_SUBMIT_SIGNAL,
    ZINK_SUBMIT_MAX
@@ -700,12 +761,29 @@ submit_queue(void *data, void *gdata, int thread_index)
    assert(util_dynarray_num_elements(&bs->fd_wait_semaphores, VkSemaphore) <= util_dynarray_num_elements(&bs->fd_wait_semaphore_stages, VkPipelineStageFlags));
    si[ZINK_SUBMIT_WAIT_FD].pWaitDstStageMask = bs->fd_wait_semaphore_stages.data;
 
+   /* transfer queue uploads are acquired on the transfer stage: draws never wait on them directly */
+   VkPipelineStageFlags transfer_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+   VkTimelineSemaphoreSubmitInfo transfer_tsi = {0};
+   if (bs->transfer_wait) {
+      transfer_tsi.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+      transfer_tsi.waitSemaphoreValueCount = 1;
+      transfer_tsi.pWaitSemaphoreValues = &bs->transfer_wait;
+      si[ZINK_SUBMIT_WAIT_TRANSFER].pNext = &transfer_tsi;
+      si[ZINK_SUBMIT_WAIT_TRANSFER].waitSemaphoreCount = 1;
+      si[ZINK_SUBMIT_WAIT_TRANSFER].pWaitSemaphores = &ctx->transfer.sem;
+      si[ZINK_SUBMIT_WAIT_TRANSFER].pWaitDstStageMask = &transfer_stage;
+   }
+
    if (si[ZINK_SUBMIT_WAIT_ACQUIRE].waitSemaphoreCount == 0) {
       num_si--;
       submit++;
       if (si[ZINK_SUBMIT_WAIT_FD].waitSemaphoreCount == 0) {
          num_si--;
          submit++;
+         if (si[ZINK_SUBMIT_WAIT_TRANSFER].waitSemaphoreCount == 0) {
+            num_si--;
+            submit++;
+         }
       }
    }
 
@@ -963,41 +1041,34 @@ zink_end_batch(struct zink_context *ctx)
    }
 }
 
-ALWAYS_INLINE static void
-batch_hashlist_update(struct zink_batch_state *bs, unsigned hash)
+static int
+batch_find_resource(struct zink_batch_state *bs, struct zink_resource_object *obj)
 {
-   bs->hashlist_min = bs->hashlist_min == UINT16_MAX ? hash : MIN2(hash, bs->hashlist_min);
-   bs->hashlist_max = bs->hashlist_max == UINT16_MAX ? hash : MAX2(hash, bs->hashlist_max);
+   const struct zink_batch_obj_set *set = &bs->obj_set;
+   /* the table is never full, so an empty slot always ends the probe */
+   for (unsigned i = obj_set_hash(obj, set->size);; i = (i + 1) & (set->size - 1)) {
+      if (set->table[i].obj == obj)
+         return set->table[i].idx;
+      if (!set->table[i].obj)
+         return -1;
+   }
 }
 
-static int
-batch_find_resource(struct zink_batch_state *bs, struct zink_resource_object *obj, struct zink_batch_obj_list *list)
+static void
+batch_add_resource(struct zink_batch_state *bs, struct zink_resource_object *obj, unsigned idx)
 {
-   unsigned hash = obj->bo->unique_id & (BUFFER_HASHLIST_SIZE-1);
-   int buffer_index = bs->buffer_indices_hashlist[hash];
-
-   /* not found or found */
-   if (buffer_index < 0 || (buffer_index < list->num_buffers && list->objs[buffer_index] == obj))
-      return buffer_index;
-
-   /* Hash collision, look for the BO in the list of list->objs linearly. */
-   for (int i = list->num_buffers - 1; i >= 0; i--) {
-      if (list->objs[i] == obj) {
-         /* Put this buffer in the hash list.
-          * This will prevent additional hash collisions if there are
-          * several consecutive lookup_buffer calls for the same buffer.
-          *
-          * Example: Assuming list->objs A,B,C collide in the hash list,
-          * the following sequence of list->objs:
-          *         AAAAAAAAAAABBBBBBBBBBBBBBCCCCCCCC
-          * will collide here: ^ and here:   ^,
-          * meaning that we should get very few collisions in the end. */
-         bs->buffer_indices_hashlist[hash] = i & (BUFFER_HASHLIST_SIZE-1);
-         batch_hashlist_update(bs, hash);
-         return i;
-      }
+   struct zink_batch_obj_set *set = &bs->obj_set;
+   if ((set->count + 1) * 4 > set->size * 3 && !obj_set_resize(set, set->size * 2)) {
+      /* things are about to go dramatically wrong anyway */
+      mesa_loge("zink: batch object set resize failed due to oom!\n");
+      abort();
    }
-   return -1;
+   unsigned i = obj_set_hash(obj, set->size);
+   while (set->table[i].obj)
+      i = (i + 1) & (set->size - 1);
+   set->table[i].obj = obj;
+   set->table[i].idx = idx;
+   set->count++;
 }
 
 void
@@ -1024,11 +1095,15 @@ batch_ptr_add_usage(struct zink_context *ctx, struct set *s, void *ptr)
 ALWAYS_INLINE static void
 check_oom_flush(struct zink_context *ctx)
 {
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
    const VkDeviceSize resource_size = ctx->bs->resource_size;
-   if (resource_size >= zink_screen(ctx->base.screen)->clamp_video_mem) {
+   if (resource_size >= screen->clamp_video_mem) {
        ctx->oom_flush = true;
        ctx->oom_stall = true;
-    }
+   } else if (resource_size >= screen->clamp_video_mem / 4 && p_atomic_read(&screen->pb.budget.pressure)) {
+       /* close to the memory budget: flush sooner so batch references stop holding freed memory */
+       ctx->oom_flush = true;
+   }
 }
 
 /* this adds a ref (batch tracking) */
@@ -1080,7 +1155,7 @@ zink_batch_reference_resource_move(struct zink_context *ctx, struct zink_resourc
    } else {
       list = &bs->sparse_objs;
    }
-   int idx = batch_find_resource(bs, res->obj, list);
+   int idx = batch_find_resource(bs, res->obj);
    if (idx >= 0) {
       simple_mtx_unlock(&bs->ref_lock);
       return true;
@@ -1099,9 +1174,7 @@ zink_batch_reference_resource_move(struct zink_context *ctx, struct zink_resourc
    }
    idx = list->num_buffers++;
    list->objs[idx] = res->obj;
-   unsigned hash = bo->unique_id & (BUFFER_HASHLIST_SIZE-1);
-   bs->buffer_indices_hashlist[hash] = idx & 0x7fff;
-   batch_hashlist_update(bs, hash);
+   batch_add_resource(bs, res->obj, idx);
    bs->last_added_obj = res->obj;
    if (!(res->base.b.flags & PIPE_RESOURCE_FLAG_SPARSE)) {
       bs->resource_size += res->obj->size;
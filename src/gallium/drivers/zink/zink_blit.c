@@ -131,9 +131,15 @@ blit_resolve(struct zink_context *ctx, const struct pipe_blit_info *info, bool *
       region.extent.depth = u_minify(src->base.b.depth0, region.srcSubresource.mipLevel) - region.srcOffset.z;
    if (region.dstOffset.z + region.extent.depth >= u_minify(dst->base.b.depth0, region.dstSubresource.mipLevel))
       region.extent.depth = u_minify(dst->base.b.depth0, region.dstSubresource.mipLevel) - region.dstOffset.z;
+   unsigned trace_region = UINT32_MAX;
+   if (unlikely(ctx->gpu_trace_tid))
+      trace_region = zink_gpu_trace_begin(ctx, cmdbuf, ZINK_GPU_TRACE_RESOLVE, info->dst.format,
+                                          region.extent.width, region.extent.height, region.extent.depth);
    VKCTX(CmdResolveImage)(cmdbuf, use_src->obj->image, src->layout,
                      dst->obj->image, dst->layout,
                      1, &region);
+   if (trace_region != UINT32_MAX)
+      zink_gpu_trace_end(ctx, cmdbuf, trace_region);
    zink_cmd_debug_marker_end(ctx, cmdbuf, marker);
 
    return true;
@@ -287,10 +293,16 @@ blit_native(struct zink_context *ctx, const struct pipe_blit_info *info, bool *n
                                              info->src.box.width, info->src.box.height,
                                              info->dst.box.width, info->dst.box.height);
 
+   unsigned trace_region = UINT32_MAX;
+   if (unlikely(ctx->gpu_trace_tid))
+      trace_region = zink_gpu_trace_begin(ctx, cmdbuf, ZINK_GPU_TRACE_BLIT, info->dst.format,
+                                          info->dst.box.width, info->dst.box.height, info->dst.box.depth);
    VKCTX(CmdBlitImage)(cmdbuf, use_src->obj->image, src->layout,
                   dst->obj->image, dst->layout,
                   1, &region,
                   zink_filter(info->filter));
+   if (trace_region != UINT32_MAX)
+      zink_gpu_trace_end(ctx, cmdbuf, trace_region);
 
    zink_cmd_debug_marker_end(ctx, cmdbuf, marker);
 
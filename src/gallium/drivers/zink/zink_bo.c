@@ -145,6 +145,12 @@ bo_destroy(struct zink_screen *screen, struct pb_buffer *pbuf)
       zink_bo_unmap(screen, bo);
    }
 
+   if (bo->mem) {
+      unsigned heap_idx = screen->info.mem_props.memoryTypes[bo->base.base.placement].heapIndex;
+      simple_mtx_lock(&screen->pb.budget.lock);
+      screen->pb.budget.allocated[heap_idx] -= bo->base.base.size;
+      simple_mtx_unlock(&screen->pb.budget.lock);
+   }
    VKSCR(FreeMemory)(screen->dev, bo->mem, NULL);
 
    simple_mtx_destroy(&bo->lock);
@@ -206,6 +212,113 @@ clean_up_buffer_managers(struct zink_screen *screen)
    return !!num_reclaims;
 }
 
+enum budget_state {
+   BUDGET_OK,
+   BUDGET_TIGHT,
+   BUDGET_OVER,
+};
+
+/* must be called with the budget lock held */
+static void
+budget_query(struct zink_screen *screen)
+{
+   VkPhysicalDeviceMemoryProperties2 mem = {0};
+   mem.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+   VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {0};
+   budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+   mem.pNext = &budget;
+   VKSCR(GetPhysicalDeviceMemoryProperties2)(screen->pdev, &mem);
+
+   for (unsigned i = 0; i < mem.memoryProperties.memoryHeapCount; i++) {
+      screen->pb.budget.usage[i] = budget.heapUsage[i];
+      screen->pb.budget.budget[i] = budget.heapBudget[i];
+      screen->pb.budget.allocated_at_query[i] = screen->pb.budget.allocated[i];
+   }
+}
+
+/* the driver's last report adjusted by what zink allocated or freed since */
+static uint64_t
+budget_estimate(struct zink_screen *screen, unsigned heap_idx)
+{
+   int64_t delta = screen->pb.budget.allocated[heap_idx] - screen->pb.budget.allocated_at_query[heap_idx];
+   return MAX2((int64_t)screen->pb.budget.usage[heap_idx] + delta, 0);
+}
+
+static enum budget_state
+budget_check(struct zink_screen *screen, unsigned heap_idx, uint64_t size)
+{
+   bool have_budget = screen->info.have_EXT_memory_budget && VKSCR(GetPhysicalDeviceMemoryProperties2);
+
+   simple_mtx_lock(&screen->pb.budget.lock);
+   uint64_t limit = screen->pb.budget.budget[heap_idx];
+   uint64_t drift = screen->pb.budget.allocated[heap_idx] > screen->pb.budget.allocated_at_query[heap_idx] ?
+                    screen->pb.budget.allocated[heap_idx] - screen->pb.budget.allocated_at_query[heap_idx] :
+                    screen->pb.budget.allocated_at_query[heap_idx] - screen->pb.budget.allocated[heap_idx];
+   /* other processes change the budget too: requery when close to it or after enough local churn */
+   if (have_budget && (budget_estimate(screen, heap_idx) + size > limit / 8 * 7 || drift > limit / 32)) {
+      budget_query(screen);
+      limit = screen->pb.budget.budget[heap_idx];
+   }
+   uint64_t estimate = budget_estimate(screen, heap_idx) + size;
+   simple_mtx_unlock(&screen->pb.budget.lock);
+
+   /* some drivers report no budget for heaps they don't track */
+   if (!limit)
+      return BUDGET_OK;
+   if (estimate > limit)
+      return BUDGET_OVER;
+   return estimate > limit / 8 * 7 ? BUDGET_TIGHT : BUDGET_OK;
+}
+
+/* make room in a heap before allocating from it:
+ * idle cached buffers and empty slabs are released once the heap gets close to its budget,
+ * and if that isn't enough then submitted work is waited on so that busy ones can go too
+ */
+static void
+budget_reclaim(struct zink_screen *screen, unsigned heap_idx, uint64_t size)
+{
+   enum budget_state state = budget_check(screen, heap_idx, size);
+   p_atomic_set(&screen->pb.budget.pressure, state != BUDGET_OK);
+   if (state == BUDGET_OK)
+      return;
+
+   clean_up_buffer_managers(screen);
+   if (state != BUDGET_OVER || budget_check(screen, heap_idx, size) != BUDGET_OVER)
+      return;
+
+   uint64_t batch_id = p_atomic_read(&screen->curr_batch);
+   if (!screen->info.have_KHR_timeline_semaphore || !batch_id || !screen->pb.bo_cache.num_buffers)
+      return;
+   zink_screen_timeline_wait(screen, batch_id, OS_TIMEOUT_INFINITE);
+   clean_up_buffer_managers(screen);
+}
+
+bool
+zink_bo_over_budget(struct zink_screen *screen, unsigned mem_type_idx, uint64_t size)
+{
+   unsigned heap_idx = screen->info.mem_props.memoryTypes[mem_type_idx].heapIndex;
+   return budget_check(screen, heap_idx, size) == BUDGET_OVER;
+}
+
+/* totals over the device-local heaps, or over all heaps if none is device-local */
+void
+zink_bo_budget_totals(struct zink_screen *screen, uint64_t *usage, uint64_t *budget)
+{
+   bool have_local = false;
+   for (unsigned i = 0; i < screen->info.mem_props.memoryHeapCount; i++)
+      have_local |= !!(screen->info.mem_props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT);
+
+   *usage = *budget = 0;
+   simple_mtx_lock(&screen->pb.budget.lock);
+   for (unsigned i = 0; i < screen->info.mem_props.memoryHeapCount; i++) {
+      if (have_local && !(screen->info.mem_props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+         continue;
+      *usage += budget_estimate(screen, i);
+      *budget += screen->pb.budget.budget[i];
+   }
+   simple_mtx_unlock(&screen->pb.budget.lock);
+}
+
 static unsigned
 get_optimal_alignment(struct zink_screen *screen, uint64_t size, unsigned alignment)
 {
@@ -298,6 +411,11 @@ bo_create_internal(struct zink_screen *screen,
    }
 
    VkResult ret = VKSCR(AllocateMemory)(screen->dev, &mai, NULL, &bo->mem);
+   if (ret == VK_SUCCESS) {
+      simple_mtx_lock(&screen->pb.budget.lock);
+      screen->pb.budget.allocated[vk_heap_idx] += mai.allocationSize;
+      simple_mtx_unlock(&screen->pb.budget.lock);
+   }
    if (!zink_screen_handle_vkresult(screen, ret)) {
       mesa_loge("zink: couldn't allocate memory: heap=%u size=%" PRIu64, heap, size);
       if (zink_debug & ZINK_DEBUG_MEM) {
@@ -676,6 +794,7 @@ no_slab:
    }
 
    /* Create a new one. */
+   budget_reclaim(screen, screen->info.mem_props.memoryTypes[mem_type_idx].heapIndex, size);
    bo = bo_create_internal(screen, size, alignment, heap, mem_type_idx, flags, pNext);
    if (!bo) {
       /* Clean up buffer managers and try again. */
@@ -1340,6 +1459,13 @@ zink_bo_init(struct zink_screen *screen)
    uint64_t total_mem = 0;
    for (uint32_t i = 0; i < screen->info.mem_props.memoryHeapCount; ++i)
       total_mem += screen->info.mem_props.memoryHeaps[i].size;
+
+   /* without VK_EXT_memory_budget, zink's own allocations are checked against the heap sizes */
+   simple_mtx_init(&screen->pb.budget.lock, mtx_plain);
+   for (uint32_t i = 0; i < screen->info.mem_props.memoryHeapCount; ++i)
+      screen->pb.budget.budget[i] = screen->info.mem_props.memoryHeaps[i].size;
+   if (screen->info.have_EXT_memory_budget && VKSCR(GetPhysicalDeviceMemoryProperties2))
+      budget_query(screen);
    /* Create managers. */
    pb_cache_init(&screen->pb.bo_cache, screen->info.mem_props.memoryTypeCount,
                  500000, 2.0f, 0,
@@ -1380,4 +1506,5 @@ zink_bo_deinit(struct zink_screen *screen)
          pb_slabs_deinit(&screen->pb.bo_slabs[i]);
    }
    pb_cache_deinit(&screen->pb.bo_cache);
+   simple_mtx_destroy(&screen->pb.budget.lock);
 }
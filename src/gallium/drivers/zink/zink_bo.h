@@ -113,6 +113,12 @@ zink_bo_deinit(struct zink_screen *screen);
 struct pb_buffer *
 zink_bo_create(struct zink_screen *screen, uint64_t size, unsigned alignment, enum zink_heap heap, enum zink_alloc_flag flags, unsigned mem_type_idx, const void *pNext);
 
+bool
+zink_bo_over_budget(struct zink_screen *screen, unsigned mem_type_idx, uint64_t size);
+
+void
+zink_bo_budget_totals(struct zink_screen *screen, uint64_t *usage, uint64_t *budget);
+
 bool
 zink_bo_get_kms_handle(struct zink_screen *screen, struct zink_bo *bo, int fd, uint32_t *handle);
 
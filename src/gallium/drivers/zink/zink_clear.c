@@ -487,6 +487,10 @@ zink_clear_texture_dynamic(struct pipe_context *pctx,
       if (res->aspect & VK_IMAGE_ASPECT_STENCIL_BIT)
          info.pStencilAttachment = &att;
    }
+   unsigned trace_region = UINT32_MAX;
+   if (unlikely(ctx->gpu_trace_tid))
+      trace_region = zink_gpu_trace_begin(ctx, cmdbuf, ZINK_GPU_TRACE_CLEAR, pres->format,
+                                          box->width, box->height, MAX2(box->depth, 1));
    VKCTX(CmdBeginRendering)(cmdbuf, &info);
    if (!full_clear) {
       VkClearRect rect;
@@ -502,6 +506,8 @@ zink_clear_texture_dynamic(struct pipe_context *pctx,
       VKCTX(CmdClearAttachments)(cmdbuf, 1, &clear_att, 1, &rect);
    }
    VKCTX(CmdEndRendering)(cmdbuf);
+   if (trace_region != UINT32_MAX)
+      zink_gpu_trace_end(ctx, cmdbuf, trace_region);
    zink_batch_reference_resource_rw(ctx, res, true);
    /* this will never destroy the surface */
    pipe_surface_reference(&surf, NULL);
@@ -589,7 +595,12 @@ zink_clear_buffer(struct pipe_context *pctx,
       zink_resource_buffer_transfer_dst_barrier(ctx, res, offset, size);
       VkCommandBuffer cmdbuf = zink_get_cmdbuf(ctx, NULL, res);
       zink_batch_reference_resource_rw(ctx, res, true);
+      unsigned trace_region = UINT32_MAX;
+      if (unlikely(ctx->gpu_trace_tid))
+         trace_region = zink_gpu_trace_begin(ctx, cmdbuf, ZINK_GPU_TRACE_CLEAR, PIPE_FORMAT_NONE, size, 1, 1);
       VKCTX(CmdFillBuffer)(cmdbuf, res->obj->buffer, offset, size, *(uint32_t*)clear_value);
+      if (trace_region != UINT32_MAX)
+         zink_gpu_trace_end(ctx, cmdbuf, trace_region);
       return;
    }
    struct pipe_transfer *xfer;
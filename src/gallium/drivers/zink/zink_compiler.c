@@ -4195,6 +4195,85 @@ zink_shader_compile(struct zink_screen *screen, bool can_shobj, struct zink_shad
    return obj;
 }
 
+/* disk cache entries for compiled variants: this header, then the SPIR-V words */
+struct zink_spirv_cache_entry {
+   uint32_t num_words;
+   uint32_t tcs_vertices_out_word;
+   bool cannot_inline; //compiling found the shader too big for further uniform inlining
+};
+
+static void
+spirv_cache_key(struct zink_screen *screen, struct zink_shader *zs, const struct blob *blob,
+                const void *key_data, size_t key_size, cache_key cache_key)
+{
+   static const char tag[] = "zink-spirv-variant";
+   struct mesa_blake3 ctx;
+   _mesa_blake3_init(&ctx);
+   _mesa_blake3_update(&ctx, tag, sizeof(tag));
+   _mesa_blake3_update(&ctx, blob->data, blob->size);
+   _mesa_blake3_update(&ctx, &zs->sinfo, sizeof(zs->sinfo));
+   if (zs->info.stage == MESA_SHADER_FRAGMENT)
+      _mesa_blake3_update(&ctx, &zs->fs.legacy_shadow_mask, sizeof(zs->fs.legacy_shadow_mask));
+   if (key_size)
+      _mesa_blake3_update(&ctx, key_data, key_size);
+   blake3_hash hash;
+   _mesa_blake3_final(&ctx, hash);
+   /* the cache itself is keyed on the driver build, device and codegen-affecting options */
+   disk_cache_compute_key(screen->disk_cache, hash, sizeof(hash), cache_key);
+}
+
+/* compile a variant from its serialized nir, or load its SPIR-V from the disk cache:
+ * key_data must fully identify the variant alongside the nir
+ */
+struct zink_shader_object
+zink_shader_compile_cached(struct zink_screen *screen, bool can_shobj, struct zink_shader *zs,
+                           struct blob *blob, const struct zink_shader_key *key, const void *extra_data,
+                           struct zink_program *pg, const void *key_data, size_t key_size)
+{
+   /* generated tcs keep their SPIR-V around for patching; debug output needs the nir */
+   bool cacheable = screen->disk_cache &&
+                    !(zs->info.stage == MESA_SHADER_TESS_CTRL && zs->non_fs.is_generated) &&
+                    !(zink_debug & (ZINK_DEBUG_NIR | ZINK_DEBUG_SPIRV | ZINK_DEBUG_TGSI));
+   cache_key cache_key;
+
+   if (cacheable) {
+      spirv_cache_key(screen, zs, blob, key_data, key_size, cache_key);
+      size_t size;
+      struct zink_spirv_cache_entry *entry = disk_cache_get(screen->disk_cache, cache_key, &size);
+      if (entry && size >= sizeof(*entry) &&
+          size == sizeof(*entry) + entry->num_words * sizeof(uint32_t)) {
+         struct spirv_shader *spirv = ralloc(NULL, struct spirv_shader);
+         if (spirv) {
+            spirv->words = ralloc_memdup(spirv, entry + 1, entry->num_words * sizeof(uint32_t));
+            spirv->num_words = entry->num_words;
+            spirv->tcs_vertices_out_word = entry->tcs_vertices_out_word;
+            if (entry->cannot_inline)
+               zs->can_inline = false;
+            free(entry);
+            struct zink_shader_object obj = zink_shader_spirv_compile(screen, zs, spirv, can_shobj, pg);
+            obj.spirv = spirv;
+            return obj;
+         }
+      }
+      free(entry);
+   }
+
+   struct zink_shader_object obj = zink_shader_compile(screen, can_shobj, zs, zink_shader_blob_deserialize(screen, blob),
+                                                       key, extra_data, pg);
+   if (cacheable && obj.spirv) {
+      size_t size = sizeof(struct zink_spirv_cache_entry) + obj.spirv->num_words * sizeof(uint32_t);
+      struct zink_spirv_cache_entry *entry = calloc(1, size);
+      if (entry) {
+         entry->num_words = obj.spirv->num_words;
+         entry->tcs_vertices_out_word = obj.spirv->tcs_vertices_out_word;
+         entry->cannot_inline = !zs->can_inline;
+         memcpy(entry + 1, obj.spirv->words, obj.spirv->num_words * sizeof(uint32_t));
+         disk_cache_put_nocopy(screen->disk_cache, cache_key, entry, size, NULL);
+      }
+   }
+   return obj;
+}
+
 struct zink_shader_object
 zink_shader_compile_separate(struct zink_screen *screen, struct zink_shader *zs)
 {
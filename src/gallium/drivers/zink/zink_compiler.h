@@ -72,6 +72,10 @@ zink_compiler_assign_io(struct zink_screen *screen, nir_shader *producer, nir_sh
 struct zink_shader_object
 zink_shader_compile(struct zink_screen *screen, bool can_shobj, struct zink_shader *zs, nir_shader *nir, const struct zink_shader_key *key, const void *extra_data, struct zink_program *pg);
 struct zink_shader_object
+zink_shader_compile_cached(struct zink_screen *screen, bool can_shobj, struct zink_shader *zs,
+                           struct blob *blob, const struct zink_shader_key *key, const void *extra_data,
+                           struct zink_program *pg, const void *key_data, size_t key_size);
+struct zink_shader_object
 zink_shader_compile_separate(struct zink_screen *screen, struct zink_shader *zs);
 struct zink_shader *
 zink_shader_create(struct zink_screen *screen, struct nir_shader *nir);
@@ -66,8 +66,6 @@
 #define XXH_INLINE_ALL
 #include "util/xxhash.h"
 
-struct pipe_context* zink_xlib_context;
-
 static void
 update_tc_info(struct zink_context *ctx)
 {
@@ -217,6 +215,10 @@ zink_context_destroy(struct pipe_context *pctx)
       screen->last_free_batch_state = screen->last_free_batch_state->next;
    simple_mtx_unlock(&screen->free_batch_states_lock);
 
+   zink_transfer_queue_fini(ctx);
+   /* batch states were cleared above, returning their staging buffers to the pool */
+   zink_staging_pool_fini(ctx);
+
    for (unsigned i = 0; i < 2; i++) {
       util_idalloc_fini(&ctx->di.bindless[i].tex_slots);
       util_idalloc_fini(&ctx->di.bindless[i].img_slots);
@@ -2768,12 +2770,11 @@ begin_rendering(struct zink_context *ctx, bool check_msaa_expand)
             ctx->dynamic_fb.attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
          else
             ctx->dynamic_fb.attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-         if (use_tc_info) {
-            if (ctx->dynamic_fb.tc_info.cbuf_invalidate & BITFIELD_BIT(i))
-               ctx->dynamic_fb.attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-            else
-               ctx->dynamic_fb.attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-         }
+         /* transient samples are kept even when resolved: the rp may be split before the final resolve */
+         if (use_tc_info && ctx->dynamic_fb.tc_info.cbuf_invalidate & BITFIELD_BIT(i))
+            ctx->dynamic_fb.attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+         else
+            ctx->dynamic_fb.attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
          if (ctx->dynamic_fb.attachments[i].loadOp == VK_ATTACHMENT_LOAD_OP_LOAD)
             msaa_expand_mask |= BITFIELD_BIT(i);
       }
@@ -2795,12 +2796,16 @@ begin_rendering(struct zink_context *ctx, bool check_msaa_expand)
          else
             ctx->dynamic_fb.attachments[PIPE_MAX_COLOR_BUFS].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 
-         if (use_tc_info) {
-            if (ctx->dynamic_fb.tc_info.zsbuf_invalidate)
-               ctx->dynamic_fb.attachments[PIPE_MAX_COLOR_BUFS].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-            else
-               ctx->dynamic_fb.attachments[PIPE_MAX_COLOR_BUFS].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-         }
+         const struct tc_renderpass_info *info = &ctx->dynamic_fb.tc_info;
+         if (use_tc_info && info->zsbuf_invalidate)
+            ctx->dynamic_fb.attachments[PIPE_MAX_COLOR_BUFS].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+         else if (use_tc_info && zink_screen_has_store_op_none(zink_screen(ctx->base.screen)) &&
+                  !zink_fb_clear_enabled(ctx, PIPE_MAX_COLOR_BUFS) &&
+                  !(info->zsbuf_clear | info->zsbuf_clear_partial | info->zsbuf_write_fs | info->zsbuf_write_dsa))
+            /* read-only: nothing to write back */
+            ctx->dynamic_fb.attachments[PIPE_MAX_COLOR_BUFS].storeOp = VK_ATTACHMENT_STORE_OP_NONE;
+         else
+            ctx->dynamic_fb.attachments[PIPE_MAX_COLOR_BUFS].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 
          /* maybe TODO but also not handled by legacy rp...
          if (ctx->dynamic_fb.attachments[PIPE_MAX_COLOR_BUFS].loadOp == VK_ATTACHMENT_LOAD_OP_LOAD)
@@ -3066,11 +3071,15 @@ zink_batch_rp(struct zink_context *ctx)
     * - msrtss is TODO
     * - dynamic rendering doesn't have input attachments
     */
+   if (unlikely(ctx->gpu_trace_tid) && !in_rp)
+      zink_gpu_trace_rp_begin(ctx);
    if (!zink_screen(ctx->base.screen)->info.have_KHR_dynamic_rendering ||
        (ctx->fbfetch_outputs && !zink_screen(ctx->base.screen)->info.have_KHR_dynamic_rendering_local_read))
       clear_buffers = zink_begin_render_pass(ctx);
    else
       clear_buffers = begin_rendering(ctx, true);
+   if (unlikely(ctx->gpu_trace_tid))
+      zink_gpu_trace_rp_check(ctx);
    assert(!ctx->rp_changed);
    if (ctx->unordered_blitting)
       ctx->bs->has_reordered_work = true;
@@ -3085,6 +3094,7 @@ zink_batch_rp(struct zink_context *ctx)
       if (ctx->render_condition.query)
          zink_start_conditional_render(ctx);
       zink_clear_framebuffer(ctx, clear_buffers);
+      ctx->hud.store_bytes_saved += zink_render_pass_discarded_bytes(ctx);
       if (ctx->pipeline_changed[0]) {
          for (unsigned i = 0; i < ctx->fb_state.nr_cbufs; i++)
             batch_ref_fb_surface(ctx, ctx->fb_state.cbufs[i]);
@@ -3115,7 +3125,15 @@ zink_batch_no_rp_safe(struct zink_context *ctx)
    else {
       VKCTX(CmdEndRendering)(ctx->bs->cmdbuf);
       ctx->in_rp = false;
+      /* discarded samples must be re-expanded before they can be loaded again */
+      for (unsigned i = 0; i < ctx->fb_state.nr_cbufs; i++) {
+         struct zink_ctx_surface *csurf = (struct zink_ctx_surface*)ctx->fb_state.cbufs[i];
+         if (csurf && csurf->transient && ctx->dynamic_fb.attachments[i].storeOp == VK_ATTACHMENT_STORE_OP_DONT_CARE)
+            csurf->transient_init = false;
+      }
    }
+   if (unlikely(ctx->gpu_trace_tid))
+      zink_gpu_trace_rp_end(ctx);
    assert(!ctx->in_rp);
 }
 
@@ -4035,13 +4053,14 @@ zink_flush(struct pipe_context *pctx,
          * in some cases in order to correctly draw the first frame, though it's
          * unknown at this time why this is the case
          */
-         if (screen->info.have_KHR_timeline_semaphore)
-            zink_screen_timeline_wait(screen, bs->fence.batch_id, OS_TIMEOUT_INFINITE);
-         else
-            zink_vkfence_wait(screen, &bs->fence, OS_TIMEOUT_INFINITE);
-		
+         if (!ctx->first_frame_done) {
+            if (screen->info.have_KHR_timeline_semaphore)
+               zink_screen_timeline_wait(screen, bs->fence.batch_id, OS_TIMEOUT_INFINITE);
+            else
+               zink_vkfence_wait(screen, &bs->fence, OS_TIMEOUT_INFINITE);
+         }
          ctx->first_frame_done = true;
-      }	 
+      }
    }
 }
 
@@ -4697,10 +4716,11 @@ zink_copy_buffer(struct zink_context *ctx, struct zink_resource *dst, struct zin
    zink_cmd_debug_marker_end(ctx, cmdbuf, marker);
 }
 
-void
-zink_copy_image_buffer(struct zink_context *ctx, struct zink_resource *dst, struct zink_resource *src,
-                       unsigned dst_level, unsigned dstx, unsigned dsty, unsigned dstz,
-                       unsigned src_level, const struct pipe_box *src_box, enum pipe_map_flags map_flags)
+static void
+copy_image_buffer(struct zink_context *ctx, struct zink_resource *dst, struct zink_resource *src,
+                  unsigned dst_level, unsigned dstx, unsigned dsty, unsigned dstz,
+                  unsigned src_level, const struct pipe_box *src_box, enum pipe_map_flags map_flags,
+                  unsigned buffer_row_length)
 {
    struct zink_resource *img = dst->base.b.target == PIPE_BUFFER ? src : dst;
    struct zink_resource *use_img = img;
@@ -4731,12 +4751,18 @@ zink_copy_image_buffer(struct zink_context *ctx, struct zink_resource *dst, stru
       if (zink_is_swapchain(img))
          needs_present_readback = zink_kopper_acquire_readback(ctx, img, &use_img);
       zink_screen(ctx->base.screen)->image_barrier(ctx, use_img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 0, 0);
-      zink_resource_buffer_transfer_dst_barrier(ctx, buf, dstx, src_box->width);
+      if (buffer_row_length)
+         zink_resource_buffer_transfer_dst_barrier(ctx, buf, dstx,
+                                                   util_format_get_2d_size(img->base.b.format,
+                                                                           util_format_get_stride(img->base.b.format, buffer_row_length),
+                                                                           src_box->height));
+      else
+         zink_resource_buffer_transfer_dst_barrier(ctx, buf, dstx, src_box->width);
    }
 
    VkBufferImageCopy region = {0};
    region.bufferOffset = buf2img ? src_box->x : dstx;
-   region.bufferRowLength = 0;
+   region.bufferRowLength = buffer_row_length;
    region.bufferImageHeight = 0;
    region.imageSubresource.mipLevel = buf2img ? dst_level : src_level;
    enum pipe_texture_target img_target = img->base.b.target;
@@ -4861,6 +4887,24 @@ zink_copy_image_buffer(struct zink_context *ctx, struct zink_resource *dst, stru
       flush_batch(ctx, false);
 }
 
+void
+zink_copy_image_buffer(struct zink_context *ctx, struct zink_resource *dst, struct zink_resource *src,
+                       unsigned dst_level, unsigned dstx, unsigned dsty, unsigned dstz,
+                       unsigned src_level, const struct pipe_box *src_box, enum pipe_map_flags map_flags)
+{
+   copy_image_buffer(ctx, dst, src, dst_level, dstx, dsty, dstz, src_level, src_box, map_flags, 0);
+}
+
+/* read back an image region into a buffer using a row pitch (in texels) instead of tight packing */
+void
+zink_copy_image_to_buffer_pitched(struct zink_context *ctx, struct zink_resource *dst, unsigned offset,
+                                  unsigned row_length, struct zink_resource *src, unsigned src_level,
+                                  const struct pipe_box *src_box)
+{
+   assert(dst->base.b.target == PIPE_BUFFER && row_length >= src_box->width);
+   copy_image_buffer(ctx, dst, src, 0, offset, 0, 0, src_level, src_box, 0, row_length);
+}
+
 static void
 zink_resource_copy_region(struct pipe_context *pctx,
                           struct pipe_resource *pdst,
@@ -5519,6 +5563,7 @@ zink_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags)
    zink_start_batch(ctx);
    if (!ctx->bs)
       goto fail;
+   zink_transfer_queue_init(ctx);
 
    if (screen->compact_descriptors)
       ctx->invalidate_descriptor_state = zink_context_invalidate_descriptor_state_compact;
@@ -5603,8 +5648,6 @@ zink_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags)
       ctx->no_reorder = true;
 
    if (!(flags & PIPE_CONTEXT_PREFER_THREADED) || flags & PIPE_CONTEXT_COMPUTE_ONLY) {
-      zink_xlib_context = &ctx->base;
-      mesa_logi("base context %u created", (unsigned)zink_xlib_context);
       return &ctx->base;
    }
 
@@ -5628,9 +5671,6 @@ zink_context_create(struct pipe_screen *pscreen, void *priv, unsigned flags)
       ctx->base.set_context_param = zink_set_context_param;
    }
 
-   zink_xlib_context = (struct pipe_context*)tc;
-   mesa_logi("threaded context %u created", (unsigned)zink_xlib_context);
-
    return (struct pipe_context*)tc;
 
 fail:
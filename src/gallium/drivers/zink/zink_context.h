@@ -279,6 +279,10 @@ void
 zink_copy_image_buffer(struct zink_context *ctx, struct zink_resource *dst, struct zink_resource *src,
                        unsigned dst_level, unsigned dstx, unsigned dsty, unsigned dstz,
                        unsigned src_level, const struct pipe_box *src_box, enum pipe_map_flags map_flags);
+void
+zink_copy_image_to_buffer_pitched(struct zink_context *ctx, struct zink_resource *dst, unsigned offset,
+                                  unsigned row_length, struct zink_resource *src, unsigned src_level,
+                                  const struct pipe_box *src_box);
 
 void
 zink_destroy_buffer_view(struct zink_screen *screen, struct zink_buffer_view *buffer_view);
@@ -463,6 +463,37 @@ descriptor_program_num_sizes_compact(VkDescriptorPoolSize *sizes, unsigned desc_
    unreachable("unknown type");
 }
 
+/* the template reads descriptorCount elements at offset into the context: hash those bytes to identify a set */
+static struct zink_descriptor_set_cache *
+create_set_cache(struct zink_program *pg, const VkDescriptorUpdateTemplateEntry *entries, unsigned num_entries)
+{
+   struct zink_descriptor_set_cache *cache = rzalloc_size(pg, sizeof(struct zink_descriptor_set_cache) +
+                                                              num_entries * sizeof(cache->ranges[0]));
+   if (!cache)
+      return NULL;
+   for (unsigned i = 0; i < num_entries; i++) {
+      uint32_t size = entries[i].stride * entries[i].descriptorCount;
+      /* merge contiguous bindings, e.g., consecutive samplers of a stage */
+      if (cache->num_ranges &&
+          cache->ranges[cache->num_ranges - 1].offset + cache->ranges[cache->num_ranges - 1].size == entries[i].offset) {
+         cache->ranges[cache->num_ranges - 1].size += size;
+      } else {
+         cache->ranges[cache->num_ranges].offset = entries[i].offset;
+         cache->ranges[cache->num_ranges].size = size;
+         cache->num_ranges++;
+      }
+      cache->key_size += size;
+   }
+   uint8_t *keys = ralloc_size(cache, cache->key_size * ZINK_DESCRIPTOR_SET_CACHE_SIZE);
+   if (!keys) {
+      ralloc_free(cache);
+      return NULL;
+   }
+   for (unsigned i = 0; i < ZINK_DESCRIPTOR_SET_CACHE_SIZE; i++)
+      cache->entries[i].key = keys + i * cache->key_size;
+   return cache;
+}
+
 /* create all the descriptor objects for a program:
  * called during program creation
  * may be called from threads (no unsafe ctx use!)
@@ -668,6 +699,11 @@ zink_descriptor_program_init(struct zink_context *ctx, struct zink_program *pg)
       if (VKSCR(CreateDescriptorUpdateTemplate)(screen->dev, &template[i], NULL, &t) != VK_SUCCESS)
          return false;
       pg->dd.templates[i] = t;
+      if (!is_push && screen->descriptor_set_cache) {
+         pg->dd.set_cache[i - 1] = create_set_cache(pg, entries[i - 1], wd_count[i]);
+         if (!pg->dd.set_cache[i - 1])
+            return false;
+      }
    }
    return true;
 }
@@ -1227,6 +1263,57 @@ zink_descriptors_update_masked_buffer(struct zink_context *ctx, bool is_compute,
    }
 }
 
+static uint64_t
+set_cache_hash(const struct zink_context *ctx, const struct zink_descriptor_set_cache *cache)
+{
+   uint64_t hash = 0;
+   for (unsigned i = 0; i < cache->num_ranges; i++)
+      hash = XXH64((const uint8_t*)ctx + cache->ranges[i].offset, cache->ranges[i].size, hash);
+   return hash;
+}
+
+/* a matching hash alone could hand out a set written with other descriptors */
+static bool
+set_cache_key_equal(const struct zink_context *ctx, const struct zink_descriptor_set_cache *cache,
+                    const struct zink_descriptor_set_cache_entry *entry)
+{
+   const uint8_t *key = entry->key;
+   for (unsigned i = 0; i < cache->num_ranges; i++) {
+      if (memcmp(key, (const uint8_t*)ctx + cache->ranges[i].offset, cache->ranges[i].size))
+         return false;
+      key += cache->ranges[i].size;
+   }
+   return true;
+}
+
+static VkDescriptorSet
+set_cache_lookup(struct zink_context *ctx, const struct zink_descriptor_set_cache *cache, uint64_t *hash)
+{
+   *hash = set_cache_hash(ctx, cache);
+   const struct zink_descriptor_set_cache_entry *entry = &cache->entries[*hash % ZINK_DESCRIPTOR_SET_CACHE_SIZE];
+   if (entry->set && entry->gen == ctx->dd.set_cache_gen && entry->hash == *hash &&
+       set_cache_key_equal(ctx, cache, entry)) {
+      ctx->hud.set_cache_hits++;
+      return entry->set;
+   }
+   ctx->hud.set_cache_misses++;
+   return VK_NULL_HANDLE;
+}
+
+static void
+set_cache_insert(struct zink_context *ctx, struct zink_descriptor_set_cache *cache, uint64_t hash, VkDescriptorSet set)
+{
+   struct zink_descriptor_set_cache_entry *entry = &cache->entries[hash % ZINK_DESCRIPTOR_SET_CACHE_SIZE];
+   uint8_t *key = entry->key;
+   for (unsigned i = 0; i < cache->num_ranges; i++) {
+      memcpy(key, (const uint8_t*)ctx + cache->ranges[i].offset, cache->ranges[i].size);
+      key += cache->ranges[i].size;
+   }
+   entry->hash = hash;
+   entry->set = set;
+   entry->gen = ctx->dd.set_cache_gen;
+}
+
 /* updates the mask of changed_sets and binds the mask of bind_sets */
 void
 zink_descriptors_update_masked(struct zink_context *ctx, bool is_compute, uint8_t changed_sets, uint8_t bind_sets)
@@ -1240,8 +1327,19 @@ zink_descriptors_update_masked(struct zink_context *ctx, bool is_compute, uint8_
    if (!pg->dd.binding_usage || (!changed_sets && !bind_sets))
       return;
 
+   /* reuse sets already written with identical descriptors in this batch */
+   uint8_t cached_sets = 0;
+   uint64_t hashes[ZINK_DESCRIPTOR_BASE_TYPES];
+   u_foreach_bit(type, changed_sets) {
+      if (pg->dd.set_cache[type]) {
+         desc_sets[type] = set_cache_lookup(ctx, pg->dd.set_cache[type], &hashes[type]);
+         if (desc_sets[type])
+            cached_sets |= BITFIELD_BIT(type);
+      }
+   }
+
    /* populate usable sets for the changed_sets mask */
-   if (!populate_sets(ctx, bs, pg, changed_sets, desc_sets)) {
+   if (!populate_sets(ctx, bs, pg, changed_sets & ~cached_sets, desc_sets)) {
       debug_printf("ZINK: couldn't get descriptor sets!\n");
       return;
    }
@@ -1254,7 +1352,11 @@ zink_descriptors_update_masked(struct zink_context *ctx, bool is_compute, uint8_
          /* templates are indexed by the set id, so increment type by 1
           * (this is effectively an optimization of indirecting through screen->desc_set_id)
           */
-         VKSCR(UpdateDescriptorSetWithTemplate)(screen->dev, desc_sets[type], pg->dd.templates[type + 1], ctx);
+         if (!(cached_sets & BITFIELD_BIT(type))) {
+            VKSCR(UpdateDescriptorSetWithTemplate)(screen->dev, desc_sets[type], pg->dd.templates[type + 1], ctx);
+            if (pg->dd.set_cache[type])
+               set_cache_insert(ctx, pg->dd.set_cache[type], hashes[type], desc_sets[type]);
+         }
          VKSCR(CmdBindDescriptorSets)(bs->cmdbuf,
                                  is_compute ? VK_PIPELINE_BIND_POINT_COMPUTE : VK_PIPELINE_BIND_POINT_GRAPHICS,
                                  /* same set indexing as above */
@@ -1663,9 +1765,11 @@ bool
 zink_descriptor_layouts_init(struct zink_screen *screen)
 {
    for (unsigned i = 0; i < ZINK_DESCRIPTOR_BASE_TYPES; i++) {
-      if (!_mesa_hash_table_init(&screen->desc_set_layouts[i], screen, hash_descriptor_layout, equals_descriptor_layout))
+      if (!_mesa_hash_table_init_with_flags(&screen->desc_set_layouts[i], screen, hash_descriptor_layout, equals_descriptor_layout,
+                                            HASH_TABLE_GROUP_PROBE))
          return false;
-      if (!_mesa_set_init(&screen->desc_pool_keys[i], screen, hash_descriptor_pool_key, equals_descriptor_pool_key))
+      if (!_mesa_set_init_with_flags(&screen->desc_pool_keys[i], screen, hash_descriptor_pool_key, equals_descriptor_pool_key,
+                                     SET_GROUP_PROBE))
          return false;
    }
    simple_mtx_init(&screen->desc_set_layouts_lock, mtx_plain);
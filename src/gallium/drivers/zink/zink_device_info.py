@@ -189,6 +189,8 @@ EXTENSIONS = [
               features=True,
               conditions=["$feats.vertexAttributeInstanceRateDivisor"]),
     Extension("VK_EXT_calibrated_timestamps"),
+    Extension("VK_EXT_load_store_op_none"),
+    Extension("VK_KHR_load_store_op_none"),
     Extension("VK_NV_linear_color_attachment",
               alias="linear_color",
               features=True),
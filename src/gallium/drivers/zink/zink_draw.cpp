@@ -921,6 +921,8 @@ zink_draw(struct pipe_context *pctx,
 
    if (unlikely(zink_tracing))
       zink_cmd_debug_marker_end(ctx, bs->cmdbuf, marker);
+   if (unlikely(ctx->gpu_trace_tid))
+      zink_gpu_trace_draw(ctx, num_draws);
 
    if (have_streamout) {
       for (unsigned i = 0; i < ctx->num_so_targets; i++) {
@@ -1101,11 +1103,21 @@ zink_launch_grid(struct pipe_context *pctx, const struct pipe_grid_info *info)
    zink_batch_no_rp(ctx);
    if (!ctx->queries_disabled)
       zink_resume_cs_query(ctx);
+   unsigned trace_region = UINT32_MAX;
+   if (unlikely(ctx->gpu_trace_tid)) {
+      /* indirect grids are only known to the gpu */
+      trace_region = zink_gpu_trace_begin(ctx, bs->cmdbuf, ZINK_GPU_TRACE_DISPATCH, PIPE_FORMAT_NONE,
+                                          info->indirect ? 0 : info->grid[0],
+                                          info->indirect ? 0 : info->grid[1],
+                                          info->indirect ? 0 : info->grid[2]);
+   }
    if (info->indirect) {
       VKCTX(CmdDispatchIndirect)(bs->cmdbuf, zink_resource(info->indirect)->obj->buffer, info->indirect_offset);
       zink_batch_reference_resource_rw(ctx, zink_resource(info->indirect), false);
    } else
       VKCTX(CmdDispatch)(bs->cmdbuf, info->grid[0], info->grid[1], info->grid[2]);
+   if (trace_region != UINT32_MAX)
+      zink_gpu_trace_end(ctx, bs->cmdbuf, trace_region);
    bs->has_work = true;
    ctx->last_work_was_compute = true;
    /* flush if there's >100k computes */
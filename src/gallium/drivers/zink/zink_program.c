@@ -148,17 +148,6 @@ create_shader_module_for_stage(struct zink_context *ctx, struct zink_screen *scr
       return NULL;
    }
    unsigned patch_vertices = state->shader_keys.key[MESA_SHADER_TESS_CTRL].key.tcs.patch_vertices;
-   if (stage == MESA_SHADER_TESS_CTRL && zs->non_fs.is_generated && zs->spirv) {
-      assert(ctx); //TODO async
-      zm->obj = zink_shader_tcs_compile(screen, zs, patch_vertices, prog->base.uses_shobj, &prog->base);
-   } else {
-      zm->obj = zink_shader_compile(screen, prog->base.uses_shobj, zs, zink_shader_blob_deserialize(screen, &prog->blobs[stage]), key, &ctx->di.zs_swizzle[stage], &prog->base);
-   }
-   if (!zm->obj.mod) {
-      FREE(zm);
-      return NULL;
-   }
-   zm->shobj = prog->base.uses_shobj;
    zm->num_uniforms = inline_size;
    if (!is_nongenerated_tcs) {
       zm->key_size = key->size;
@@ -175,14 +164,28 @@ create_shader_module_for_stage(struct zink_context *ctx, struct zink_screen *scr
    zm->has_nonseamless = has_nonseamless ? 0 : !!nonseamless_size;
    if (inline_size)
       memcpy(zm->key + key->size + nonseamless_size, key->base.inlined_uniform_values, inline_size * sizeof(uint32_t));
+   if (unlikely(shadow_needs_shader_swizzle))
+      memcpy(zm->key + key->size + nonseamless_size + inline_size * sizeof(uint32_t), &ctx->di.zs_swizzle[stage], sizeof(struct zink_zs_swizzle_key));
+   if (stage == MESA_SHADER_TESS_CTRL && zs->non_fs.is_generated && zs->spirv) {
+      assert(ctx); //TODO async
+      zm->obj = zink_shader_tcs_compile(screen, zs, patch_vertices, prog->base.uses_shobj, &prog->base);
+   } else {
+      /* the module key fully identifies the variant */
+      zm->obj = zink_shader_compile_cached(screen, prog->base.uses_shobj, zs, &prog->blobs[stage], key, &ctx->di.zs_swizzle[stage], &prog->base,
+                                           zm->key, key->size + nonseamless_size + inline_size * sizeof(uint32_t) +
+                                                    (shadow_needs_shader_swizzle ? sizeof(struct zink_zs_swizzle_key) : 0));
+   }
+   if (!zm->obj.mod) {
+      FREE(zm);
+      return NULL;
+   }
+   zm->shobj = prog->base.uses_shobj;
    if (stage == MESA_SHADER_TESS_CTRL && zs->non_fs.is_generated)
       zm->hash = patch_vertices;
    else
       zm->hash = shader_module_hash(zm);
-   if (unlikely(shadow_needs_shader_swizzle)) {
-      memcpy(zm->key + key->size + nonseamless_size + inline_size * sizeof(uint32_t), &ctx->di.zs_swizzle[stage], sizeof(struct zink_zs_swizzle_key));
+   if (unlikely(shadow_needs_shader_swizzle))
       zm->hash ^= _mesa_hash_data(&ctx->di.zs_swizzle[stage], sizeof(struct zink_zs_swizzle_key));
-   }
    zm->default_variant = !shadow_needs_shader_swizzle && !inline_size && !util_dynarray_contains(&prog->shader_cache[stage][0][0], void*);
    if (inline_size)
       prog->inlined_variant_count[stage]++;
@@ -261,6 +264,16 @@ create_shader_module_for_stage_optimal(struct zink_context *ctx, struct zink_scr
    if (!zm) {
       return NULL;
    }
+   /* non-generated tcs won't use the shader key */
+   const bool is_nongenerated_tcs = stage == MESA_SHADER_TESS_CTRL && !zs->non_fs.is_generated;
+   if (key && !is_nongenerated_tcs) {
+      zm->key_size = key_size;
+      uint16_t *data = (uint16_t*)zm->key;
+      /* sanitize actual key bits */
+      *data = (*key) & mask;
+      if (unlikely(shadow_needs_shader_swizzle))
+         memcpy(&data[1], &ctx->di.zs_swizzle[stage], sizeof(struct zink_zs_swizzle_key));
+   }
    if (stage == MESA_SHADER_TESS_CTRL && zs->non_fs.is_generated && zs->spirv) {
       assert(ctx || screen->info.dynamic_state2_feats.extendedDynamicState2PatchControlPoints);
       unsigned patch_vertices = 3;
@@ -270,26 +283,21 @@ create_shader_module_for_stage_optimal(struct zink_context *ctx, struct zink_scr
       }
       zm->obj = zink_shader_tcs_compile(screen, zs, patch_vertices, prog->base.uses_shobj, &prog->base);
    } else {
-      zm->obj = zink_shader_compile(screen, prog->base.uses_shobj, zs, zink_shader_blob_deserialize(screen, &prog->blobs[stage]),
-                                    (struct zink_shader_key*)key, shadow_needs_shader_swizzle ? &ctx->di.zs_swizzle[stage] : NULL, &prog->base);
+      /* the sanitized key fully identifies the variant */
+      zm->obj = zink_shader_compile_cached(screen, prog->base.uses_shobj, zs, &prog->blobs[stage],
+                                           (struct zink_shader_key*)key, shadow_needs_shader_swizzle ? &ctx->di.zs_swizzle[stage] : NULL, &prog->base,
+                                           zm->key, key && !is_nongenerated_tcs ?
+                                                    key_size + (shadow_needs_shader_swizzle ? sizeof(struct zink_zs_swizzle_key) : 0) : 0);
    }
    if (!zm->obj.mod) {
       FREE(zm);
       return NULL;
    }
    zm->shobj = prog->base.uses_shobj;
-   /* non-generated tcs won't use the shader key */
-   const bool is_nongenerated_tcs = stage == MESA_SHADER_TESS_CTRL && !zs->non_fs.is_generated;
-   if (key && !is_nongenerated_tcs) {
-      zm->key_size = key_size;
-      uint16_t *data = (uint16_t*)zm->key;
-      /* sanitize actual key bits */
-      *data = (*key) & mask;
-      if (unlikely(shadow_needs_shader_swizzle))
-         memcpy(&data[1], &ctx->di.zs_swizzle[stage], sizeof(struct zink_zs_swizzle_key));
-   }
+   simple_mtx_lock(&prog->shader_cache_lock);
    zm->default_variant = !util_dynarray_contains(&prog->shader_cache[stage][0][0], void*);
    util_dynarray_append(&prog->shader_cache[stage][0][0], void*, zm);
+   simple_mtx_unlock(&prog->shader_cache_lock);
    return zm;
 }
 
@@ -649,13 +657,117 @@ zink_gfx_program_update(struct zink_context *ctx)
    ctx->dirty_gfx_stages = 0;
 }
 
+/* the shader key history stores one entry per recorded optimal key:
+ * entry n of a shader set is keyed by blake3(history_id, n)
+ */
+#define ZINK_KEY_HISTORY_VERSION 1
+#define ZINK_KEY_HISTORY_MAX 32
+
+struct zink_key_history_entry {
+   uint32_t version;
+   uint32_t optimal_key;
+};
+
+struct zink_key_history_write {
+   uint8_t key[20];
+   struct zink_key_history_entry entry;
+};
+
+static void
+key_history_entry_key(const struct zink_gfx_lib_cache *libs, uint32_t idx, uint8_t *key)
+{
+   struct mesa_blake3 ctx;
+   blake3_hash hash;
+   _mesa_blake3_init(&ctx);
+   _mesa_blake3_update(&ctx, libs->history_id, sizeof(libs->history_id));
+   _mesa_blake3_update(&ctx, &idx, sizeof(idx));
+   _mesa_blake3_final(&ctx, hash);
+   memcpy(key, hash, sizeof(libs->history_id));
+}
+
+/* read back the keys recorded for this shader set in previous runs */
+static void
+load_key_history(struct zink_screen *screen, struct zink_gfx_lib_cache *libs)
+{
+   struct mesa_blake3 ctx;
+   blake3_hash hash;
+   _mesa_blake3_init(&ctx);
+   for (unsigned i = 0; i < ZINK_GFX_SHADER_COUNT; i++) {
+      if (libs->shaders[i])
+         _mesa_blake3_update(&ctx, libs->shaders[i]->base.sha1, sizeof(libs->shaders[i]->base.sha1));
+   }
+   _mesa_blake3_final(&ctx, hash);
+   memcpy(libs->history_id, hash, sizeof(libs->history_id));
+   libs->has_history = true;
+
+   for (unsigned i = 0; i < ZINK_KEY_HISTORY_MAX; i++) {
+      uint8_t key[20];
+      size_t size = 0;
+      key_history_entry_key(libs, i, key);
+      struct zink_key_history_entry *entry = foz_read_entry(&screen->key_history, key, &size);
+      if (!entry)
+         break;
+      bool valid = size == sizeof(*entry) && entry->version == ZINK_KEY_HISTORY_VERSION;
+      if (valid)
+         util_dynarray_append(&libs->key_history, uint32_t, entry->optimal_key);
+      free(entry);
+      if (!valid)
+         break;
+   }
+}
+
+static void
+write_key_history_job(void *data, void *gdata, int thread_index)
+{
+   struct zink_key_history_write *job = data;
+   struct zink_screen *screen = gdata;
+   foz_write_entry(&screen->key_history, job->key, &job->entry, sizeof(job->entry));
+   free(job);
+}
+
+/* append a newly-seen variant key of this shader set to the history */
+static void
+record_key_history(struct zink_screen *screen, struct zink_gfx_lib_cache *libs, uint32_t optimal_key)
+{
+   union zink_shader_key_optimal k;
+   k.val = zink_shader_key_optimal_no_tcs(optimal_key);
+   /* shadow swizzles depend on sampler view state which isn't part of the key */
+   if (k.val == ZINK_SHADER_KEY_OPTIMAL_DEFAULT || k.fs.shadow_needs_shader_swizzle)
+      return;
+
+   simple_mtx_lock(&libs->lock);
+   unsigned idx = util_dynarray_num_elements(&libs->key_history, uint32_t);
+   bool found = idx >= ZINK_KEY_HISTORY_MAX;
+   util_dynarray_foreach(&libs->key_history, uint32_t, key) {
+      if (*key == k.val) {
+         found = true;
+         break;
+      }
+   }
+   if (!found)
+      util_dynarray_append(&libs->key_history, uint32_t, k.val);
+   simple_mtx_unlock(&libs->lock);
+   if (found)
+      return;
+
+   struct zink_key_history_write *job = malloc(sizeof(struct zink_key_history_write));
+   if (!job)
+      return;
+   key_history_entry_key(libs, idx, job->key);
+   job->entry.version = ZINK_KEY_HISTORY_VERSION;
+   job->entry.optimal_key = k.val;
+   util_queue_add_job(&screen->cache_put_thread, job, NULL, write_key_history_job, NULL, 0);
+}
+
 ALWAYS_INLINE static bool
 update_gfx_shader_module_optimal(struct zink_context *ctx, struct zink_gfx_program *prog, gl_shader_stage pstage)
 {
    struct zink_screen *screen = zink_screen(ctx->base.screen);
    if (screen->info.have_EXT_graphics_pipeline_library)
       util_queue_fence_wait(&prog->base.cache_fence);
+   simple_mtx_lock(&prog->shader_cache_lock);
    struct zink_shader_module *zm = get_shader_module_for_stage_optimal(ctx, screen, prog->shaders[pstage], prog, pstage, &ctx->gfx_pipeline_state);
+   simple_mtx_unlock(&prog->shader_cache_lock);
    if (!zm) {
       zm = create_shader_module_for_stage_optimal(ctx, screen, prog->shaders[pstage], prog, pstage, &ctx->gfx_pipeline_state);
       perf_debug(ctx, "zink[gfx_compile]: %s shader variant required\n", _mesa_shader_stage_to_string(pstage));
@@ -685,8 +797,10 @@ update_gfx_program_optimal(struct zink_context *ctx, struct zink_gfx_program *pr
       bool changed = update_gfx_shader_module_optimal(ctx, prog, MESA_SHADER_FRAGMENT);
       ctx->gfx_pipeline_state.modules_changed |= changed;
       if (unlikely(shadow_needs_shader_swizzle)) {
+         simple_mtx_lock(&prog->shader_cache_lock);
          struct zink_shader_module **pzm = prog->shader_cache[MESA_SHADER_FRAGMENT][0][0].data;
          ctx->gfx_pipeline_state.shadow = (struct zink_zs_swizzle_key*)pzm[0]->key + sizeof(uint16_t);
+         simple_mtx_unlock(&prog->shader_cache_lock);
       }
    }
    if (prog->shaders[MESA_SHADER_TESS_CTRL] && prog->shaders[MESA_SHADER_TESS_CTRL]->non_fs.is_generated &&
@@ -695,6 +809,8 @@ update_gfx_program_optimal(struct zink_context *ctx, struct zink_gfx_program *pr
       bool changed = update_gfx_shader_module_optimal(ctx, prog, MESA_SHADER_TESS_CTRL);
       ctx->gfx_pipeline_state.modules_changed |= changed;
    }
+   if (prog->libs && prog->libs->has_history && prog->last_variant_hash != ctx->gfx_pipeline_state.optimal_key)
+      record_key_history(zink_screen(ctx->base.screen), prog->libs, ctx->gfx_pipeline_state.optimal_key);
    prog->last_variant_hash = ctx->gfx_pipeline_state.optimal_key;
 }
 
@@ -908,11 +1024,6 @@ update_cs_shader_module(struct zink_context *ctx, struct zink_compute_program *c
          return;
       }
       zm->shobj = false;
-      zm->obj = zink_shader_compile(screen, false, zs, zink_shader_blob_deserialize(screen, &comp->shader->blob), key, zs_swizzle_size ? &ctx->di.zs_swizzle[MESA_SHADER_COMPUTE] : NULL, &comp->base);
-      if (!zm->obj.spirv) {
-         FREE(zm);
-         return;
-      }
       zm->num_uniforms = inline_size;
       zm->key_size = key->size;
       memcpy(zm->key, key, key->size);
@@ -925,6 +1036,12 @@ update_cs_shader_module(struct zink_context *ctx, struct zink_compute_program *c
          memcpy(zm->key + zm->key_size + nonseamless_size, key->base.inlined_uniform_values, inline_size * sizeof(uint32_t));
       if (zs_swizzle_size)
          memcpy(zm->key + zm->key_size + nonseamless_size + inline_size * sizeof(uint32_t), &ctx->di.zs_swizzle[MESA_SHADER_COMPUTE], zs_swizzle_size);
+      zm->obj = zink_shader_compile_cached(screen, false, zs, &comp->shader->blob, key, zs_swizzle_size ? &ctx->di.zs_swizzle[MESA_SHADER_COMPUTE] : NULL, &comp->base,
+                                           zm->key, zm->key_size + nonseamless_size + inline_size * sizeof(uint32_t) + zs_swizzle_size);
+      if (!zm->obj.spirv) {
+         FREE(zm);
+         return;
+      }
 
       zm->hash = shader_module_hash(zm);
       zm->default_variant = false;
@@ -1025,6 +1142,7 @@ zink_gfx_lib_cache_unref(struct zink_screen *screen, struct zink_gfx_lib_cache *
       FREE(gkey);
    }
    ralloc_free(libs->libs.table);
+   util_dynarray_fini(&libs->key_history);
    FREE(libs);
 }
 
@@ -1036,6 +1154,7 @@ create_lib_cache(struct zink_gfx_program *prog, bool generated_tcs)
    if (generated_tcs)
       libs->stages_present &= ~BITFIELD_BIT(MESA_SHADER_TESS_CTRL);
    simple_mtx_init(&libs->lock, mtx_plain);
+   util_dynarray_init(&libs->key_history, NULL);
    if (generated_tcs)
       _mesa_set_init(&libs->libs, NULL, hash_pipeline_lib_generated_tcs, equals_pipeline_lib_generated_tcs);
    else
@@ -1063,6 +1182,9 @@ find_or_create_lib_cache(struct zink_screen *screen, struct zink_gfx_program *pr
    } else {
       libs = create_lib_cache(prog, generated_tcs);
       memcpy(libs->shaders, prog->shaders, sizeof(prog->shaders));
+      /* generated tcs variants depend on patch_vertices, which isn't recorded */
+      if (screen->key_history.alive && !generated_tcs)
+         load_key_history(screen, libs);
       entry->key = libs;
       unsigned refs = 0;
       for (unsigned i = 0; i < MESA_SHADER_COMPUTE; i++) {
@@ -1093,6 +1215,7 @@ gfx_program_create(struct zink_context *ctx,
    prog->gfx_hash = gfx_hash;
    prog->base.removed = true;
    prog->optimal_keys = screen->optimal_keys;
+   simple_mtx_init(&prog->shader_cache_lock, mtx_plain);
 
    prog->has_edgeflags = prog->shaders[MESA_SHADER_VERTEX] &&
                          prog->shaders[MESA_SHADER_VERTEX]->has_edgeflags;
@@ -1674,6 +1797,8 @@ zink_destroy_gfx_program(struct zink_screen *screen,
          blob_finish(&prog->blobs[i]);
       }
    }
+   if (!prog->is_separable)
+      simple_mtx_destroy(&prog->shader_cache_lock);
    if (prog->libs)
       zink_gfx_lib_cache_unref(screen, prog->libs);
 
@@ -2128,7 +2253,7 @@ zink_delete_cs_shader_state(struct pipe_context *pctx, void *cso)
 
 /* caller must lock prog->libs->lock */
 struct zink_gfx_library_key *
-zink_create_pipeline_lib(struct zink_screen *screen, struct zink_gfx_program *prog, struct zink_gfx_pipeline_state *state)
+zink_create_pipeline_lib(struct zink_screen *screen, struct zink_gfx_program *prog, struct zink_shader_object *objs, struct zink_gfx_pipeline_state *state)
 {
    struct zink_gfx_library_key *gkey = CALLOC_STRUCT(zink_gfx_library_key);
    if (!gkey) {
@@ -2139,8 +2264,8 @@ zink_create_pipeline_lib(struct zink_screen *screen, struct zink_gfx_program *pr
    gkey->optimal_key = state->optimal_key;
    assert(gkey->optimal_key);
    for (unsigned i = 0; i < ZINK_GFX_SHADER_COUNT; i++)
-      gkey->modules[i] = prog->objs[i].mod;
-   gkey->pipeline = zink_create_gfx_pipeline_library(screen, prog);
+      gkey->modules[i] = objs[i].mod;
+   gkey->pipeline = zink_create_gfx_pipeline_library(screen, prog, objs);
    _mesa_set_add(&prog->libs->libs, gkey);
    return gkey;
 }
@@ -2169,6 +2294,61 @@ print_exe_stages(VkShaderStageFlags stages)
    unreachable("unhandled combination of stages!");
 }
 
+static struct zink_shader_module *
+find_shader_module_for_key_optimal(struct zink_gfx_program *prog, gl_shader_stage stage, uint16_t val)
+{
+   util_dynarray_foreach(&prog->shader_cache[stage][0][0], struct zink_shader_module *, pzm) {
+      if ((*pzm)->key_size == sizeof(uint16_t) && !memcmp((*pzm)->key, &val, sizeof(uint16_t)))
+         return *pzm;
+   }
+   return NULL;
+}
+
+/* compile the variants recorded for this shader set in previous runs into the
+ * shader module cache and pipeline libraries; prog->objs is left to the draws
+ */
+static void
+precompile_key_history(struct zink_screen *screen, struct zink_gfx_program *prog)
+{
+   uint32_t keys[ZINK_KEY_HISTORY_MAX];
+   simple_mtx_lock(&prog->libs->lock);
+   unsigned num_keys = util_dynarray_num_elements(&prog->libs->key_history, uint32_t);
+   memcpy(keys, prog->libs->key_history.data, num_keys * sizeof(uint32_t));
+   simple_mtx_unlock(&prog->libs->lock);
+   if (!num_keys)
+      return;
+
+   /* only the last vertex stage and the fragment shader have optimal key variants */
+   struct zink_shader_object objs[ZINK_GFX_SHADER_COUNT];
+   memcpy(objs, prog->objs, sizeof(objs));
+   const gl_shader_stage stages[] = {prog->last_vertex_stage->info.stage, MESA_SHADER_FRAGMENT};
+   for (unsigned i = 0; i < num_keys; i++) {
+      struct zink_gfx_pipeline_state state = {0};
+      state.shader_keys_optimal.key.val = keys[i];
+      state.optimal_key = keys[i];
+      bool valid = true;
+      for (unsigned j = 0; j < ARRAY_SIZE(stages) && valid; j++) {
+         gl_shader_stage stage = stages[j];
+         uint16_t val = stage == MESA_SHADER_FRAGMENT ? state.shader_keys_optimal.key.fs_bits :
+                                                        state.shader_keys_optimal.key.vs_bits;
+         simple_mtx_lock(&prog->shader_cache_lock);
+         struct zink_shader_module *zm = find_shader_module_for_key_optimal(prog, stage, val);
+         simple_mtx_unlock(&prog->shader_cache_lock);
+         if (!zm)
+            zm = create_shader_module_for_stage_optimal(NULL, screen, prog->shaders[stage], prog, stage, &state);
+         if (zm)
+            objs[stage] = zm->obj;
+         valid = !!zm;
+      }
+      if (valid && !screen->info.have_EXT_shader_object) {
+         simple_mtx_lock(&prog->libs->lock);
+         if (!_mesa_set_search(&prog->libs->libs, &state.optimal_key))
+            zink_create_pipeline_lib(screen, prog, objs, &state);
+         simple_mtx_unlock(&prog->libs->lock);
+      }
+   }
+}
+
 static void
 gfx_program_precompile_job(void *data, void *gdata, int thread_index)
 {
@@ -2186,9 +2366,11 @@ gfx_program_precompile_job(void *data, void *gdata, int thread_index)
    zink_screen_get_pipeline_cache(screen, &prog->base, true);
    if (!screen->info.have_EXT_shader_object) {
       simple_mtx_lock(&prog->libs->lock);
-      zink_create_pipeline_lib(screen, prog, &state);
+      zink_create_pipeline_lib(screen, prog, prog->objs, &state);
       simple_mtx_unlock(&prog->libs->lock);
    }
+   if (prog->libs && prog->libs->has_history)
+      precompile_key_history(screen, prog);
    zink_screen_update_pipeline_cache(screen, &prog->base, true);
 }
 
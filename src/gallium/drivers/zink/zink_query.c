@@ -5,7 +5,10 @@
 #include "zink_program.h"
 #include "zink_resource.h"
 #include "zink_screen.h"
+#include "zink_xlib.h"
 
+#include "util/format/u_format.h"
+#include "util/u_debug.h"
 #include "util/u_dump.h"
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
@@ -13,6 +16,13 @@
 #define NUM_QUERIES 500
 
 #define ZINK_QUERY_RENDER_PASSES (PIPE_QUERY_DRIVER_SPECIFIC + 0)
+/* one per zink_present_stat */
+#define ZINK_QUERY_PRESENT_FIRST (PIPE_QUERY_DRIVER_SPECIFIC + 1)
+#define ZINK_QUERY_PRESENT_LAST (ZINK_QUERY_PRESENT_FIRST + ZINK_PRESENT_STAT_COUNT - 1)
+#define ZINK_QUERY_STORE_BYTES_SAVED (ZINK_QUERY_PRESENT_LAST + 1)
+#define ZINK_QUERY_SET_CACHE_HIT_RATE (ZINK_QUERY_PRESENT_LAST + 2)
+#define ZINK_QUERY_MEMORY_USAGE (ZINK_QUERY_PRESENT_LAST + 3)
+#define ZINK_QUERY_MEMORY_BUDGET (ZINK_QUERY_PRESENT_LAST + 4)
 
 struct zink_query_pool {
    struct list_head list;
@@ -86,10 +96,24 @@ struct zink_query {
 
    struct zink_resource *predicate;
    bool predicate_dirty;
+
+   uint64_t present_start, present_end; //ns, present-* queries
 };
 
 static const struct pipe_driver_query_info zink_specific_queries[] = {
    {"render-passes", ZINK_QUERY_RENDER_PASSES, { 0 }},
+   {"present-fence-wait", ZINK_QUERY_PRESENT_FIRST + ZINK_PRESENT_STAT_FENCE_WAIT, { 0 },
+    PIPE_DRIVER_QUERY_TYPE_MICROSECONDS, PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE},
+   {"present-readback-map", ZINK_QUERY_PRESENT_FIRST + ZINK_PRESENT_STAT_MAP, { 0 },
+    PIPE_DRIVER_QUERY_TYPE_MICROSECONDS, PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE},
+   {"present-cpu-copy", ZINK_QUERY_PRESENT_FIRST + ZINK_PRESENT_STAT_COPY, { 0 },
+    PIPE_DRIVER_QUERY_TYPE_MICROSECONDS, PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE},
+   {"present-x-put", ZINK_QUERY_PRESENT_FIRST + ZINK_PRESENT_STAT_PUT, { 0 },
+    PIPE_DRIVER_QUERY_TYPE_MICROSECONDS, PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE},
+   {"store-bytes-saved", ZINK_QUERY_STORE_BYTES_SAVED, { 0 }, PIPE_DRIVER_QUERY_TYPE_BYTES},
+   {"descriptor-set-cache-hit-rate", ZINK_QUERY_SET_CACHE_HIT_RATE, { 100 }, PIPE_DRIVER_QUERY_TYPE_PERCENTAGE},
+   {"memory-budget-usage", ZINK_QUERY_MEMORY_USAGE, { 0 }, PIPE_DRIVER_QUERY_TYPE_BYTES},
+   {"memory-budget", ZINK_QUERY_MEMORY_BUDGET, { 0 }, PIPE_DRIVER_QUERY_TYPE_BYTES},
 };
 
 static inline int
@@ -963,6 +987,12 @@ zink_begin_query(struct pipe_context *pctx,
    struct zink_query *query = (struct zink_query *)q;
    struct zink_context *ctx = zink_context(pctx);
 
+   /* present stats are screen-wide totals: results are what accumulated in between */
+   if (query->type >= ZINK_QUERY_PRESENT_FIRST && query->type <= ZINK_QUERY_PRESENT_LAST) {
+      query->present_start = zink_xlib_present_stat(zink_screen(pctx->screen), query->type - ZINK_QUERY_PRESENT_FIRST);
+      return true;
+   }
+
    /* drop all past results */
    reset_qbo(query);
 
@@ -1052,6 +1082,8 @@ zink_end_query(struct pipe_context *pctx,
    struct zink_context *ctx = zink_context(pctx);
    struct zink_query *query = (struct zink_query *)q;
 
+   if (query->type >= ZINK_QUERY_PRESENT_FIRST && query->type <= ZINK_QUERY_PRESENT_LAST)
+      query->present_end = zink_xlib_present_stat(zink_screen(pctx->screen), query->type - ZINK_QUERY_PRESENT_FIRST);
    if (query->type == PIPE_QUERY_TIMESTAMP_DISJOINT || query->type >= PIPE_QUERY_DRIVER_SPECIFIC)
       return true;
 
@@ -1132,6 +1164,32 @@ zink_get_query_result(struct pipe_context *pctx,
       return true;
    }
 
+   if (query->type == ZINK_QUERY_STORE_BYTES_SAVED) {
+      result->u64 = ctx->hud.store_bytes_saved;
+      ctx->hud.store_bytes_saved = 0;
+      return true;
+   }
+
+   if (query->type == ZINK_QUERY_SET_CACHE_HIT_RATE) {
+      uint64_t lookups = ctx->hud.set_cache_hits + ctx->hud.set_cache_misses;
+      result->u64 = lookups ? ctx->hud.set_cache_hits * 100 / lookups : 0;
+      ctx->hud.set_cache_hits = ctx->hud.set_cache_misses = 0;
+      return true;
+   }
+
+   if (query->type == ZINK_QUERY_MEMORY_USAGE || query->type == ZINK_QUERY_MEMORY_BUDGET) {
+      uint64_t usage, budget;
+      zink_bo_budget_totals(zink_screen(pctx->screen), &usage, &budget);
+      result->u64 = query->type == ZINK_QUERY_MEMORY_USAGE ? usage : budget;
+      return true;
+   }
+
+   if (query->type >= ZINK_QUERY_PRESENT_FIRST && query->type <= ZINK_QUERY_PRESENT_LAST) {
+      /* microseconds */
+      result->u64 = (query->present_end - query->present_start) / 1000;
+      return true;
+   }
+
    if (query->needs_update) {
       assert(!ctx->tc || !threaded_query(q)->flushed);
       update_qbo(ctx, query);
@@ -1500,6 +1558,297 @@ zink_get_timestamp(struct pipe_screen *pscreen)
    return timestamp;
 }
 
+/* ZINK_GPU_TRACE=<file> streams the gpu duration of every render pass, dispatch, blit, and clear
+ * to a chrome://tracing (trace event format) json file
+ *
+ * each batch state owns a growing set of timestamp pools which are reset in the reordered cmdbuf
+ * the first time a batch uses them; results are only read back once the batch has completed,
+ * so tracing never adds stalls
+ */
+DEBUG_GET_ONCE_OPTION(zink_gpu_trace, "ZINK_GPU_TRACE", NULL)
+
+static const char *gpu_trace_names[] = {
+   [ZINK_GPU_TRACE_RENDER_PASS] = "renderpass",
+   [ZINK_GPU_TRACE_DISPATCH] = "dispatch",
+   [ZINK_GPU_TRACE_BLIT] = "blit",
+   [ZINK_GPU_TRACE_RESOLVE] = "resolve",
+   [ZINK_GPU_TRACE_CLEAR] = "clear",
+};
+
+static uint32_t
+gpu_trace_program_id(const struct zink_program *pg)
+{
+   uint32_t id = 0;
+   if (pg)
+      memcpy(&id, pg->blake3, sizeof(id));
+   return id;
+}
+
+void
+zink_gpu_trace_screen_init(struct zink_screen *screen)
+{
+   const char *path = debug_get_option_zink_gpu_trace();
+   if (!path)
+      return;
+   if (!screen->timestamp_valid_bits) {
+      mesa_loge("zink: ZINK_GPU_TRACE requires timestamp support on the gfx queue");
+      return;
+   }
+   screen->gpu_trace.file = fopen(path, "w");
+   if (!screen->gpu_trace.file) {
+      mesa_loge("zink: failed to open gpu trace %s", path);
+      return;
+   }
+   simple_mtx_init(&screen->gpu_trace.lock, mtx_plain);
+   /* the closing bracket is optional in the array format, so a trace cut short by a crash still loads */
+   fprintf(screen->gpu_trace.file, "[\n");
+}
+
+void
+zink_gpu_trace_screen_deinit(struct zink_screen *screen)
+{
+   if (!screen->gpu_trace.file)
+      return;
+   fprintf(screen->gpu_trace.file, "\n]\n");
+   fclose(screen->gpu_trace.file);
+   simple_mtx_destroy(&screen->gpu_trace.lock);
+}
+
+static void
+gpu_trace_context_init(struct zink_context *ctx)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   if (!screen->gpu_trace.file)
+      return;
+   simple_mtx_lock(&screen->gpu_trace.lock);
+   ctx->gpu_trace_tid = ++screen->gpu_trace.next_tid;
+   fprintf(screen->gpu_trace.file,
+           "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"zink context %u%s\"}}",
+           screen->gpu_trace.events++ ? ",\n" : "", ctx->gpu_trace_tid, ctx->gpu_trace_tid,
+           ctx->flags & ZINK_CONTEXT_COPY_ONLY ? " (copy)" : "");
+   simple_mtx_unlock(&screen->gpu_trace.lock);
+}
+
+void
+zink_gpu_trace_batch_init(struct zink_batch_state *bs)
+{
+   util_dynarray_init(&bs->gpu_trace.pools, NULL);
+   util_dynarray_init(&bs->gpu_trace.regions, NULL);
+   bs->gpu_trace.rp = UINT32_MAX;
+}
+
+void
+zink_gpu_trace_batch_deinit(struct zink_screen *screen, struct zink_batch_state *bs)
+{
+   util_dynarray_foreach(&bs->gpu_trace.pools, VkQueryPool, pool)
+      VKSCR(DestroyQueryPool)(screen->dev, *pool, NULL);
+   util_dynarray_fini(&bs->gpu_trace.pools);
+   util_dynarray_fini(&bs->gpu_trace.regions);
+}
+
+/* returns the region index to pass to zink_gpu_trace_end, or UINT32_MAX if the region is dropped */
+unsigned
+zink_gpu_trace_begin(struct zink_context *ctx, VkCommandBuffer cmdbuf, enum zink_gpu_trace_kind kind,
+                     enum pipe_format format, uint32_t width, uint32_t height, uint32_t depth)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   struct zink_batch_state *bs = ctx->bs;
+   unsigned idx = util_dynarray_num_elements(&bs->gpu_trace.regions, struct zink_gpu_trace_region);
+   unsigned pool_idx = idx / ZINK_GPU_TRACE_POOL_REGIONS;
+   if (idx % ZINK_GPU_TRACE_POOL_REGIONS == 0) {
+      if (pool_idx == util_dynarray_num_elements(&bs->gpu_trace.pools, VkQueryPool)) {
+         VkQueryPoolCreateInfo pool_create = {0};
+         pool_create.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+         pool_create.queryType = VK_QUERY_TYPE_TIMESTAMP;
+         pool_create.queryCount = ZINK_GPU_TRACE_POOL_REGIONS * 2;
+         VkQueryPool pool;
+         VkResult result = VKSCR(CreateQueryPool)(screen->dev, &pool_create, NULL, &pool);
+         if (result != VK_SUCCESS) {
+            /* stop tracing this context rather than leave render pass regions unbalanced */
+            mesa_loge("ZINK: vkCreateQueryPool failed (%s)", vk_Result_to_str(result));
+            ctx->gpu_trace_tid = 0;
+            return UINT32_MAX;
+         }
+         util_dynarray_append(&bs->gpu_trace.pools, VkQueryPool, pool);
+      }
+      /* the reordered cmdbuf executes before the main cmdbuf, and any timestamps recorded into it
+       * for this pool can only come after this reset
+       */
+      VkQueryPool pool = *util_dynarray_element(&bs->gpu_trace.pools, VkQueryPool, pool_idx);
+      VKCTX(CmdResetQueryPool)(bs->reordered_cmdbuf, pool, 0, ZINK_GPU_TRACE_POOL_REGIONS * 2);
+      bs->has_reordered_work = true;
+   }
+
+   struct zink_gpu_trace_region *region = util_dynarray_grow(&bs->gpu_trace.regions, struct zink_gpu_trace_region, 1);
+   memset(region, 0, sizeof(*region));
+   region->kind = kind;
+   region->format = format;
+   region->dims[0] = width;
+   region->dims[1] = height;
+   region->dims[2] = depth;
+   region->open = true;
+   if (kind == ZINK_GPU_TRACE_DISPATCH)
+      region->program = gpu_trace_program_id(&ctx->curr_compute->base);
+
+   VkQueryPool pool = *util_dynarray_element(&bs->gpu_trace.pools, VkQueryPool, pool_idx);
+   VKCTX(CmdWriteTimestamp)(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, (idx % ZINK_GPU_TRACE_POOL_REGIONS) * 2);
+   return idx;
+}
+
+void
+zink_gpu_trace_end(struct zink_context *ctx, VkCommandBuffer cmdbuf, unsigned idx)
+{
+   struct zink_batch_state *bs = ctx->bs;
+   if (idx == UINT32_MAX)
+      return;
+   VkQueryPool pool = *util_dynarray_element(&bs->gpu_trace.pools, VkQueryPool, idx / ZINK_GPU_TRACE_POOL_REGIONS);
+   VKCTX(CmdWriteTimestamp)(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, (idx % ZINK_GPU_TRACE_POOL_REGIONS) * 2 + 1);
+}
+
+/* called immediately before beginning a render pass in ctx->bs->cmdbuf
+ * unordered blits and clears temporarily swap that for the reordered cmdbuf and begin a render pass
+ * while the main one is still active, so render pass regions nest
+ */
+void
+zink_gpu_trace_rp_begin(struct zink_context *ctx)
+{
+   const struct pipe_framebuffer_state *fb = &ctx->fb_state;
+   struct pipe_surface *psurf = fb->nr_cbufs ? fb->cbufs[0] : NULL;
+   if (!psurf)
+      psurf = fb->zsbuf;
+   unsigned idx = zink_gpu_trace_begin(ctx, ctx->bs->cmdbuf, ZINK_GPU_TRACE_RENDER_PASS,
+                                       psurf ? psurf->format : PIPE_FORMAT_NONE,
+                                       fb->width, fb->height, MAX2(fb->layers, 1));
+   if (idx == UINT32_MAX)
+      return;
+   struct zink_gpu_trace_region *region = util_dynarray_element(&ctx->bs->gpu_trace.regions, struct zink_gpu_trace_region, idx);
+   region->parent = ctx->bs->gpu_trace.rp;
+   ctx->bs->gpu_trace.rp = idx;
+   ctx->bs->gpu_trace.last_program = NULL;
+   region->samples = MAX2(fb->samples, 1);
+   region->attachments = fb->nr_cbufs;
+   region->zs = !!fb->zsbuf;
+}
+
+/* called after zink_batch_rp(), which may have failed to begin a render pass */
+void
+zink_gpu_trace_rp_check(struct zink_context *ctx)
+{
+   unsigned idx = ctx->bs->gpu_trace.rp;
+   if (idx == UINT32_MAX || ctx->in_rp)
+      return;
+   struct zink_gpu_trace_region *region = util_dynarray_element(&ctx->bs->gpu_trace.regions, struct zink_gpu_trace_region, idx);
+   region->open = false;
+   ctx->bs->gpu_trace.rp = region->parent;
+}
+
+/* called immediately after ending a render pass in ctx->bs->cmdbuf */
+void
+zink_gpu_trace_rp_end(struct zink_context *ctx)
+{
+   unsigned idx = ctx->bs->gpu_trace.rp;
+   if (idx == UINT32_MAX)
+      return;
+   zink_gpu_trace_end(ctx, ctx->bs->cmdbuf, idx);
+   ctx->bs->gpu_trace.rp = util_dynarray_element(&ctx->bs->gpu_trace.regions, struct zink_gpu_trace_region, idx)->parent;
+   ctx->bs->gpu_trace.last_program = NULL;
+}
+
+void
+zink_gpu_trace_draw(struct zink_context *ctx, unsigned num_draws)
+{
+   struct zink_batch_state *bs = ctx->bs;
+   if (bs->gpu_trace.rp == UINT32_MAX)
+      return;
+   struct zink_gpu_trace_region *region = util_dynarray_element(&bs->gpu_trace.regions, struct zink_gpu_trace_region, bs->gpu_trace.rp);
+   region->draws += num_draws;
+   if (bs->gpu_trace.last_program != ctx->curr_program) {
+      bs->gpu_trace.last_program = ctx->curr_program;
+      region->program = gpu_trace_program_id(ctx->curr_program ? &ctx->curr_program->base : NULL);
+      region->programs++;
+   }
+}
+
+static void
+gpu_trace_write_region(struct zink_screen *screen, struct zink_context *ctx, const struct zink_batch_state *bs,
+                       const struct zink_gpu_trace_region *region, uint64_t start, uint64_t end)
+{
+   FILE *f = screen->gpu_trace.file;
+   if (!screen->gpu_trace.base)
+      screen->gpu_trace.base = start;
+   fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+           "\"args\":{\"batch\":%" PRIu64 ",\"format\":\"%s\"",
+           screen->gpu_trace.events++ ? ",\n" : "",
+           gpu_trace_names[region->kind], ctx->gpu_trace_tid,
+           ((int64_t)start - (int64_t)screen->gpu_trace.base) / 1000.0,
+           end > start ? (end - start) / 1000.0 : 0.0,
+           bs->fence.batch_id, util_format_short_name(region->format));
+   switch (region->kind) {
+   case ZINK_GPU_TRACE_RENDER_PASS:
+      fprintf(f, ",\"fb\":\"%ux%ux%u\",\"samples\":%u,\"cbufs\":%u,\"zs\":%s,\"draws\":%u,\"programs\":%u,\"program\":\"%08x\"",
+              region->dims[0], region->dims[1], region->dims[2], region->samples,
+              region->attachments, region->zs ? "true" : "false",
+              region->draws, region->programs, region->program);
+      break;
+   case ZINK_GPU_TRACE_DISPATCH:
+      /* indirect dispatches have no cpu-side grid */
+      if (region->dims[0])
+         fprintf(f, ",\"grid\":\"%ux%ux%u\"", region->dims[0], region->dims[1], region->dims[2]);
+      else
+         fprintf(f, ",\"grid\":\"indirect\"");
+      fprintf(f, ",\"program\":\"%08x\"", region->program);
+      break;
+   default:
+      fprintf(f, ",\"box\":\"%ux%ux%u\"", region->dims[0], region->dims[1], region->dims[2]);
+      break;
+   }
+   fprintf(f, "}}");
+}
+
+/* called when a batch state is reset: only regions whose timestamps are already available are written */
+void
+zink_gpu_trace_batch_resolve(struct zink_context *ctx, struct zink_batch_state *bs)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   unsigned num_regions = util_dynarray_num_elements(&bs->gpu_trace.regions, struct zink_gpu_trace_region);
+   bs->gpu_trace.rp = UINT32_MAX;
+   bs->gpu_trace.last_program = NULL;
+   if (!num_regions)
+      return;
+   /* an unsubmitted batch never reset its pools */
+   if (!ctx->gpu_trace_tid || !bs->fence.submitted || bs->is_device_lost) {
+      util_dynarray_clear(&bs->gpu_trace.regions);
+      return;
+   }
+
+   /* [timestamp, availability] pairs */
+   uint64_t results[ZINK_GPU_TRACE_POOL_REGIONS * 2][2];
+   const struct zink_gpu_trace_region *regions = bs->gpu_trace.regions.data;
+   simple_mtx_lock(&screen->gpu_trace.lock);
+   for (unsigned base = 0; base < num_regions; base += ZINK_GPU_TRACE_POOL_REGIONS) {
+      unsigned count = MIN2(num_regions - base, ZINK_GPU_TRACE_POOL_REGIONS);
+      VkQueryPool pool = *util_dynarray_element(&bs->gpu_trace.pools, VkQueryPool, base / ZINK_GPU_TRACE_POOL_REGIONS);
+      VkResult result = VKSCR(GetQueryPoolResults)(screen->dev, pool, 0, count * 2, sizeof(results), results,
+                                                   sizeof(results[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+      if (result != VK_SUCCESS && result != VK_NOT_READY) {
+         mesa_loge("ZINK: vkGetQueryPoolResults failed (%s)", vk_Result_to_str(result));
+         break;
+      }
+      for (unsigned i = 0; i < count; i++) {
+         if (!regions[base + i].open || !results[i * 2][1] || !results[i * 2 + 1][1])
+            continue;
+         uint64_t start = results[i * 2][0];
+         uint64_t end = results[i * 2 + 1][0];
+         timestamp_to_nanoseconds(screen, &start);
+         timestamp_to_nanoseconds(screen, &end);
+         gpu_trace_write_region(screen, ctx, bs, &regions[base + i], start, end);
+      }
+   }
+   fflush(screen->gpu_trace.file);
+   simple_mtx_unlock(&screen->gpu_trace.lock);
+   util_dynarray_clear(&bs->gpu_trace.regions);
+}
+
 void
 zink_context_query_init(struct pipe_context *pctx)
 {
@@ -1515,6 +1864,8 @@ zink_context_query_init(struct pipe_context *pctx)
    pctx->get_query_result_resource = zink_get_query_result_resource;
    pctx->set_active_query_state = zink_set_active_query_state;
    pctx->render_condition = zink_render_condition;
+
+   gpu_trace_context_init(ctx);
 }
 
 int
@@ -63,6 +63,30 @@ zink_context_destroy_query_pools(struct zink_context *ctx);
 uint64_t
 zink_get_timestamp(struct pipe_screen *pscreen);
 
+void
+zink_gpu_trace_screen_init(struct zink_screen *screen);
+void
+zink_gpu_trace_screen_deinit(struct zink_screen *screen);
+void
+zink_gpu_trace_batch_init(struct zink_batch_state *bs);
+void
+zink_gpu_trace_batch_deinit(struct zink_screen *screen, struct zink_batch_state *bs);
+void
+zink_gpu_trace_batch_resolve(struct zink_context *ctx, struct zink_batch_state *bs);
+unsigned
+zink_gpu_trace_begin(struct zink_context *ctx, VkCommandBuffer cmdbuf, enum zink_gpu_trace_kind kind,
+                     enum pipe_format format, uint32_t width, uint32_t height, uint32_t depth);
+void
+zink_gpu_trace_end(struct zink_context *ctx, VkCommandBuffer cmdbuf, unsigned idx);
+void
+zink_gpu_trace_rp_begin(struct zink_context *ctx);
+void
+zink_gpu_trace_rp_check(struct zink_context *ctx);
+void
+zink_gpu_trace_rp_end(struct zink_context *ctx);
+void
+zink_gpu_trace_draw(struct zink_context *ctx, unsigned num_draws);
+
 int
 zink_get_driver_query_group_info(struct pipe_screen *pscreen, unsigned index,
                                  struct pipe_driver_query_group_info *info);
@@ -31,10 +31,22 @@
 #include "zink_screen.h"
 #include "zink_surface.h"
 
+#include "util/format/u_format.h"
 #include "util/u_memory.h"
 #include "util/u_string.h"
 #include "util/u_blitter.h"
 
+static VkAttachmentStoreOp
+get_rt_storeop(const struct zink_screen *screen, const struct zink_rt_attrib *rt, bool zs)
+{
+   if (rt->discard)
+      return VK_ATTACHMENT_STORE_OP_DONT_CARE;
+   /* read-only zs: nothing to write back */
+   if (zs && !rt->needs_write && !rt->clear_color && !rt->clear_stencil && zink_screen_has_store_op_none(screen))
+      return VK_ATTACHMENT_STORE_OP_NONE;
+   return VK_ATTACHMENT_STORE_OP_STORE;
+}
+
 static VkRenderPass
 create_render_pass(struct zink_screen *screen, struct zink_render_pass_state *state, struct zink_render_pass_pipeline_state *pstate)
 {
@@ -56,7 +68,7 @@ create_render_pass(struct zink_screen *screen, struct zink_render_pass_state *st
                                                 state->swapchain_init && rt->swapchain ?
                                                 VK_ATTACHMENT_LOAD_OP_DONT_CARE :
                                                 VK_ATTACHMENT_LOAD_OP_LOAD;
-      attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+      attachments[i].storeOp = get_rt_storeop(screen, rt, false);
       attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
       attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
       /* if layout changes are ever handled here, need VkAttachmentSampleLocationsEXT */
@@ -92,9 +104,9 @@ create_render_pass(struct zink_screen *screen, struct zink_render_pass_state *st
       if (rt->mixed_zs)
          attachments[num_attachments].storeOp = VK_ATTACHMENT_STORE_OP_NONE;
       else
-         attachments[num_attachments].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+         attachments[num_attachments].storeOp = get_rt_storeop(screen, rt, true);
       attachments[num_attachments].stencilLoadOp = rt->clear_stencil ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
-      attachments[num_attachments].stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+      attachments[num_attachments].stencilStoreOp = get_rt_storeop(screen, rt, true);
       /* if layout changes are ever handled here, need VkAttachmentSampleLocationsEXT */
       attachments[num_attachments].initialLayout = layout;
       attachments[num_attachments].finalLayout = layout;
@@ -205,10 +217,7 @@ create_render_pass2(struct zink_screen *screen, struct zink_render_pass_state *s
       pstate->attachments[i].format = attachments[i].format = rt->format;
       pstate->attachments[i].samples = attachments[i].samples = rt->samples;
       attachments[i].loadOp = get_rt_loadop(rt, rt->clear_color);
-
-      /* TODO: need replicate EXT */
-      //attachments[i].storeOp = rt->resolve ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
-      attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+      attachments[i].storeOp = get_rt_storeop(screen, rt, false);
       attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
       attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
       /* if layout changes are ever handled here, need VkAttachmentSampleLocationsEXT */
@@ -254,11 +263,8 @@ create_render_pass2(struct zink_screen *screen, struct zink_render_pass_state *s
       pstate->attachments[num_attachments].samples = attachments[num_attachments].samples = rt->samples;
       attachments[num_attachments].loadOp = get_rt_loadop(rt, rt->clear_color);
       attachments[num_attachments].stencilLoadOp = get_rt_loadop(rt, rt->clear_stencil);
-      /* TODO: need replicate EXT */
-      //attachments[num_attachments].storeOp = rt->resolve ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
-      //attachments[num_attachments].stencilStoreOp = rt->resolve ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
-      attachments[num_attachments].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-      attachments[num_attachments].stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+      attachments[num_attachments].storeOp = get_rt_storeop(screen, rt, true);
+      attachments[num_attachments].stencilStoreOp = attachments[num_attachments].storeOp;
       /* if layout changes are ever handled here, need VkAttachmentSampleLocationsEXT */
       attachments[num_attachments].initialLayout = layout;
       attachments[num_attachments].finalLayout = layout;
@@ -508,6 +514,7 @@ zink_init_zs_attachment(struct zink_context *ctx, struct zink_rt_attrib *rt)
                         (zink_fb_clear_enabled(ctx, PIPE_MAX_COLOR_BUFS) && (zink_fb_clear_element(fb_clear, 0)->zs.bits & PIPE_CLEAR_STENCIL));
    rt->needs_write = needs_write_z | needs_write_s;
    rt->invalid = !zsbuf->valid;
+   rt->discard = false;
    rt->feedback_loop = (ctx->feedback_loops & BITFIELD_BIT(PIPE_MAX_COLOR_BUFS)) > 0;
 }
 
@@ -528,6 +535,7 @@ zink_tc_init_zs_attachment(struct zink_context *ctx, const struct tc_renderpass_
                                            (zink_fb_clear_element(fb_clear, 0)->zs.bits & PIPE_CLEAR_STENCIL);
    rt->needs_write = info->zsbuf_clear | info->zsbuf_clear_partial | info->zsbuf_write_fs | info->zsbuf_write_dsa;
    rt->invalid = !zsbuf->valid;
+   rt->discard = info->zsbuf_invalidate;
    rt->feedback_loop = (ctx->feedback_loops & BITFIELD_BIT(PIPE_MAX_COLOR_BUFS)) > 0;
 }
 
@@ -544,6 +552,7 @@ zink_init_color_attachment(struct zink_context *ctx, unsigned i, struct zink_rt_
       rt->clear_color = zink_fb_clear_enabled(ctx, i) && !zink_fb_clear_first_needs_explicit(&ctx->fb_clears[i]);
       rt->invalid = !zink_resource(psurf->texture)->valid;
       rt->fbfetch = (ctx->fbfetch_outputs & BITFIELD_BIT(i)) > 0;
+      rt->discard = false;
       rt->feedback_loop = (ctx->feedback_loops & BITFIELD_BIT(i)) > 0;
    } else {
       memset(rt, 0, sizeof(struct zink_rt_attrib));
@@ -565,6 +574,7 @@ zink_tc_init_color_attachment(struct zink_context *ctx, const struct tc_renderpa
       rt->clear_color = zink_fb_clear_enabled(ctx, i) && !zink_fb_clear_first_needs_explicit(&ctx->fb_clears[i]);
       rt->invalid = !zink_resource(psurf->texture)->valid;
       rt->fbfetch = (info->cbuf_fbfetch & BITFIELD_BIT(i)) > 0;
+      rt->discard = (info->cbuf_invalidate & BITFIELD_BIT(i)) > 0;
       rt->feedback_loop = (ctx->feedback_loops & BITFIELD_BIT(i)) > 0;
    } else {
       memset(rt, 0, sizeof(struct zink_rt_attrib));
@@ -598,6 +608,10 @@ get_render_pass(struct zink_context *ctx)
             state.rts[i].resolve = true;
             if (!state.rts[i].clear_color)
                state.msaa_expand_mask |= BITFIELD_BIT(i);
+            /* the samples are only dead once the resolve is final, which the store op can't know
+             * when the rp begins: a mid-frame split re-expanding them from the resolve image would
+             * lose their coverage, so they are only discarded when tc reports them invalidated
+             */
          } else {
             state.rts[i].resolve = false;
          }
@@ -894,6 +908,44 @@ begin_render_pass(struct zink_context *ctx)
    return clear_buffers;
 }
 
+static uint64_t
+attachment_size(struct pipe_surface *psurf, unsigned layers)
+{
+   struct zink_surface *transient = zink_transient_surface(psurf);
+   struct pipe_resource *pres = transient ? transient->base.texture : psurf->texture;
+   return (uint64_t)util_format_get_blocksize(psurf->format) * psurf->width * psurf->height *
+          layers * MAX2(pres->nr_samples, 1);
+}
+
+uint64_t
+zink_render_pass_discarded_bytes(struct zink_context *ctx)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   const struct pipe_framebuffer_state *fb = &ctx->fb_state;
+   const struct zink_render_pass *rp = ctx->gfx_pipeline_state.render_pass;
+   unsigned layers = MAX2(zink_framebuffer_get_num_layers(fb), 1);
+   uint64_t bytes = 0;
+
+   for (unsigned i = 0; i < fb->nr_cbufs; i++) {
+      if (!fb->cbufs[i])
+         continue;
+      if (rp ? rp->state.rts[i].discard :
+               ctx->dynamic_fb.attachments[i].storeOp != VK_ATTACHMENT_STORE_OP_STORE)
+         bytes += attachment_size(fb->cbufs[i], layers);
+   }
+   if (fb->zsbuf && !ctx->zsbuf_unused) {
+      bool discard;
+      if (rp)
+         discard = rp->state.have_zsbuf &&
+                   get_rt_storeop(screen, &rp->state.rts[rp->state.num_cbufs], true) != VK_ATTACHMENT_STORE_OP_STORE;
+      else
+         discard = ctx->dynamic_fb.attachments[PIPE_MAX_COLOR_BUFS].storeOp != VK_ATTACHMENT_STORE_OP_STORE;
+      if (discard)
+         bytes += attachment_size(fb->zsbuf, layers);
+   }
+   return bytes;
+}
+
 void
 zink_render_msaa_expand(struct zink_context *ctx, uint32_t msaa_expand_mask)
 {
@@ -980,10 +1032,12 @@ zink_end_render_pass(struct zink_context *ctx)
    if (ctx->in_rp) {
       VKCTX(CmdEndRenderPass)(ctx->bs->cmdbuf);
 
+      const struct zink_render_pass *rp = ctx->gfx_pipeline_state.render_pass;
       for (unsigned i = 0; i < ctx->fb_state.nr_cbufs; i++) {
          struct zink_ctx_surface *csurf = (struct zink_ctx_surface*)ctx->fb_state.cbufs[i];
+         /* discarded samples must be re-expanded before they can be loaded again */
          if (csurf)
-            csurf->transient_init = true;
+            csurf->transient_init = !(rp->state.rts[i].resolve && rp->state.rts[i].discard);
       }
    }
    ctx->in_rp = false;
@@ -61,4 +61,6 @@ void
 zink_tc_init_color_attachment(struct zink_context *ctx, const struct tc_renderpass_info *info, unsigned i, struct zink_rt_attrib *rt);
 void
 zink_render_msaa_expand(struct zink_context *ctx, uint32_t msaa_expand_mask);
+uint64_t
+zink_render_pass_discarded_bytes(struct zink_context *ctx);
 #endif
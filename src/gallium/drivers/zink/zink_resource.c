@@ -30,6 +30,7 @@
 #include "zink_format.h"
 #include "zink_program.h"
 #include "zink_screen.h"
+#include "zink_xlib.h"
 #include "zink_kopper.h"
 
 #ifdef VK_USE_PLATFORM_METAL_EXT
@@ -43,6 +44,7 @@
 #include "util/u_transfer_helper.h"
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
+#include "util/u_surface.h"
 #include "util/u_upload_mgr.h"
 #include "util/os_file.h"
 #include "frontend/winsys_handle.h"
@@ -249,6 +251,8 @@ zink_resource_destroy(struct pipe_screen *pscreen,
    }
    /* no need to do anything for the caches, these objects own the resource lifetimes */
 
+   if (res->dt)
+      zink_xlib_present_destroy(screen, res);
    zink_resource_object_reference(screen, &res->obj, NULL);
    threaded_resource_deinit(pres);
    FREE_CL(res);
@@ -1020,6 +1024,24 @@ allocate_bo(struct zink_screen *screen, const struct pipe_resource *templ,
       assert(zink_mem_type_idx_from_types(screen, heap, reqs->memoryTypeBits) != UINT32_MAX);
    }
 
+   /* once vram is over budget, resources the gpu only reads go to host memory rather than
+    * pushing the heap further: this is where the kernel starts evicting or killing processes
+    */
+   bool demoted = false;
+   if (heap == ZINK_HEAP_DEVICE_LOCAL && !alloc_info->whandle && !alloc_info->user_mem && !obj->exportable &&
+       !(templ->flags & PIPE_RESOURCE_FLAG_SPARSE) &&
+       !(templ->bind & (PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL | PIPE_BIND_SHADER_IMAGE |
+                        PIPE_BIND_SHADER_BUFFER | PIPE_BIND_STREAM_OUTPUT))) {
+      unsigned local_idx = zink_mem_type_idx_from_types(screen, heap, reqs->memoryTypeBits);
+      unsigned host_idx = zink_mem_type_idx_from_types(screen, ZINK_HEAP_HOST_VISIBLE_COHERENT, reqs->memoryTypeBits);
+      if (host_idx != UINT32_MAX &&
+          screen->info.mem_props.memoryTypes[host_idx].heapIndex != screen->info.mem_props.memoryTypes[local_idx].heapIndex &&
+          zink_bo_over_budget(screen, local_idx, reqs->size) && !zink_bo_over_budget(screen, host_idx, reqs->size)) {
+         heap = ZINK_HEAP_HOST_VISIBLE_COHERENT;
+         demoted = true;
+      }
+   }
+
    while (1) {
       /* iterate over all available memory types to reduce chance of oom */
       for (unsigned i = 0; !obj->bo && i < screen->heap_count[heap]; i++) {
@@ -1030,6 +1052,12 @@ allocate_bo(struct zink_screen *screen, const struct pipe_resource *templ,
          obj->bo = zink_bo(zink_bo_create(screen, reqs->size, alignment, heap, mai.pNext ? ZINK_ALLOC_NO_SUBALLOC : 0, mai.memoryTypeIndex, mai.pNext));
       }
 
+      if (!obj->bo && demoted) {
+         /* host memory is full too: try vram after all */
+         heap = ZINK_HEAP_DEVICE_LOCAL;
+         demoted = false;
+         continue;
+      }
       if (obj->bo || heap != ZINK_HEAP_DEVICE_LOCAL_VISIBLE)
          break;
 
@@ -2239,6 +2267,436 @@ destroy_transfer(struct zink_context *ctx, struct zink_transfer *trans)
    }
 }
 
+static unsigned
+staging_pool_bucket(unsigned size)
+{
+   return MAX2(util_logbase2_ceil(size), ZINK_STAGING_POOL_MIN_ORDER) - ZINK_STAGING_POOL_MIN_ORDER;
+}
+
+/* readback staging buffers are recycled: take the smallest idle one of at least the given size */
+static struct pipe_resource *
+staging_pool_get(struct zink_context *ctx, unsigned size, bool *pooled)
+{
+   *pooled = size <= 1u << ZINK_STAGING_POOL_MAX_ORDER;
+   if (!*pooled)
+      return pipe_buffer_create(ctx->base.screen, PIPE_BIND_LINEAR, PIPE_USAGE_STAGING, size);
+
+   size = align(size, 1u << ZINK_STAGING_POOL_MIN_ORDER);
+   struct util_dynarray *bucket = &ctx->staging_pool[staging_pool_bucket(size)];
+   struct zink_staging_entry *best = NULL;
+   util_dynarray_foreach(bucket, struct zink_staging_entry, entry) {
+      if (entry->pres->width0 >= size && (!best || entry->pres->width0 < best->pres->width0))
+         best = entry;
+   }
+   if (best) {
+      struct pipe_resource *pres = best->pres;
+      ctx->staging_pool_size -= pres->width0;
+      *best = util_dynarray_pop(bucket, struct zink_staging_entry);
+      return pres;
+   }
+   return pipe_buffer_create(ctx->base.screen, PIPE_BIND_LINEAR, PIPE_USAGE_STAGING, size);
+}
+
+/* return the staging buffers released during a batch to the pool now that it has completed,
+ * and release the ones which have been idle for too long or all of them when memory is tight
+ */
+void
+zink_staging_pool_recycle(struct zink_context *ctx, struct zink_batch_state *bs)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   bool pressure = p_atomic_read(&screen->pb.budget.pressure);
+   int64_t now = os_time_get_nano();
+
+   for (unsigned i = 0; i < ARRAY_SIZE(ctx->staging_pool); i++) {
+      struct util_dynarray *bucket = &ctx->staging_pool[i];
+      for (unsigned j = 0; j < util_dynarray_num_elements(bucket, struct zink_staging_entry);) {
+         struct zink_staging_entry *entry = util_dynarray_element(bucket, struct zink_staging_entry, j);
+         if (!pressure && now - entry->idle_since < ZINK_STAGING_POOL_TIMEOUT_NS) {
+            j++;
+            continue;
+         }
+         ctx->staging_pool_size -= entry->pres->width0;
+         pipe_resource_reference(&entry->pres, NULL);
+         *entry = util_dynarray_pop(bucket, struct zink_staging_entry);
+      }
+   }
+
+   while (util_dynarray_contains(&bs->staging_returns, struct pipe_resource*)) {
+      struct pipe_resource *pres = util_dynarray_pop(&bs->staging_returns, struct pipe_resource*);
+      struct util_dynarray *bucket = &ctx->staging_pool[staging_pool_bucket(pres->width0)];
+      if (pressure || ctx->staging_pool_size + pres->width0 > ZINK_STAGING_POOL_MAX_SIZE ||
+          util_dynarray_num_elements(bucket, struct zink_staging_entry) >= ZINK_STAGING_POOL_BUCKET_SIZE) {
+         pipe_resource_reference(&pres, NULL);
+         continue;
+      }
+      struct zink_staging_entry entry = {pres, now};
+      util_dynarray_append(bucket, struct zink_staging_entry, entry);
+      ctx->staging_pool_size += pres->width0;
+   }
+}
+
+void
+zink_staging_pool_fini(struct zink_context *ctx)
+{
+   for (unsigned i = 0; i < ARRAY_SIZE(ctx->staging_pool); i++) {
+      util_dynarray_foreach(&ctx->staging_pool[i], struct zink_staging_entry, entry)
+         pipe_resource_reference(&entry->pres, NULL);
+      util_dynarray_fini(&ctx->staging_pool[i]);
+   }
+   ctx->staging_pool_size = 0;
+}
+
+void
+zink_transfer_queue_init(struct zink_context *ctx)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   struct zink_transfer_queue *tq = &ctx->transfer;
+
+   if (screen->transfer_queue == UINT32_MAX || !ctx->have_timelines)
+      return;
+
+   VkCommandPoolCreateInfo cpci = {0};
+   cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+   cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+   cpci.queueFamilyIndex = screen->transfer_queue;
+   if (VKSCR(CreateCommandPool)(screen->dev, &cpci, NULL, &tq->cmdpool) != VK_SUCCESS) {
+      mesa_loge("ZINK: vkCreateCommandPool failed");
+      return;
+   }
+
+   VkCommandBufferAllocateInfo cbai = {0};
+   cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+   cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+   cbai.commandPool = tq->cmdpool;
+   cbai.commandBufferCount = ARRAY_SIZE(tq->cmdbufs);
+   if (VKSCR(AllocateCommandBuffers)(screen->dev, &cbai, tq->cmdbufs) != VK_SUCCESS) {
+      mesa_loge("ZINK: vkAllocateCommandBuffers failed");
+      goto fail;
+   }
+
+   VkSemaphoreTypeCreateInfo tci = {0};
+   tci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+   tci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+   VkSemaphoreCreateInfo sci = {0};
+   sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+   sci.pNext = &tci;
+   if (VKSCR(CreateSemaphore)(screen->dev, &sci, NULL, &tq->sem) != VK_SUCCESS) {
+      mesa_loge("ZINK: vkCreateSemaphore failed");
+      tq->sem = VK_NULL_HANDLE;
+      goto fail;
+   }
+   return;
+
+fail:
+   VKSCR(DestroyCommandPool)(screen->dev, tq->cmdpool, NULL);
+   tq->cmdpool = VK_NULL_HANDLE;
+}
+
+static bool
+transfer_queue_wait(struct zink_screen *screen, struct zink_transfer_queue *tq, uint64_t value)
+{
+   if (screen->device_lost)
+      return true;
+   VkSemaphoreWaitInfo wi = {0};
+   wi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+   wi.semaphoreCount = 1;
+   wi.pSemaphores = &tq->sem;
+   wi.pValues = &value;
+   return zink_screen_handle_vkresult(screen, VKSCR(WaitSemaphores)(screen->dev, &wi, UINT64_MAX));
+}
+
+void
+zink_transfer_queue_fini(struct zink_context *ctx)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   struct zink_transfer_queue *tq = &ctx->transfer;
+
+   if (!tq->sem)
+      return;
+   transfer_queue_wait(screen, tq, tq->value);
+   VKSCR(DestroyCommandPool)(screen->dev, tq->cmdpool, NULL);
+   VKSCR(DestroySemaphore)(screen->dev, tq->sem, NULL);
+}
+
+/* the transfer queue may only write whole mip levels or granularity-aligned boxes */
+static bool
+transfer_queue_box_supported(struct zink_screen *screen, struct zink_resource *res, unsigned level, const struct pipe_box *box)
+{
+   unsigned width = u_minify(res->base.b.width0, level);
+   unsigned height = u_minify(res->base.b.height0, level);
+   unsigned depth = res->base.b.target == PIPE_TEXTURE_3D ? u_minify(res->base.b.depth0, level) : 1;
+   if (res->base.b.target != PIPE_TEXTURE_3D && !box->x && !box->y &&
+       box->width == width && box->height == height)
+      return true;
+   if (!box->x && !box->y && !box->z &&
+       box->width == width && box->height == height && box->depth == depth)
+      return true;
+
+   const VkExtent3D *g = &screen->transfer_granularity;
+   if (!g->width || !g->height || !g->depth)
+      return false;
+   unsigned gw = g->width * util_format_get_blockwidth(res->base.b.format);
+   unsigned gh = g->height * util_format_get_blockheight(res->base.b.format);
+   unsigned gd = res->base.b.target == PIPE_TEXTURE_3D ? g->depth : 1;
+   if (box->x % gw || box->y % gh || (res->base.b.target == PIPE_TEXTURE_3D && box->z % gd))
+      return false;
+   return (box->width % gw == 0 || box->x + box->width == width) &&
+          (box->height % gh == 0 || box->y + box->height == height) &&
+          (res->base.b.target != PIPE_TEXTURE_3D || box->depth % gd == 0 || box->z + box->depth == depth);
+}
+
+/* whether an upload can go through the transfer queue:
+ * the resource must be idle and its previous contents must not be needed,
+ * since they are never released from the gfx queue
+ */
+static bool
+transfer_queue_upload_supported(struct zink_context *ctx, struct zink_resource *res, unsigned usage,
+                                unsigned level, const struct pipe_box *box, unsigned size)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+
+   if (!ctx->transfer.sem || size < ZINK_TRANSFER_QUEUE_MIN_SIZE ||
+       usage & (PIPE_MAP_UNSYNCHRONIZED | TC_TRANSFER_MAP_THREADED_UNSYNC))
+      return false;
+   if (res->base.b.flags & PIPE_RESOURCE_FLAG_SPARSE || res->obj->dt || res->obj->exportable ||
+       res->queue != VK_QUEUE_FAMILY_IGNORED)
+      return false;
+
+   if (res->obj->is_buffer) {
+      bool whole = !box->x && box->width == res->base.b.width0;
+      if (!whole && res->valid_buffer_range.start <= res->valid_buffer_range.end)
+         return false;
+      /* replace the backing storage of a busy buffer rather than waiting */
+      if (whole && !zink_resource_usage_check_completion(screen, res, ZINK_RESOURCE_ACCESS_RW))
+         invalidate_buffer(ctx, res);
+   } else {
+      if (res->aspect != VK_IMAGE_ASPECT_COLOR_BIT || res->linear || res->base.b.nr_samples > 1 ||
+          res->base.b.target == PIPE_TEXTURE_1D_ARRAY || res->fb_bind_count ||
+          util_format_get_num_planes(res->base.b.format) > 1)
+         return false;
+      if (!transfer_queue_box_supported(screen, res, level, box))
+         return false;
+      /* once valid, only an upload which replaces the whole image can be made */
+      if (res->valid) {
+         unsigned layers = res->base.b.target == PIPE_TEXTURE_3D ? res->base.b.depth0 : res->base.b.array_size;
+         if (res->base.b.last_level || box->x || box->y || box->z ||
+             box->width != res->base.b.width0 || box->height != res->base.b.height0 || box->depth != layers)
+            return false;
+      }
+   }
+   return zink_resource_usage_check_completion(screen, res, ZINK_RESOURCE_ACCESS_RW);
+}
+
+static VkCommandBuffer
+transfer_queue_begin(struct zink_context *ctx)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   struct zink_transfer_queue *tq = &ctx->transfer;
+
+   /* the oldest cmdbuf is recycled: this only blocks if all slots are still copying */
+   if (tq->values[tq->next] && !transfer_queue_wait(screen, tq, tq->values[tq->next]))
+      return VK_NULL_HANDLE;
+   VkCommandBuffer cmdbuf = tq->cmdbufs[tq->next];
+   VkCommandBufferBeginInfo cbbi = {0};
+   cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+   if (VKSCR(BeginCommandBuffer)(cmdbuf, &cbbi) != VK_SUCCESS) {
+      mesa_loge("ZINK: vkBeginCommandBuffer failed");
+      return VK_NULL_HANDLE;
+   }
+   return cmdbuf;
+}
+
+static bool
+transfer_queue_submit(struct zink_context *ctx, VkCommandBuffer cmdbuf)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   struct zink_transfer_queue *tq = &ctx->transfer;
+
+   if (VKSCR(EndCommandBuffer)(cmdbuf) != VK_SUCCESS) {
+      mesa_loge("ZINK: vkEndCommandBuffer failed");
+      return false;
+   }
+   uint64_t value = tq->value + 1;
+   VkTimelineSemaphoreSubmitInfo tsi = {0};
+   tsi.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+   tsi.signalSemaphoreValueCount = 1;
+   tsi.pSignalSemaphoreValues = &value;
+   VkSubmitInfo si = {0};
+   si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+   si.pNext = &tsi;
+   si.commandBufferCount = 1;
+   si.pCommandBuffers = &cmdbuf;
+   si.signalSemaphoreCount = 1;
+   si.pSignalSemaphores = &tq->sem;
+
+   simple_mtx_lock(&screen->queue_lock);
+   VkResult result = VKSCR(QueueSubmit)(screen->queue_transfer, 1, &si, VK_NULL_HANDLE);
+   simple_mtx_unlock(&screen->queue_lock);
+   if (result != VK_SUCCESS) {
+      mesa_loge("ZINK: vkQueueSubmit failed (%s)", vk_Result_to_str(result));
+      return false;
+   }
+   tq->values[tq->next] = value;
+   tq->value = value;
+   tq->next = (tq->next + 1) % ARRAY_SIZE(tq->cmdbufs);
+   /* the current batch acquires the resource on the transfer stage after this completes */
+   ctx->bs->transfer_wait = value;
+   return true;
+}
+
+/* copy an upload on the transfer queue and acquire the result in the current batch:
+ * only transfer-stage work in the batch waits for the copy, later users of the
+ * resource are ordered against that acquire by the usual barriers
+ */
+static bool
+transfer_queue_upload(struct zink_context *ctx, struct zink_resource *res, unsigned usage,
+                      unsigned level, const struct pipe_box *box,
+                      const void *data, unsigned stride, uintptr_t layer_stride)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   enum pipe_format format = res->base.b.format;
+   unsigned row = 0, slice = 0, size;
+
+   if (res->obj->is_buffer) {
+      size = box->width;
+   } else {
+      row = util_format_get_stride(format, box->width);
+      slice = util_format_get_2d_size(format, row, box->height);
+      size = slice * box->depth;
+   }
+   if (!transfer_queue_upload_supported(ctx, res, usage, level, box, size))
+      return false;
+
+   bool pooled;
+   struct pipe_resource *staging = staging_pool_get(ctx, size, &pooled);
+   if (!staging)
+      return false;
+   struct zink_resource *staging_res = zink_resource(staging);
+   uint8_t *ptr = map_resource(screen, staging_res);
+   if (!ptr)
+      goto fail;
+   if (res->obj->is_buffer)
+      memcpy(ptr, data, size);
+   else
+      util_copy_box(ptr, format, row, slice, 0, 0, 0, box->width, box->height, box->depth,
+                    data, stride, layer_stride, 0, 0, 0);
+   if (!staging_res->obj->coherent) {
+      VkMappedMemoryRange range = zink_resource_init_mem_range(screen, staging_res->obj, staging_res->obj->offset, staging_res->obj->size);
+      if (VKSCR(FlushMappedMemoryRanges)(screen->dev, 1, &range) != VK_SUCCESS)
+         mesa_loge("ZINK: vkFlushMappedMemoryRanges failed");
+   }
+   unmap_resource(screen, staging_res);
+
+   VkCommandBuffer cmdbuf = transfer_queue_begin(ctx);
+   if (!cmdbuf)
+      goto fail;
+
+   if (res->obj->is_buffer) {
+      VkBufferCopy region = {0, box->x, box->width};
+      VKCTX(CmdCopyBuffer)(cmdbuf, staging_res->obj->buffer, res->obj->buffer, 1, &region);
+      VkBufferMemoryBarrier bmb = {
+         VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+         NULL,
+         VK_ACCESS_TRANSFER_WRITE_BIT,
+         0,
+         screen->transfer_queue,
+         screen->gfx_queue,
+         res->obj->buffer,
+         0,
+         VK_WHOLE_SIZE
+      };
+      VKCTX(CmdPipelineBarrier)(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                0, 0, NULL, 1, &bmb, 0, NULL);
+   } else {
+      bool is_arrayed = res->base.b.target == PIPE_TEXTURE_2D_ARRAY ||
+                        res->base.b.target == PIPE_TEXTURE_CUBE ||
+                        res->base.b.target == PIPE_TEXTURE_CUBE_ARRAY;
+      /* previous contents are discarded: transition from UNDEFINED */
+      VkImageMemoryBarrier imb = {
+         VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+         NULL,
+         0,
+         VK_ACCESS_TRANSFER_WRITE_BIT,
+         VK_IMAGE_LAYOUT_UNDEFINED,
+         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+         VK_QUEUE_FAMILY_IGNORED,
+         VK_QUEUE_FAMILY_IGNORED,
+         res->obj->image,
+         {res->aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS}
+      };
+      VKCTX(CmdPipelineBarrier)(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                0, 0, NULL, 0, NULL, 1, &imb);
+      VkBufferImageCopy region = {
+         0, 0, 0,
+         {res->aspect, level, is_arrayed ? box->z : 0, is_arrayed ? box->depth : 1},
+         {box->x, box->y, is_arrayed ? 0 : box->z},
+         {box->width, box->height, is_arrayed ? 1 : box->depth}
+      };
+      VKCTX(CmdCopyBufferToImage)(cmdbuf, staging_res->obj->buffer, res->obj->image,
+                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+      /* release without a layout change: the acquire must match it exactly */
+      imb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      imb.dstAccessMask = 0;
+      imb.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      imb.srcQueueFamilyIndex = screen->transfer_queue;
+      imb.dstQueueFamilyIndex = screen->gfx_queue;
+      VKCTX(CmdPipelineBarrier)(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                0, 0, NULL, 0, NULL, 1, &imb);
+   }
+
+   if (!transfer_queue_submit(ctx, cmdbuf))
+      goto fail;
+
+   if (res->obj->is_buffer) {
+      bool unordered = zink_resource_buffer_transfer_dst_barrier(ctx, res, box->x, box->width);
+      bool can_unorder = unordered && !ctx->no_reorder;
+      VkCommandBuffer gfx_cmdbuf = can_unorder ? ctx->bs->reordered_cmdbuf : zink_get_cmdbuf(ctx, NULL, res);
+      ctx->bs->has_reordered_work |= can_unorder;
+      VkBufferMemoryBarrier bmb = {
+         VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+         NULL,
+         0,
+         VK_ACCESS_TRANSFER_WRITE_BIT,
+         screen->transfer_queue,
+         screen->gfx_queue,
+         res->obj->buffer,
+         0,
+         VK_WHOLE_SIZE
+      };
+      VKCTX(CmdPipelineBarrier)(gfx_cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                0, 0, NULL, 1, &bmb, 0, NULL);
+      util_range_add(&res->base.b, &res->valid_buffer_range, box->x, box->x + box->width);
+   } else {
+      /* the image barrier emits the matching acquire for a resource owned by another queue */
+      res->layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      res->obj->access = VK_ACCESS_TRANSFER_WRITE_BIT;
+      res->obj->access_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+      res->obj->last_write = VK_ACCESS_TRANSFER_WRITE_BIT;
+      res->queue = screen->transfer_queue;
+      screen->image_barrier(ctx, res, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+      if (res->obj->copies_need_reset)
+         zink_resource_copies_reset(res);
+      zink_resource_copy_box_add(ctx, res, level, box);
+      res->valid = true;
+   }
+   zink_batch_reference_resource_rw(ctx, res, true);
+   /* the batch waits for the copy, so its completion also frees the staging buffer */
+   zink_batch_reference_resource_rw(ctx, staging_res, false);
+   if (pooled)
+      util_dynarray_append(&ctx->bs->staging_returns, struct pipe_resource*, staging);
+   else
+      pipe_resource_reference(&staging, NULL);
+   return true;
+
+fail:
+   if (pooled)
+      util_dynarray_append(&ctx->bs->staging_returns, struct pipe_resource*, staging);
+   else
+      pipe_resource_reference(&staging, NULL);
+   return false;
+}
+
 static void *
 zink_buffer_map(struct pipe_context *pctx,
                     struct pipe_resource *pres,
@@ -2477,19 +2935,24 @@ zink_image_map(struct pipe_context *pctx,
                                                          trans->base.b.stride,
                                                          box->height);
 
-      struct pipe_resource templ = *pres;
-      templ.next = NULL;
-      templ.format = format;
-      templ.usage = usage & PIPE_MAP_READ ? PIPE_USAGE_STAGING : PIPE_USAGE_STREAM;
-      templ.target = PIPE_BUFFER;
-      templ.bind = PIPE_BIND_LINEAR;
-      templ.width0 = trans->base.b.layer_stride * box->depth;
-      templ.height0 = templ.depth0 = 0;
-      templ.last_level = 0;
-      templ.array_size = 1;
-      templ.flags = 0;
-
-      trans->staging_res = zink_resource_create(pctx->screen, &templ);
+      if (usage & PIPE_MAP_READ) {
+         trans->staging_res = staging_pool_get(ctx, trans->base.b.layer_stride * box->depth,
+                                               &trans->staging_pooled);
+      } else {
+         struct pipe_resource templ = *pres;
+         templ.next = NULL;
+         templ.format = format;
+         templ.usage = PIPE_USAGE_STREAM;
+         templ.target = PIPE_BUFFER;
+         templ.bind = PIPE_BIND_LINEAR;
+         templ.width0 = trans->base.b.layer_stride * box->depth;
+         templ.height0 = templ.depth0 = 0;
+         templ.last_level = 0;
+         templ.array_size = 1;
+         templ.flags = 0;
+
+         trans->staging_res = zink_resource_create(pctx->screen, &templ);
+      }
       if (!trans->staging_res)
          goto fail;
 
@@ -2501,8 +2964,8 @@ zink_image_map(struct pipe_context *pctx,
          if (zink_resource_usage_is_unflushed_write(res))
             zink_resource_usage_wait(ctx, res, ZINK_RESOURCE_ACCESS_WRITE);
          zink_transfer_copy_bufimage(ctx, staging_res, res, trans);
-         /* need to wait for rendering to finish */
-         zink_fence_wait(pctx);
+         /* only the batch with the copy needs to finish */
+         zink_resource_usage_wait(ctx, staging_res, ZINK_RESOURCE_ACCESS_WRITE);
       }
 
       ptr = map_resource(screen, staging_res);
@@ -2667,6 +3130,9 @@ zink_image_subdata(struct pipe_context *pctx,
       res->valid = true;
       return;
    }
+   /* large uploads of discardable contents can run on the transfer queue */
+   if (transfer_queue_upload(ctx, res, usage, level, box, data, stride, layer_stride))
+      return;
    /* fallback case for per-resource unsupported or device-level unsupported */
    u_default_texture_subdata(pctx, pres, level, usage, box, data, stride, layer_stride);
 }
@@ -2960,8 +3426,13 @@ transfer_unmap(struct pipe_context *pctx, struct pipe_transfer *ptrans)
       zink_transfer_flush_region(pctx, ptrans, &box);
    }
 
-   if (trans->staging_res)
+   if (trans->staging_pooled) {
+      /* back to the pool once anything recorded with it so far has completed */
+      util_dynarray_append(&ctx->bs->staging_returns, struct pipe_resource*, trans->staging_res);
+      trans->staging_res = NULL;
+   } else if (trans->staging_res) {
       pipe_resource_reference(&trans->staging_res, NULL);
+   }
    pipe_resource_reference(&trans->base.b.resource, NULL);
 
    destroy_transfer(ctx, trans);
@@ -3020,6 +3491,9 @@ zink_buffer_subdata(struct pipe_context *ctx, struct pipe_resource *buffer,
       usage |= PIPE_MAP_DISCARD_RANGE;
 
    u_box_1d(offset, size, &box);
+   if (!(usage & PIPE_MAP_DIRECTLY) &&
+       transfer_queue_upload(zink_context(ctx), zink_resource(buffer), usage, 0, &box, data, 0, 0))
+      return;
    map = zink_buffer_map(ctx, buffer, 0, usage, &box, &transfer);
    if (!map)
       return;
@@ -77,6 +77,15 @@ zink_resource_object_init_storage(struct zink_context *ctx, struct zink_resource
 bool
 zink_resource_object_init_mutable(struct zink_context *ctx, struct zink_resource *res);
 
+void
+zink_staging_pool_recycle(struct zink_context *ctx, struct zink_batch_state *bs);
+void
+zink_staging_pool_fini(struct zink_context *ctx);
+void
+zink_transfer_queue_init(struct zink_context *ctx);
+void
+zink_transfer_queue_fini(struct zink_context *ctx);
+
 VkDeviceAddress
 zink_resource_get_address(struct zink_screen *screen, struct zink_resource *res);
 
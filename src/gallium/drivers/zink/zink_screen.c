@@ -38,12 +38,15 @@
 #include "zink_query.h"
 #include "zink_resource.h"
 #include "zink_state.h"
+#include "zink_xlib.h"
 #include "nir_to_spirv/nir_to_spirv.h" // for SPIRV_VERSION
 
+#include "util/disk_cache_os.h"
 #include "util/u_debug.h"
 #include "util/u_dl.h"
 #include "util/os_file.h"
 #include "util/u_memory.h"
+#include "util/u_process.h"
 #include "util/u_screen.h"
 #include "util/u_string.h"
 #include "util/perf/u_trace.h"
@@ -56,7 +59,6 @@
 #include "driver_trace/tr_context.h"
 
 #include "frontend/sw_winsys.h"
-extern struct pipe_context* zink_xlib_context;
 
 typedef unsigned char ubyte;
 
@@ -274,6 +276,34 @@ get_video_mem(struct zink_screen *screen)
    return size;
 }
 
+#ifdef ENABLE_SHADER_CACHE
+/* The shader key history is a small per-application fossilize db next to the
+ * single-file shader cache which records the shader variants (optimal keys)
+ * hit at runtime, so that they can be precompiled along with the default
+ * variant on the next run.
+ */
+static void
+key_history_init(struct zink_screen *screen, const char *cache_id)
+{
+#if !DETECT_OS_WINDOWS
+   if (!debug_get_bool_option("ZINK_SHADER_KEY_HISTORY", true))
+      return;
+
+   const char *process_name = util_get_process_name();
+   if (!process_name || !process_name[0])
+      return;
+
+   char *path = disk_cache_generate_cache_dir(screen, "zink", cache_id, DISK_CACHE_SINGLE_FILE);
+   if (!path)
+      return;
+
+   char *name = ralloc_asprintf(screen, "zink_keys_%s", process_name);
+   if (!foz_prepare_single(&screen->key_history, path, name))
+      mesa_logw("zink: failed to open shader key history in %s", path);
+#endif
+}
+#endif
+
 /**
  * Creates the disk cache used by mesa/st frontend for caching the GLSL -> NIR
  * path.
@@ -349,7 +379,8 @@ disk_cache_init(struct zink_screen *screen)
    if (!screen->disk_cache)
       return true;
 
-   if (!util_queue_init(&screen->cache_put_thread, "zcq", 8, 1, UTIL_QUEUE_INIT_RESIZE_IF_FULL, screen)) {
+   if (!util_queue_init(&screen->cache_put_thread, "zcq", 8, 1,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL | UTIL_QUEUE_INIT_BACKGROUND_THREADS, screen)) {
       mesa_loge("zink: Failed to create disk cache queue\n");
 
       disk_cache_destroy(screen->disk_cache);
@@ -357,6 +388,8 @@ disk_cache_init(struct zink_screen *screen)
 
       return false;
    }
+
+   key_history_init(screen, cache_id);
 #endif
 
    return true;
@@ -1388,6 +1421,11 @@ zink_is_format_supported(struct pipe_screen *pscreen,
          return false;
    }
 
+   /* sw winsys presents can reorder 8-bit channels into any X visual layout, see zink_xlib.c */
+   if (bind == PIPE_BIND_DISPLAY_TARGET && screen->winsys &&
+       util_format_is_rgba8_variant(util_format_description(format)))
+      return true;
+
    /* always use superset to determine feature support */
    VkFormat vkformat = zink_get_format(screen, PIPE_FORMAT_A8_UNORM ? zink_format_get_emulated_alpha(format) : format);
    if (vkformat == VK_FORMAT_UNDEFINED)
@@ -1594,6 +1632,10 @@ zink_destroy_screen(struct pipe_screen *pscreen)
 
    if (screen->copy_context)
       screen->copy_context->base.destroy(&screen->copy_context->base);
+   zink_xlib_screen_destroy(screen);
+   if (screen->present_context)
+      screen->present_context->base.destroy(&screen->present_context->base);
+   zink_gpu_trace_screen_deinit(screen);
 
    struct zink_batch_state *bs = screen->free_batch_states;
    while (bs) {
@@ -1630,6 +1672,7 @@ zink_destroy_screen(struct pipe_screen *pscreen)
       disk_cache_wait_for_idle(screen->disk_cache);
       util_queue_destroy(&screen->cache_put_thread);
    }
+   foz_destroy(&screen->key_history);
 #endif
    disk_cache_destroy(screen->disk_cache);
 
@@ -1834,6 +1877,20 @@ update_queue_props(struct zink_screen *screen)
    }
    if (sparse_only != UINT32_MAX)
       screen->sparse_queue = sparse_only;
+
+   /* a transfer-only family (i.e., a dma engine) lets large uploads run alongside rendering */
+   screen->transfer_queue = UINT32_MAX;
+   if (debug_get_bool_option("ZINK_TRANSFER_QUEUE", true)) {
+      for (uint32_t i = 0; i < num_queues; i++) {
+         if (i == screen->gfx_queue || i == screen->sparse_queue)
+            continue;
+         if ((props[i].queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == VK_QUEUE_TRANSFER_BIT) {
+            screen->transfer_queue = i;
+            screen->transfer_granularity = props[i].minImageTransferGranularity;
+            break;
+         }
+      }
+   }
    free(props);
 }
 
@@ -1846,6 +1903,8 @@ init_queue(struct zink_screen *screen)
       VKSCR(GetDeviceQueue)(screen->dev, screen->sparse_queue, 0, &screen->queue_sparse);
    else
       screen->queue_sparse = screen->queue;
+   if (screen->transfer_queue != UINT32_MAX)
+      VKSCR(GetDeviceQueue)(screen->dev, screen->transfer_queue, 0, &screen->queue_transfer);
 }
 
 static void
@@ -1893,31 +1952,7 @@ zink_flush_frontbuffer(struct pipe_screen *pscreen,
    /*assert(zink_kopper_acquired(res->obj->dt, res->obj->dt_idx));
    zink_kopper_present_queue(screen, res, nboxes, sub_box);*/
 
-   struct sw_winsys *winsys = screen->winsys;
-
-   if (!winsys)
-     return;
-   void *map = winsys->displaytarget_map(winsys, res->dt, 0);
-
-   if (map) {
-      struct pipe_transfer *transfer = NULL;
-      
-      // Context hack
-      pctx = zink_xlib_context;
-      
-      void *res_map = pipe_texture_map(pctx, pres, level, layer, PIPE_MAP_READ, 0, 0,
-                                        u_minify(pres->width0, level),
-                                        u_minify(pres->height0, level),
-                                        &transfer);
-      if (res_map) {
-         util_copy_rect((ubyte*)map, pres->format, res->dt_stride, 0, 0,
-                        transfer->box.width, transfer->box.height,
-                        (const ubyte*)res_map, transfer->stride, 0, 0);
-         pipe_texture_unmap(pctx, transfer);
-      }
-      winsys->displaytarget_unmap(winsys, res->dt);
-   }
-   winsys->displaytarget_display(winsys, res->dt, winsys_drawable_handle, nboxes, sub_box);
+   zink_xlib_flush_frontbuffer(screen, pctx, res, level, layer, winsys_drawable_handle, nboxes, sub_box);
 }
 
 bool
@@ -2872,10 +2907,11 @@ zink_create_logical_device(struct zink_screen *screen)
 {
    VkDevice dev = VK_NULL_HANDLE;
 
-   VkDeviceQueueCreateInfo qci[2] = {0};
+   VkDeviceQueueCreateInfo qci[3] = {0};
    uint32_t queues[3] = {
       screen->gfx_queue,
       screen->sparse_queue,
+      screen->transfer_queue,
    };
    float dummy = 0.0f;
    for (unsigned i = 0; i < ARRAY_SIZE(qci); i++) {
@@ -2888,6 +2924,8 @@ zink_create_logical_device(struct zink_screen *screen)
    unsigned num_queues = 1;
    if (screen->sparse_queue != screen->gfx_queue)
       num_queues++;
+   if (screen->transfer_queue != UINT32_MAX)
+      qci[num_queues++].queueFamilyIndex = screen->transfer_queue;
 
    VkDeviceCreateInfo dci = {0};
    dci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -3441,6 +3479,7 @@ zink_internal_create_screen(const struct pipe_screen_config *config, int64_t dev
    else
       screen->threaded_submit = screen->threaded;
    screen->abort_on_hang = debug_get_bool_option("ZINK_HANG_ABORT", false);
+   screen->descriptor_set_cache = debug_get_bool_option("ZINK_DESCRIPTOR_CACHE", false);
 
 
    u_trace_state_init();
@@ -3524,7 +3563,12 @@ zink_internal_create_screen(const struct pipe_screen_config *config, int64_t dev
    }
 
    setup_renderdoc(screen);
-   if (screen->threaded_submit && !util_queue_init(&screen->flush_queue, "zfq", 8, 1, UTIL_QUEUE_INIT_RESIZE_IF_FULL, screen)) {
+   /* The lockless ring can't grow, so give it enough room for all the
+    * batches that can be in flight.
+    */
+   if (screen->threaded_submit && !util_queue_init(&screen->flush_queue, "zfq", 32, 1,
+                                                    UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                                                    UTIL_QUEUE_INIT_LOCKLESS, screen)) {
       if (!screen->driver_name_is_inferred)
          mesa_loge("zink: Failed to create flush queue.\n");
       goto fail;
@@ -3665,7 +3709,7 @@ zink_internal_create_screen(const struct pipe_screen_config *config, int64_t dev
       goto fail;
    }
    if (!util_queue_init(&screen->cache_get_thread, "zcfq", 8, 4,
-                        UTIL_QUEUE_INIT_RESIZE_IF_FULL, screen))
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL | UTIL_QUEUE_INIT_BACKGROUND_THREADS, screen))
       goto fail;
    populate_format_props(screen);
 
@@ -3852,6 +3896,9 @@ zink_internal_create_screen(const struct pipe_screen_config *config, int64_t dev
    }
 
    simple_mtx_init(&screen->copy_context_lock, mtx_plain);
+   simple_mtx_init(&screen->present_context_lock, mtx_plain);
+   zink_xlib_screen_init(screen);
+   zink_gpu_trace_screen_init(screen);
 
    init_optimal_keys(screen);
 
@@ -129,6 +129,13 @@ zink_string_vkflags_unroll(char *buf, size_t bufsize, uint64_t flags, zink_vkfla
 VkSemaphore
 zink_create_semaphore(struct zink_screen *screen);
 
+static inline bool
+zink_screen_has_store_op_none(const struct zink_screen *screen)
+{
+   return screen->info.have_vulkan13 || screen->info.have_EXT_load_store_op_none ||
+          screen->info.have_KHR_load_store_op_none;
+}
+
 static inline VkDriverId
 zink_driverid(const struct zink_screen *screen)
 {
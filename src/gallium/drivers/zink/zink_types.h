@@ -39,6 +39,7 @@
 #include "pipebuffer/pb_slab.h"
 
 #include "util/disk_cache.h"
+#include "util/fossilize_db.h"
 #include "util/hash_table.h"
 #include "util/list.h"
 #include "util/log.h"
@@ -71,6 +72,8 @@
 
 /* number of descriptors to allocate in a pool */
 #define MAX_LAZY_DESCRIPTORS 500
+/* number of written sets remembered per program and set type with ZINK_DESCRIPTOR_CACHE */
+#define ZINK_DESCRIPTOR_SET_CACHE_SIZE 32
 /* explicit clamping because descriptor caching used to exist */
 #define ZINK_MAX_SHADER_IMAGES 32
 /* total number of bindless ids that can be allocated */
@@ -90,6 +93,22 @@
 /* this is the spec minimum */
 #define ZINK_SPARSE_BUFFER_PAGE_SIZE (64 * 1024)
 
+/* image readback staging buffer pool: buffers are page-sized multiples up to 16MiB,
+ * sorted into power-of-two size class buckets
+ */
+#define ZINK_STAGING_POOL_MIN_ORDER 12
+#define ZINK_STAGING_POOL_MAX_ORDER 24
+#define ZINK_STAGING_POOL_BUCKETS (ZINK_STAGING_POOL_MAX_ORDER - ZINK_STAGING_POOL_MIN_ORDER + 1)
+#define ZINK_STAGING_POOL_BUCKET_SIZE 4
+/* idle bytes a context keeps pooled, and how long an idle buffer is kept */
+#define ZINK_STAGING_POOL_MAX_SIZE (32 * 1024 * 1024)
+#define ZINK_STAGING_POOL_TIMEOUT_NS (1000 * 1000 * 1000ll)
+
+/* uploads at least this large are copied on the transfer queue when one exists */
+#define ZINK_TRANSFER_QUEUE_MIN_SIZE (256 * 1024)
+/* transfer queue cmdbufs in flight per context before the oldest must be waited on */
+#define ZINK_TRANSFER_QUEUE_SLOTS 8
+
 /* flag to create screen->copy_context */
 #define ZINK_CONTEXT_COPY_ONLY (1<<30)
 
@@ -447,6 +466,9 @@ struct zink_descriptor_data {
 
    struct zink_program *pg[2]; //gfx, compute
 
+   /* bumped every batch: cached sets are only valid in the batch whose pools they came from */
+   uint32_t set_cache_gen;
+
    VkDescriptorUpdateTemplateEntry push_entries[MESA_SHADER_STAGES]; //gfx+fbfetch
    VkDescriptorUpdateTemplateEntry compute_push_entry;
 
@@ -456,6 +478,25 @@ struct zink_descriptor_data {
    /* compute offset is always 0 */
 };
 
+/* a set already written in the current batch, keyed by the hash of its descriptors */
+struct zink_descriptor_set_cache_entry {
+   uint64_t hash;
+   VkDescriptorSet set;
+   uint32_t gen; //zink_descriptor_data::set_cache_gen
+   uint8_t *key; //the ranges' bytes the set was written with, compared on a hash match
+};
+
+/* the context ranges read by a set's update template and the sets last written with it */
+struct zink_descriptor_set_cache {
+   struct zink_descriptor_set_cache_entry entries[ZINK_DESCRIPTOR_SET_CACHE_SIZE];
+   unsigned key_size; //sum of the ranges' sizes
+   unsigned num_ranges;
+   struct {
+      uint32_t offset;
+      uint32_t size;
+   } ranges[];
+};
+
 /* pg->dd; created at program creation */
 struct zink_program_descriptor_data {
    bool bindless;
@@ -475,6 +516,7 @@ struct zink_program_descriptor_data {
    };
    uint32_t db_size[ZINK_DESCRIPTOR_NON_BINDLESS_TYPES]; //the total size of the layout
    uint32_t *db_offset[ZINK_DESCRIPTOR_NON_BINDLESS_TYPES]; //the offset of each binding in the layout
+   struct zink_descriptor_set_cache *set_cache[ZINK_DESCRIPTOR_BASE_TYPES]; //ZINK_DESCRIPTOR_CACHE only
 };
 
 struct zink_descriptor_pool {
@@ -577,12 +619,61 @@ struct zink_bo_usage {
    struct zink_batch_usage *u;
 };
 
+/* ZINK_GPU_TRACE: ops bracketed by a pair of timestamp queries */
+#define ZINK_GPU_TRACE_POOL_REGIONS 128 //regions per timestamp pool; batches append pools as needed
+
+enum zink_gpu_trace_kind {
+   ZINK_GPU_TRACE_RENDER_PASS,
+   ZINK_GPU_TRACE_DISPATCH,
+   ZINK_GPU_TRACE_BLIT,
+   ZINK_GPU_TRACE_RESOLVE,
+   ZINK_GPU_TRACE_CLEAR,
+};
+
+struct zink_gpu_trace_region {
+   enum zink_gpu_trace_kind kind;
+   enum pipe_format format; //first attachment or destination format
+   uint32_t dims[3]; //framebuffer, grid, or box extents
+   uint32_t program; //leading bytes of the last program's blake3
+   unsigned draws; //render passes only
+   unsigned programs; //program switches, render passes only
+   uint8_t samples;
+   uint8_t attachments;
+   bool zs;
+   bool open; //cleared when a render pass fails to begin
+   unsigned parent; //render pass region interrupted by an unordered blit/clear render pass
+};
+
+struct zink_gpu_trace_batch {
+   struct util_dynarray pools; //VkQueryPool, reused across batches
+   struct util_dynarray regions; //zink_gpu_trace_region
+   unsigned rp; //region of the innermost active render pass or UINT32_MAX
+   const void *last_program; //last gfx program drawn in the active render pass
+};
+
 struct zink_batch_obj_list {
    unsigned max_buffers;
    unsigned num_buffers;
    struct zink_resource_object **objs;
 };
 
+#define ZINK_BATCH_OBJ_SET_MIN_SIZE 64
+
+struct zink_batch_obj_set_entry {
+   struct zink_resource_object *obj; //NULL if empty
+   unsigned idx; //index in the obj list which holds obj
+};
+
+/* open-addressing (linear probing) table sized to the batch's working set:
+ * it grows at 3/4 load and shrinks once it is mostly unused, so clearing it
+ * costs about as much as the entries a batch actually added
+ */
+struct zink_batch_obj_set {
+   struct zink_batch_obj_set_entry *table;
+   unsigned size; //power of two
+   unsigned count;
+};
+
 struct zink_batch_state {
    struct zink_fence fence;
    struct zink_batch_state *next;
@@ -605,6 +696,7 @@ struct zink_batch_state {
    struct util_dynarray fd_wait_semaphore_stages; //dmabuf wait semaphores
    struct util_dynarray tracked_semaphores; //semaphores which are just tracked
    VkSemaphore sparse_semaphore; //current sparse wait semaphore
+   uint64_t transfer_wait; //ctx->transfer.sem value this batch's transfer stage waits on
    struct util_dynarray fences; //zink_tc_fence refs
    simple_mtx_t ref_lock;
 
@@ -623,16 +715,8 @@ struct zink_batch_state {
    struct set programs;
    struct set dmabuf_exports;
 
-#define BUFFER_HASHLIST_SIZE 32768
-   /* buffer_indices_hashlist[hash(bo)] returns -1 if the bo
-    * isn't part of any buffer lists or the index where the bo could be found.
-    * Since 1) hash collisions of 2 different bo can happen and 2) we use a
-    * single hashlist for the 3 buffer list, this is only a hint.
-    * batch_find_resource uses this hint to speed up buffers look up.
-    */
-   int16_t buffer_indices_hashlist[BUFFER_HASHLIST_SIZE];
-   uint16_t hashlist_min;
-   uint16_t hashlist_max;
+   /* maps every object in the obj lists below to its list index */
+   struct zink_batch_obj_set obj_set;
    struct zink_batch_obj_list real_objs;
    struct zink_batch_obj_list slab_objs;
    struct zink_batch_obj_list sparse_objs;
@@ -640,6 +724,7 @@ struct zink_batch_state {
    struct util_dynarray swapchain_obj; //this doesn't have a zink_bo and must be handled differently
 
    struct util_dynarray unref_resources;
+   struct util_dynarray staging_returns; //pooled staging buffers to recycle once this batch completes
    struct util_dynarray bindless_releases[2];
 
    struct util_dynarray zombie_samplers;
@@ -647,6 +732,7 @@ struct zink_batch_state {
 
    struct set active_queries; /* zink_query objects which were active at some point in this batch */
    struct util_dynarray dead_querypools;
+   struct zink_gpu_trace_batch gpu_trace;
 
    struct util_dynarray freed_sparse_backing_bos;
 
@@ -1093,6 +1179,11 @@ struct zink_gfx_lib_cache {
 
    simple_mtx_t lock;
    struct set libs; //zink_gfx_library_key -> VkPipeline
+
+   /* optimal keys recorded for this shader set in previous runs or this one */
+   uint8_t history_id[20]; //identifies the shader set across runs
+   bool has_history; //history recording is possible for this shader set
+   struct util_dynarray key_history; //uint32_t optimal keys, protected by lock
 };
 
 struct zink_gfx_program {
@@ -1113,6 +1204,7 @@ struct zink_gfx_program {
    uint32_t module_hash[ZINK_GFX_SHADER_COUNT];
    struct blob blobs[ZINK_GFX_SHADER_COUNT];
    struct util_dynarray shader_cache[ZINK_GFX_SHADER_COUNT][2][2]; //normal, nonseamless cubes, inline uniforms
+   simple_mtx_t shader_cache_lock; //optimal shader_cache is also filled by the key history precompile
    unsigned inlined_variant_count[ZINK_GFX_SHADER_COUNT];
    uint32_t default_variant_hash;
    uint8_t inline_variants; //which stages are using inlined uniforms
@@ -1174,6 +1266,7 @@ struct zink_rt_attrib {
   
   bool needs_write;
   bool resolve;
+  bool discard; //contents are dead once the rp ends: don't store them
   
   bool mixed_zs;
   
@@ -1307,6 +1400,7 @@ struct zink_resource {
    enum pipe_format internal_format:16;
    
    struct sw_displaytarget *dt;
+   struct zink_xlib_present *xlib; //sw winsys readback ring
 
    struct zink_resource_object *obj;
    uint32_t queue;
@@ -1387,6 +1481,7 @@ struct zink_transfer {
    struct pipe_resource *staging_res;
    unsigned offset;
    unsigned depthPitch;
+   bool staging_pooled; //staging_res comes from ctx->staging_pool
 };
 
 
@@ -1396,6 +1491,15 @@ struct zink_modifier_prop {
     VkDrmFormatModifierPropertiesEXT*    pDrmFormatModifierProperties;
 };
 
+/* where time goes when presenting through the sw winsys */
+enum zink_present_stat {
+   ZINK_PRESENT_STAT_FENCE_WAIT,
+   ZINK_PRESENT_STAT_MAP,
+   ZINK_PRESENT_STAT_COPY,
+   ZINK_PRESENT_STAT_PUT,
+   ZINK_PRESENT_STAT_COUNT,
+};
+
 struct zink_screen {
    struct pipe_screen base;
 
@@ -1407,6 +1511,7 @@ struct zink_screen {
    bool threaded_submit;
    bool is_cpu;
    bool abort_on_hang;
+   bool descriptor_set_cache;
    bool frame_marker_emitted;
    bool driver_name_is_inferred;
    uint64_t curr_batch; //the current batch id
@@ -1419,6 +1524,22 @@ struct zink_screen {
    struct util_queue flush_queue;
    simple_mtx_t copy_context_lock;
    struct zink_context *copy_context;
+   /* records frontbuffer readbacks for the sw winsys, see zink_xlib.c */
+   simple_mtx_t present_context_lock;
+   struct zink_context *present_context;
+   void *present_hash_cs; //tile hashing compute state on present_context
+   struct hash_table_u64 *present_window_tiles; //Drawable -> zink_xlib_tiles of the last frame pushed to it
+   uint64_t present_stats[ZINK_PRESENT_STAT_COUNT]; //ns, accumulated over all sw winsys presents
+   FILE *present_trace; //ZINK_XLIB_PRESENT_TRACE
+   simple_mtx_t present_windows_lock;
+   struct hash_table_u64 *present_windows; //Drawable -> zink_xlib_window_stats
+   struct {
+      FILE *file; //ZINK_GPU_TRACE
+      simple_mtx_t lock;
+      uint64_t base; //ns of the first resolved timestamp
+      unsigned events; //written so far
+      unsigned next_tid;
+   } gpu_trace;
 
    struct zink_batch_state *free_batch_states; //unused batch states
    struct zink_batch_state *last_free_batch_state; //for appending
@@ -1451,6 +1572,7 @@ struct zink_screen {
    struct disk_cache *disk_cache;
    struct util_queue cache_put_thread;
    struct util_queue cache_get_thread;
+   struct foz_db key_history; //per-application log of shader keys seen at runtime
 
    /* there are 5 gfx stages, but VS and FS are assumed to be always present,
     * thus only 3 stages need to be considered, giving 2^3 = 8 program caches.
@@ -1473,6 +1595,15 @@ struct zink_screen {
       struct pb_slabs bo_slabs[NUM_SLAB_ALLOCATORS];
       unsigned min_alloc_size;
       uint32_t next_bo_unique_id;
+      /* allocations per vk heap, checked against VK_EXT_memory_budget */
+      struct {
+         simple_mtx_t lock;
+         uint64_t allocated[VK_MAX_MEMORY_HEAPS]; //VkDeviceMemory currently allocated by zink
+         uint64_t usage[VK_MAX_MEMORY_HEAPS]; //last reported by the driver
+         uint64_t budget[VK_MAX_MEMORY_HEAPS]; //last reported by the driver
+         uint64_t allocated_at_query[VK_MAX_MEMORY_HEAPS];
+         bool pressure; //a heap is close to its budget: flush early to release memory
+      } budget;
    } pb;
    uint8_t heap_map[ZINK_HEAP_MAX][VK_MAX_MEMORY_TYPES];  // mapping from zink heaps to memory type indices
    uint8_t heap_count[ZINK_HEAP_MAX];  // number of memory types per zink heap
@@ -1518,6 +1649,9 @@ struct zink_screen {
    VkDevice dev;
    VkQueue queue; //gfx+compute
    VkQueue queue_sparse;
+   uint32_t transfer_queue; //transfer-only family or UINT32_MAX
+   VkQueue queue_transfer;
+   VkExtent3D transfer_granularity;
    simple_mtx_t queue_lock;
    VkDebugUtilsMessengerEXT debugUtilsCallbackHandle;
 
@@ -1822,11 +1956,30 @@ enum zink_ds3_state {
    ZINK_DS3_BLEND_LOGIC,
 };
 
+/* uploads recorded on the screen's transfer queue */
+struct zink_transfer_queue {
+   VkCommandPool cmdpool;
+   VkCommandBuffer cmdbufs[ZINK_TRANSFER_QUEUE_SLOTS];
+   uint64_t values[ZINK_TRANSFER_QUEUE_SLOTS]; //sem value signaled by each cmdbuf's last submit
+   unsigned next;
+   VkSemaphore sem; //timeline
+   uint64_t value; //last value submitted
+};
+
+/* an idle buffer in zink_context::staging_pool */
+struct zink_staging_entry {
+   struct pipe_resource *pres;
+   int64_t idle_since; //os_time_get_nano()
+};
+
 struct zink_context {
    struct pipe_context base;
    struct threaded_context *tc;
    struct slab_child_pool transfer_pool;
    struct slab_child_pool transfer_pool_unsync;
+   struct util_dynarray staging_pool[ZINK_STAGING_POOL_BUCKETS]; //zink_staging_entry of idle readback/upload buffers by size class
+   uint64_t staging_pool_size; //bytes idle in staging_pool
+   struct zink_transfer_queue transfer;
    struct blitter_context *blitter;
    struct util_debug_callback dbg;
 
@@ -1982,7 +2135,11 @@ struct zink_context {
    } render_condition;
    struct {
       uint64_t render_passes;
+      uint64_t store_bytes_saved; //attachment stores elided by DONT_CARE/NONE
+      uint64_t set_cache_hits;
+      uint64_t set_cache_misses;
    } hud;
+   unsigned gpu_trace_tid; //nonzero when ZINK_GPU_TRACE is active
 
    struct pipe_resource *dummy_vertex_buffer;
    struct pipe_resource *dummy_xfb_buffer;
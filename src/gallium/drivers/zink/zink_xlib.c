@@ -0,0 +1,1013 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "zink_bo.h"
+#include "zink_clear.h"
+#include "zink_context.h"
+#include "zink_format.h"
+#include "zink_resource.h"
+#include "zink_screen.h"
+#include "zink_xlib.h"
+
+#include "frontend/sw_winsys.h"
+#include "frontend/xlibsw_api.h"
+#include "util/format/u_format.h"
+#include "util/hash_table.h"
+#include "util/ralloc.h"
+#include "util/u_blitter.h"
+#include "util/u_sampler.h"
+#include "util/u_surface.h"
+#include "nir/nir_builder.h"
+#include "util/u_debug.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/os_misc.h"
+#include "util/os_time.h"
+
+DEBUG_GET_ONCE_NUM_OPTION(zink_xlib_readback_frames, "ZINK_XLIB_READBACK_FRAMES", 1)
+DEBUG_GET_ONCE_BOOL_OPTION(zink_xlib_zero_copy, "ZINK_XLIB_ZERO_COPY", true)
+DEBUG_GET_ONCE_BOOL_OPTION(zink_xlib_tile_hash, "ZINK_XLIB_TILE_HASH", false)
+DEBUG_GET_ONCE_OPTION(zink_xlib_present_trace, "ZINK_XLIB_PRESENT_TRACE", NULL)
+DEBUG_GET_ONCE_BOOL_OPTION(zink_xlib_mailbox, "ZINK_XLIB_MAILBOX", false)
+
+/* wrap the display target's memory (e.g., an MIT-SHM segment) in a host-imported buffer */
+static void
+import_displaytarget(struct zink_screen *screen, struct zink_resource *res, struct zink_xlib_present *xp)
+{
+   struct sw_winsys *winsys = screen->winsys;
+   uint64_t page_size;
+
+   if (!debug_get_option_zink_xlib_zero_copy() || !screen->base.resource_from_user_memory ||
+       !os_get_page_size(&page_size))
+      return;
+   /* the import covers whole alignment units, which must not extend past the last page of the allocation */
+   VkDeviceSize alignment = screen->info.ext_host_mem_props.minImportedHostPointerAlignment;
+   if (alignment > page_size)
+      return;
+
+   /* the display target stays mapped for as long as it is imported */
+   xp->dt_map = winsys->displaytarget_map(winsys, res->dt, PIPE_MAP_WRITE);
+   if (!xp->dt_map)
+      return;
+   if ((uintptr_t)xp->dt_map & (alignment - 1))
+      goto fail;
+
+   struct pipe_resource templ = {0};
+   templ.target = PIPE_BUFFER;
+   templ.format = PIPE_FORMAT_R8_UNORM;
+   templ.width0 = align64((uint64_t)res->dt_stride * util_format_get_nblocksy(res->base.b.format, res->base.b.height0),
+                          alignment);
+   templ.height0 = templ.depth0 = templ.array_size = 1;
+   templ.usage = PIPE_USAGE_STAGING;
+   templ.bind = PIPE_BIND_LINEAR;
+   xp->dt_buffer = screen->base.resource_from_user_memory(&screen->base, &templ, xp->dt_map);
+   if (xp->dt_buffer)
+      return;
+
+fail:
+   winsys->displaytarget_unmap(winsys, res->dt);
+   xp->dt_map = NULL;
+}
+
+/* all readbacks are recorded on a screen-owned context so that presenting never
+ * touches (or flushes) whichever context the application happens to be rendering with
+ */
+static struct zink_context *
+lock_present_context(struct zink_screen *screen)
+{
+   simple_mtx_lock(&screen->present_context_lock);
+   if (!screen->present_context)
+      screen->present_context = zink_context(screen->base.context_create(&screen->base, NULL, 0));
+   if (!screen->present_context) {
+      mesa_loge("zink: failed to create present context");
+      simple_mtx_unlock(&screen->present_context_lock);
+   }
+   return screen->present_context;
+}
+
+static void
+unlock_present_context(struct zink_screen *screen)
+{
+   simple_mtx_unlock(&screen->present_context_lock);
+}
+
+/* the same resource may be flushed from any context, so creation is serialized
+ * on the screen and the returned present is locked for the ring updates
+ */
+static struct zink_xlib_present *
+lock_present(struct zink_screen *screen, struct zink_resource *res)
+{
+   simple_mtx_lock(&screen->present_context_lock);
+   struct zink_xlib_present *xp = res->xlib;
+   if (!xp) {
+      xp = CALLOC_STRUCT(zink_xlib_present);
+      if (xp) {
+         simple_mtx_init(&xp->lock, mtx_plain);
+         xp->num_frames = CLAMP(debug_get_option_zink_xlib_readback_frames(), 1, ZINK_XLIB_MAX_READBACKS);
+         xp->mailbox = debug_get_option_zink_xlib_mailbox();
+         import_displaytarget(screen, res, xp);
+         res->xlib = xp;
+      }
+   }
+   simple_mtx_unlock(&screen->present_context_lock);
+   if (xp)
+      simple_mtx_lock(&xp->lock);
+   return xp;
+}
+
+/* work out how to produce the X visual's byte layout from the resource on the gpu;
+ * only reordering of 8-bit channels is done, other layouts must match the resource
+ */
+static void
+set_display_format(struct zink_xlib_present *xp, enum pipe_format format, enum pipe_format display_format)
+{
+   if (xp->display_format == display_format)
+      return;
+   xp->display_format = display_format;
+   xp->convert_needed = false;
+   pipe_resource_reference(&xp->convert, NULL);
+
+   if (display_format == PIPE_FORMAT_NONE || display_format == format ||
+       util_format_get_blocksize(format) != 4)
+      return;
+   const struct util_format_description *desc = util_format_description(display_format);
+   if (!util_format_is_rgba8_variant(desc))
+      return;
+
+   /* rendering to rgba8 stores component i in byte i: route each component to the byte
+    * it occupies in the X pixel, padding bytes read as 1
+    */
+   for (unsigned i = 0; i < 4; i++)
+      xp->convert_swizzle[i] = PIPE_SWIZZLE_1;
+   for (unsigned i = 0; i < 4; i++) {
+      if (desc->swizzle[i] <= PIPE_SWIZZLE_W)
+         xp->convert_swizzle[desc->swizzle[i]] = PIPE_SWIZZLE_X + i;
+   }
+   xp->convert_needed = true;
+}
+
+/* swizzle the damaged boxes of the resource into the conversion image at the same position */
+static struct zink_resource *
+readback_convert(struct zink_context *ctx, struct zink_resource *res, struct zink_xlib_present *xp,
+                 unsigned level, struct zink_xlib_readback *rb)
+{
+   struct pipe_context *pctx = &ctx->base;
+   unsigned width = u_minify(res->base.b.width0, level);
+   unsigned height = u_minify(res->base.b.height0, level);
+
+   if (!xp->convert || xp->convert->width0 != width || xp->convert->height0 != height) {
+      struct pipe_resource templ = {0};
+      templ.target = PIPE_TEXTURE_2D;
+      templ.format = PIPE_FORMAT_R8G8B8A8_UNORM;
+      templ.width0 = width;
+      templ.height0 = height;
+      templ.depth0 = templ.array_size = 1;
+      templ.bind = PIPE_BIND_RENDER_TARGET;
+      pipe_resource_reference(&xp->convert, NULL);
+      xp->convert = pctx->screen->resource_create(pctx->screen, &templ);
+      if (!xp->convert)
+         return NULL;
+   }
+
+   /* read raw values: srgb decoding would be undone by nothing on the way out */
+   struct pipe_sampler_view src_templ, *src_view;
+   util_blitter_default_src_texture(ctx->blitter, &src_templ, &res->base.b, level);
+   src_templ.format = util_format_linear(res->base.b.format);
+   src_templ.swizzle_r = xp->convert_swizzle[0];
+   src_templ.swizzle_g = xp->convert_swizzle[1];
+   src_templ.swizzle_b = xp->convert_swizzle[2];
+   src_templ.swizzle_a = xp->convert_swizzle[3];
+   if (zink_format_needs_mutable(src_templ.format, res->base.b.format))
+      zink_resource_object_init_mutable(ctx, res);
+   src_view = pctx->create_sampler_view(pctx, &res->base.b, &src_templ);
+
+   struct pipe_surface dst_templ, *dst_view;
+   u_surface_default_template(&dst_templ, xp->convert);
+   dst_view = pctx->create_surface(pctx, xp->convert, &dst_templ);
+
+   if (src_view && dst_view) {
+      zink_blit_begin(ctx, ZINK_BLIT_SAVE_FB | ZINK_BLIT_SAVE_FS | ZINK_BLIT_SAVE_TEXTURES);
+      zink_blit_barriers(ctx, res, zink_resource(xp->convert), rb->full);
+      ctx->blitting = true;
+      for (unsigned i = 0; i < rb->nboxes; i++) {
+         struct pipe_box dst_box = rb->boxes[i];
+         dst_box.z = 0;
+         util_blitter_blit_generic(ctx->blitter, dst_view, &dst_box, src_view, &rb->boxes[i],
+                                   width, height, PIPE_MASK_RGBA, PIPE_TEX_FILTER_NEAREST,
+                                   NULL, false, false, 0, NULL);
+      }
+      ctx->blitting = false;
+   }
+
+   bool ok = src_view && dst_view;
+   pipe_sampler_view_reference(&src_view, NULL);
+   pipe_surface_release(pctx, &dst_view);
+   return ok ? zink_resource(xp->convert) : NULL;
+}
+
+/* one 8x8 workgroup per tile, each invocation folding an 8x8 grid of texels
+ * into an order-independent (xor, sum) pair which is then merged atomically:
+
+      layout (local_size_x = 8, local_size_y = 8) in;
+      uniform sampler2D tex;
+      uniform ivec4 params; //max x, max y, tiles_x, lod
+      buffer hashes { uvec2 tile[]; };
+
+      void main()
+      {
+         ivec2 base = ivec2(gl_WorkGroupID.xy) * 64 + ivec2(gl_LocalInvocationID.xy);
+         uint x = 0, sum = 0;
+         for (int j = 0; j < 8; j++) for (int i = 0; i < 8; i++) {
+            ivec2 pos = min(base + ivec2(i, j) * 8, params.xy);
+            uvec4 c = floatBitsToUint(texelFetch(tex, pos, params.w));
+            uint v = c.r ^ rotl(c.g, 8) ^ rotl(c.b, 16) ^ rotl(c.a, 24);
+            uint m = (v ^ (pos.x * 0x27d4eb2d + pos.y * 0x165667b1)) * 0x85ebca6b;
+            m ^= m >> 13;
+            x ^= m;
+            sum += m;
+         }
+         uint t = gl_WorkGroupID.y * params.z + gl_WorkGroupID.x;
+         atomicXor(tile[t].x, x);
+         atomicAdd(tile[t].y, sum);
+      }
+ */
+static nir_def *
+rotl(nir_builder *b, nir_def *x, unsigned n)
+{
+   return nir_ior(b, nir_ishl_imm(b, x, n), nir_ushr_imm(b, x, 32 - n));
+}
+
+static void *
+create_hash_cs(struct pipe_context *pctx)
+{
+   const struct glsl_type *sampler_type =
+      glsl_sampler_type(GLSL_SAMPLER_DIM_2D, false, false, GLSL_TYPE_FLOAT);
+   const nir_shader_compiler_options *options =
+      pctx->screen->get_compiler_options(pctx->screen, PIPE_SHADER_IR_NIR, PIPE_SHADER_COMPUTE);
+   const unsigned step = ZINK_XLIB_TILE_SIZE / 8;
+
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_COMPUTE, options, "zink_xlib_tile_hash");
+   b.shader->info.workgroup_size[0] = 8;
+   b.shader->info.workgroup_size[1] = 8;
+   b.shader->info.workgroup_size[2] = 1;
+   b.shader->info.num_ubos = 1;
+   b.shader->info.num_ssbos = 1;
+   b.shader->num_uniforms = 1;
+
+   nir_def *zero = nir_imm_int(&b, 0);
+   nir_def *params = nir_load_ubo(&b, 4, 32, zero, zero, .align_mul = 4, .range = ~0);
+
+   nir_variable *sampler = nir_variable_create(b.shader, nir_var_uniform, sampler_type, "tex");
+   sampler->data.binding = 0;
+   BITSET_SET(b.shader->info.textures_used, 0);
+   BITSET_SET(b.shader->info.samplers_used, 0);
+   nir_deref_instr *tex_deref = nir_build_deref_var(&b, sampler);
+
+   nir_def *tile = nir_trim_vector(&b, nir_load_workgroup_id(&b), 2);
+   nir_def *base = nir_iadd(&b, nir_imul_imm(&b, tile, ZINK_XLIB_TILE_SIZE),
+                            nir_trim_vector(&b, nir_load_local_invocation_id(&b), 2));
+   nir_def *max_pos = nir_trim_vector(&b, params, 2);
+   nir_def *lod = nir_channel(&b, params, 3);
+
+   nir_def *x = zero, *sum = zero;
+   for (unsigned j = 0; j < ZINK_XLIB_TILE_SIZE; j += step) {
+      for (unsigned i = 0; i < ZINK_XLIB_TILE_SIZE; i += step) {
+         nir_def *pos = nir_imin(&b, nir_iadd(&b, base, nir_imm_ivec2(&b, i, j)), max_pos);
+         nir_def *c = nir_txf_deref(&b, tex_deref, pos, lod);
+         nir_def *v = nir_ixor(&b, nir_channel(&b, c, 0), rotl(&b, nir_channel(&b, c, 1), 8));
+         v = nir_ixor(&b, v, rotl(&b, nir_channel(&b, c, 2), 16));
+         v = nir_ixor(&b, v, rotl(&b, nir_channel(&b, c, 3), 24));
+         nir_def *seed = nir_iadd(&b, nir_imul_imm(&b, nir_channel(&b, pos, 0), 0x27d4eb2d),
+                                  nir_imul_imm(&b, nir_channel(&b, pos, 1), 0x165667b1));
+         nir_def *m = nir_imul_imm(&b, nir_ixor(&b, v, seed), 0x85ebca6b);
+         m = nir_ixor(&b, m, nir_ushr_imm(&b, m, 13));
+         x = nir_ixor(&b, x, m);
+         sum = nir_iadd(&b, sum, m);
+      }
+   }
+
+   nir_def *t = nir_iadd(&b, nir_imul(&b, nir_channel(&b, tile, 1), nir_channel(&b, params, 2)),
+                         nir_channel(&b, tile, 0));
+   nir_def *offset = nir_imul_imm(&b, t, 8);
+   nir_ssbo_atomic(&b, 32, zero, offset, x, .atomic_op = nir_atomic_op_ixor);
+   nir_ssbo_atomic(&b, 32, zero, nir_iadd_imm(&b, offset, 4), sum, .atomic_op = nir_atomic_op_iadd);
+
+   pctx->screen->finalize_nir(pctx->screen, b.shader);
+
+   struct pipe_compute_state state = {0};
+   state.ir_type = PIPE_SHADER_IR_NIR;
+   state.prog = b.shader;
+   return pctx->create_compute_state(pctx, &state);
+}
+
+/* hash every tile of the level on the gpu and read the results back */
+static uint64_t *
+hash_tiles(struct zink_context *ctx, struct zink_resource *res, struct zink_xlib_present *xp,
+           unsigned level, unsigned tiles_x, unsigned tiles_y)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   struct pipe_context *pctx = &ctx->base;
+   unsigned size = tiles_x * tiles_y * sizeof(uint64_t);
+
+   if (!screen->present_hash_cs)
+      screen->present_hash_cs = create_hash_cs(pctx);
+   if (!screen->present_hash_cs)
+      return NULL;
+   if (!xp->hash_buffer || xp->hash_buffer->width0 < size) {
+      pipe_resource_reference(&xp->hash_buffer, NULL);
+      xp->hash_buffer = pipe_buffer_create(pctx->screen, PIPE_BIND_SHADER_BUFFER, PIPE_USAGE_STAGING, size);
+      if (!xp->hash_buffer)
+         return NULL;
+   }
+   uint32_t clear = 0;
+   pctx->clear_buffer(pctx, xp->hash_buffer, 0, size, &clear, sizeof(clear));
+
+   int params[4] = {
+      u_minify(res->base.b.width0, level) - 1,
+      u_minify(res->base.b.height0, level) - 1,
+      tiles_x,
+      level,
+   };
+   struct pipe_constant_buffer cb = {0};
+   cb.buffer_size = sizeof(params);
+   cb.user_buffer = params;
+   pctx->set_constant_buffer(pctx, PIPE_SHADER_COMPUTE, 0, false, &cb);
+
+   struct pipe_shader_buffer sb = {0};
+   sb.buffer = xp->hash_buffer;
+   sb.buffer_size = size;
+   pctx->set_shader_buffers(pctx, PIPE_SHADER_COMPUTE, 0, 1, &sb, BITFIELD_BIT(0));
+
+   struct pipe_sampler_state sampler_state = {0};
+   void *sampler = pctx->create_sampler_state(pctx, &sampler_state);
+   pctx->bind_sampler_states(pctx, PIPE_SHADER_COMPUTE, 0, 1, &sampler);
+
+   /* hash the raw values */
+   struct pipe_sampler_view view_templ, *view;
+   u_sampler_view_default_template(&view_templ, &res->base.b, util_format_linear(res->base.b.format));
+   if (zink_format_needs_mutable(view_templ.format, res->base.b.format))
+      zink_resource_object_init_mutable(ctx, res);
+   view = pctx->create_sampler_view(pctx, &res->base.b, &view_templ);
+   pctx->set_sampler_views(pctx, PIPE_SHADER_COMPUTE, 0, 1, 0, false, &view);
+
+   pctx->bind_compute_state(pctx, screen->present_hash_cs);
+   struct pipe_grid_info grid = {0};
+   grid.block[0] = grid.block[1] = 8;
+   grid.block[2] = 1;
+   grid.grid[0] = tiles_x;
+   grid.grid[1] = tiles_y;
+   grid.grid[2] = 1;
+   pctx->launch_grid(pctx, &grid);
+
+   pctx->set_sampler_views(pctx, PIPE_SHADER_COMPUTE, 0, 0, 1, false, NULL);
+   pctx->set_shader_buffers(pctx, PIPE_SHADER_COMPUTE, 0, 1, NULL, 0);
+   pctx->set_constant_buffer(pctx, PIPE_SHADER_COMPUTE, 0, false, NULL);
+   pctx->bind_compute_state(pctx, NULL);
+   pctx->delete_sampler_state(pctx, sampler);
+   pipe_sampler_view_reference(&view, NULL);
+
+   /* a read map waits for the dispatch */
+   struct pipe_transfer *xfer;
+   const uint64_t *map = pipe_buffer_map(pctx, xp->hash_buffer, PIPE_MAP_READ, &xfer);
+   if (!map)
+      return NULL;
+   uint64_t *hashes = malloc(size);
+   if (hashes)
+      memcpy(hashes, map, size);
+   pipe_buffer_unmap(pctx, xfer);
+   return hashes;
+}
+
+static bool
+tiles_resize(struct zink_xlib_tiles *tiles, unsigned tiles_x, unsigned tiles_y)
+{
+   if (tiles->tiles_x == tiles_x && tiles->tiles_y == tiles_y && tiles->hashes)
+      return true;
+   free(tiles->hashes);
+   tiles->hashes = NULL;
+   tiles->tiles_x = tiles->tiles_y = 0;
+   return false;
+}
+
+/* add a changed tile to the damage: tiles extend the run to their left, runs extend the box
+ * above them, and once the boxes run out everything collapses into the bounding box
+ */
+static void
+damage_add_tile(struct pipe_box *boxes, unsigned *nboxes, unsigned *row_start, struct pipe_box *tile)
+{
+   struct pipe_box *last = *nboxes ? &boxes[*nboxes - 1] : NULL;
+
+   if (*nboxes > ZINK_XLIB_MAX_DAMAGE_BOXES) {
+      u_box_union_2d(&boxes[0], &boxes[0], tile);
+      return;
+   }
+   if (last && *nboxes > *row_start && last->y == tile->y && last->x + last->width == tile->x) {
+      last->width += tile->width;
+      return;
+   }
+   if (*nboxes == ZINK_XLIB_MAX_DAMAGE_BOXES) {
+      for (unsigned i = 1; i < *nboxes; i++)
+         u_box_union_2d(&boxes[0], &boxes[0], &boxes[i]);
+      u_box_union_2d(&boxes[0], &boxes[0], tile);
+      *nboxes = ZINK_XLIB_MAX_DAMAGE_BOXES + 1;
+      return;
+   }
+   boxes[(*nboxes)++] = *tile;
+}
+
+/* the previous row's runs are merged into the boxes above them once the row is done */
+static void
+damage_end_row(struct pipe_box *boxes, unsigned *nboxes, unsigned *row_start)
+{
+   if (*nboxes > ZINK_XLIB_MAX_DAMAGE_BOXES)
+      return;
+   unsigned n = *row_start;
+   for (unsigned i = *row_start; i < *nboxes; i++) {
+      struct pipe_box *run = &boxes[i];
+      bool merged = false;
+      for (unsigned j = 0; j < *row_start; j++) {
+         struct pipe_box *above = &boxes[j];
+         if (above->x == run->x && above->width == run->width && above->y + above->height == run->y) {
+            above->height += run->height;
+            merged = true;
+            break;
+         }
+      }
+      if (!merged)
+         boxes[n++] = *run;
+   }
+   *nboxes = n;
+   *row_start = n;
+}
+
+/* compare this frame's tile hashes against both what the display target holds and what the
+ * window shows, returning the changed region as damage boxes (-1 when hashing isn't possible)
+ */
+static int
+hash_damage(struct zink_context *ctx, struct zink_resource *res, struct zink_xlib_present *xp,
+            unsigned level, unsigned long drawable, struct pipe_box *boxes)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   unsigned width = u_minify(res->base.b.width0, level);
+   unsigned height = u_minify(res->base.b.height0, level);
+   unsigned tiles_x = DIV_ROUND_UP(width, ZINK_XLIB_TILE_SIZE);
+   unsigned tiles_y = DIV_ROUND_UP(height, ZINK_XLIB_TILE_SIZE);
+
+   /* windows are tracked separately so that presenting to one doesn't invalidate another */
+   if (!screen->present_window_tiles)
+      screen->present_window_tiles = _mesa_hash_table_u64_create(NULL);
+   if (!screen->present_window_tiles)
+      return -1;
+   struct zink_xlib_tiles *window = _mesa_hash_table_u64_search(screen->present_window_tiles, drawable);
+   if (!window) {
+      window = rzalloc(screen->present_window_tiles, struct zink_xlib_tiles);
+      if (!window)
+         return -1;
+      _mesa_hash_table_u64_insert(screen->present_window_tiles, drawable, window);
+   }
+
+   /* hash what will actually be read back */
+   if (zink_resource_usage_is_unflushed_write(res))
+      zink_resource_usage_wait(ctx, res, ZINK_RESOURCE_ACCESS_WRITE);
+   zink_fb_clears_apply(ctx, &res->base.b);
+
+   uint64_t *hashes = hash_tiles(ctx, res, xp, level, tiles_x, tiles_y);
+   if (!hashes)
+      return -1;
+
+   bool dt_valid = tiles_resize(&xp->tiles, tiles_x, tiles_y);
+   bool window_valid = tiles_resize(window, tiles_x, tiles_y);
+   unsigned nboxes = 0, row_start = 0;
+   for (unsigned y = 0; y < tiles_y; y++) {
+      for (unsigned x = 0; x < tiles_x; x++) {
+         unsigned t = y * tiles_x + x;
+         if (dt_valid && window_valid && xp->tiles.hashes[t] == hashes[t] && window->hashes[t] == hashes[t])
+            continue;
+         struct pipe_box tile;
+         u_box_2d(x * ZINK_XLIB_TILE_SIZE, y * ZINK_XLIB_TILE_SIZE,
+                  MIN2(ZINK_XLIB_TILE_SIZE, width - x * ZINK_XLIB_TILE_SIZE),
+                  MIN2(ZINK_XLIB_TILE_SIZE, height - y * ZINK_XLIB_TILE_SIZE), &tile);
+         damage_add_tile(boxes, &nboxes, &row_start, &tile);
+      }
+      damage_end_row(boxes, &nboxes, &row_start);
+   }
+
+   /* both now hold this frame, once it has been read back and pushed */
+   if (!window->hashes)
+      window->hashes = malloc(tiles_x * tiles_y * sizeof(uint64_t));
+   if (window->hashes) {
+      memcpy(window->hashes, hashes, tiles_x * tiles_y * sizeof(uint64_t));
+      window->tiles_x = tiles_x;
+      window->tiles_y = tiles_y;
+   }
+   free(xp->tiles.hashes);
+   xp->tiles.hashes = hashes;
+   xp->tiles.tiles_x = tiles_x;
+   xp->tiles.tiles_y = tiles_y;
+
+   /* past the limit, everything was collapsed into the first box */
+   return nboxes > ZINK_XLIB_MAX_DAMAGE_BOXES ? 1 : nboxes;
+}
+
+/* clamp the damage to the level and reduce it to something that fits in a readback slot */
+static void
+readback_set_boxes(struct zink_xlib_readback *rb, unsigned width, unsigned height, unsigned layer,
+                   unsigned nboxes, const struct pipe_box *boxes)
+{
+   rb->nboxes = 0;
+   rb->full = !nboxes;
+   if (rb->full) {
+      u_box_2d_zslice(0, 0, layer, width, height, &rb->boxes[0]);
+      rb->nboxes = 1;
+      return;
+   }
+
+   struct pipe_box bounds;
+   bool collapse = nboxes > ZINK_XLIB_MAX_DAMAGE_BOXES;
+   for (unsigned i = 0; i < nboxes; i++) {
+      struct pipe_box box = boxes[i];
+      if (u_box_clip_2d(&box, &box, width, height) < 0)
+         continue;
+      box.z = layer;
+      box.depth = 1;
+      if (!collapse)
+         rb->boxes[rb->nboxes++] = box;
+      else if (rb->nboxes++)
+         u_box_union_2d(&bounds, &bounds, &box);
+      else
+         bounds = box;
+   }
+   if (collapse && rb->nboxes) {
+      rb->boxes[0] = bounds;
+      rb->nboxes = 1;
+   }
+}
+
+/* record the image->buffer copies for this frame's damage and submit them without waiting */
+static bool
+readback_record(struct zink_context *ctx, struct zink_resource *res, struct zink_xlib_present *xp,
+                unsigned level, unsigned layer,
+                unsigned nboxes, const struct pipe_box *boxes,
+                struct zink_xlib_readback *rb)
+{
+   struct zink_screen *screen = zink_screen(ctx->base.screen);
+   enum pipe_format format = res->base.b.format;
+
+   readback_set_boxes(rb, u_minify(res->base.b.width0, level), u_minify(res->base.b.height0, level),
+                      layer, nboxes, boxes);
+   if (!rb->nboxes)
+      return false;
+
+   /* force multi-context sync */
+   if (zink_resource_usage_is_unflushed_write(res))
+      zink_resource_usage_wait(ctx, res, ZINK_RESOURCE_ACCESS_WRITE);
+
+   /* if the readback region intersects with any clears then we have to apply them */
+   for (unsigned i = 0; i < rb->nboxes; i++)
+      zink_fb_clears_apply_region(ctx, &res->base.b, zink_rect_from_box(&rb->boxes[i]));
+
+   /* copies below are bit-exact, from the conversion image when the X layout differs */
+   struct zink_resource *src = res;
+   unsigned src_level = level, src_layer = layer;
+   if (xp->convert_needed) {
+      src = readback_convert(ctx, res, xp, level, rb);
+      if (!src)
+         return false;
+      src_level = src_layer = 0;
+   }
+
+   if (xp->dt_buffer) {
+      /* copy straight into the display target using its own layout */
+      unsigned blocksize = util_format_get_blocksize(format);
+      for (unsigned i = 0; i < rb->nboxes; i++) {
+         struct pipe_box box = rb->boxes[i];
+         box.z = src_layer;
+         zink_copy_image_to_buffer_pitched(ctx, zink_resource(xp->dt_buffer),
+                                           box.y * res->dt_stride + box.x * blocksize,
+                                           res->dt_stride / blocksize, src, src_level, &box);
+      }
+      ctx->base.flush(&ctx->base, &rb->fence, 0);
+      return !!rb->fence;
+   }
+
+   rb->size = 0;
+   for (unsigned i = 0; i < rb->nboxes; i++) {
+      /* keep every box texel-aligned for the buffer copy */
+      rb->offsets[i] = align(rb->size, 16);
+      rb->size = rb->offsets[i] + util_format_get_2d_size(format, util_format_get_stride(format, rb->boxes[i].width),
+                                                          rb->boxes[i].height);
+   }
+   if (!rb->staging || rb->staging->width0 < rb->size) {
+      pipe_resource_reference(&rb->staging, NULL);
+      rb->staging = pipe_buffer_create(&screen->base, PIPE_BIND_LINEAR, PIPE_USAGE_STAGING, rb->size);
+      if (!rb->staging)
+         return false;
+   }
+
+   for (unsigned i = 0; i < rb->nboxes; i++) {
+      struct pipe_box box = rb->boxes[i];
+      box.z = src_layer;
+      zink_copy_image_buffer(ctx, zink_resource(rb->staging), src, 0, rb->offsets[i], 0, 0, src_level, &box, 0);
+   }
+   ctx->base.flush(&ctx->base, &rb->fence, 0);
+   return !!rb->fence;
+}
+
+static void
+invalidate_mapping(struct zink_screen *screen, struct zink_resource *res, VkDeviceSize size)
+{
+   if (res->obj->coherent)
+      return;
+   VkMappedMemoryRange range = zink_resource_init_mem_range(screen, res->obj, res->obj->offset, size);
+   if (VKSCR(InvalidateMappedMemoryRanges)(screen->dev, 1, &range) != VK_SUCCESS)
+      mesa_loge("ZINK: vkInvalidateMappedMemoryRanges failed");
+}
+
+/* copy the packed damage boxes from the staging buffer into the display target */
+static void
+readback_copy_staging(struct zink_screen *screen, struct zink_resource *res, struct zink_xlib_readback *rb,
+                      int64_t *mapped)
+{
+   struct sw_winsys *winsys = screen->winsys;
+   struct zink_resource *staging = zink_resource(rb->staging);
+   enum pipe_format format = res->base.b.format;
+
+   void *map = winsys->displaytarget_map(winsys, res->dt, 0);
+   if (!map)
+      return;
+   uint8_t *ptr = zink_bo_map(screen, staging->obj->bo);
+   if (ptr) {
+      invalidate_mapping(screen, staging, rb->size);
+      *mapped = os_time_get_nano();
+      for (unsigned i = 0; i < rb->nboxes; i++) {
+         const struct pipe_box *box = &rb->boxes[i];
+         util_copy_rect(map, format, res->dt_stride, box->x, box->y,
+                        box->width, box->height,
+                        ptr + rb->offsets[i], util_format_get_stride(format, box->width), 0, 0);
+      }
+      zink_bo_unmap(screen, staging->obj->bo);
+   }
+   winsys->displaytarget_unmap(winsys, res->dt);
+}
+
+/* account a frame to the window it was meant for, returning how many frames
+ * were dropped for it since the last one which was presented
+ */
+static unsigned
+count_window_frame(struct zink_screen *screen, void *winsys_drawable_handle, bool dropped)
+{
+   const struct xlib_drawable *drawable = winsys_drawable_handle;
+   unsigned dropped_since_put = 0;
+
+   if (!drawable || !screen->present_windows)
+      return 0;
+   simple_mtx_lock(&screen->present_windows_lock);
+   struct zink_xlib_window_stats *stats = _mesa_hash_table_u64_search(screen->present_windows, drawable->drawable);
+   if (!stats) {
+      stats = rzalloc(screen->present_windows, struct zink_xlib_window_stats);
+      if (stats)
+         _mesa_hash_table_u64_insert(screen->present_windows, drawable->drawable, stats);
+   }
+   if (stats && dropped) {
+      stats->dropped++;
+      stats->dropped_since_put++;
+   } else if (stats) {
+      stats->presented++;
+      dropped_since_put = stats->dropped_since_put;
+      stats->dropped_since_put = 0;
+   }
+   simple_mtx_unlock(&screen->present_windows_lock);
+   return dropped_since_put;
+}
+
+/* wait for a previously recorded readback and push its damage to the winsys */
+static void
+readback_present(struct zink_screen *screen, struct zink_resource *res, struct zink_xlib_present *xp,
+                 struct zink_xlib_readback *rb, void *winsys_drawable_handle)
+{
+   struct sw_winsys *winsys = screen->winsys;
+   int64_t start = os_time_get_nano();
+
+   screen->base.fence_finish(&screen->base, NULL, rb->fence, OS_TIMEOUT_INFINITE);
+   screen->base.fence_reference(&screen->base, &rb->fence, NULL);
+   int64_t waited = os_time_get_nano();
+   int64_t mapped = waited;
+
+   if (xp->dt_buffer) {
+      invalidate_mapping(screen, zink_resource(xp->dt_buffer), zink_resource(xp->dt_buffer)->obj->size);
+      mapped = os_time_get_nano();
+   } else {
+      readback_copy_staging(screen, res, rb, &mapped);
+   }
+   int64_t copied = os_time_get_nano();
+   winsys->displaytarget_display(winsys, res->dt, winsys_drawable_handle,
+                                 rb->full ? 0 : rb->nboxes, rb->full ? NULL : rb->boxes);
+   int64_t put = os_time_get_nano();
+
+   uint64_t times[ZINK_PRESENT_STAT_COUNT] = {
+      [ZINK_PRESENT_STAT_FENCE_WAIT] = waited - start,
+      [ZINK_PRESENT_STAT_MAP] = mapped - waited,
+      [ZINK_PRESENT_STAT_COPY] = copied - mapped,
+      [ZINK_PRESENT_STAT_PUT] = put - copied,
+   };
+   for (unsigned i = 0; i < ZINK_PRESENT_STAT_COUNT; i++)
+      p_atomic_add(&screen->present_stats[i], times[i]);
+   unsigned dropped = count_window_frame(screen, winsys_drawable_handle, false);
+   const struct xlib_drawable *drawable = winsys_drawable_handle;
+   if (screen->present_trace)
+      fprintf(screen->present_trace, "%" PRIi64 ",%p,%u,%.3f,%.3f,%.3f,%.3f,0x%lx,%u\n",
+              start / 1000, (void *)res, rb->full ? 0 : rb->nboxes,
+              times[0] / 1000.0, times[1] / 1000.0, times[2] / 1000.0, times[3] / 1000.0,
+              drawable ? (unsigned long)drawable->drawable : 0ul, dropped);
+}
+
+/* present the oldest pending frame */
+static void
+present_pop(struct zink_screen *screen, struct zink_resource *res, struct zink_xlib_present *xp,
+            void *winsys_drawable_handle)
+{
+   readback_present(screen, res, xp, &xp->frames[xp->head], winsys_drawable_handle);
+   xp->head = (xp->head + 1) % xp->num_frames;
+   xp->pending--;
+}
+
+static void
+present_retire(struct zink_screen *screen, struct zink_resource *res,
+               struct zink_xlib_present *xp, unsigned keep, void *winsys_drawable_handle)
+{
+   while (xp->pending > keep)
+      present_pop(screen, res, xp, winsys_drawable_handle);
+}
+
+/* discard the oldest pending frame without reading it back */
+static void
+present_drop(struct zink_screen *screen, struct zink_xlib_present *xp, void *winsys_drawable_handle)
+{
+   struct zink_xlib_readback *rb = &xp->frames[xp->head];
+   screen->base.fence_reference(&screen->base, &rb->fence, NULL);
+   xp->head = (xp->head + 1) % xp->num_frames;
+   xp->pending--;
+   count_window_frame(screen, winsys_drawable_handle, true);
+}
+
+/* mailbox: push the newest frame whose readback is done and drop the ones before it,
+ * only waiting when more than keep frames would stay pending
+ */
+static void
+present_mailbox(struct zink_screen *screen, struct zink_resource *res,
+                struct zink_xlib_present *xp, unsigned keep, void *winsys_drawable_handle)
+{
+   /* readbacks complete in submission order */
+   unsigned done = 0;
+   for (unsigned i = xp->pending; i > 0; i--) {
+      struct zink_xlib_readback *rb = &xp->frames[(xp->head + i - 1) % xp->num_frames];
+      if (screen->base.fence_finish(&screen->base, NULL, rb->fence, 0)) {
+         done = i;
+         break;
+      }
+   }
+   if (xp->pending - done > keep)
+      done = xp->pending - keep;
+   if (!done)
+      return;
+   while (--done)
+      present_drop(screen, xp, winsys_drawable_handle);
+   present_pop(screen, res, xp, winsys_drawable_handle);
+}
+
+static void
+present_all(struct zink_screen *screen, struct zink_resource *res,
+            struct zink_xlib_present *xp, void *winsys_drawable_handle)
+{
+   if (xp->mailbox)
+      present_mailbox(screen, res, xp, 0, winsys_drawable_handle);
+   else
+      present_retire(screen, res, xp, 0, winsys_drawable_handle);
+}
+
+/* a mailbox frame may replace any of the frames still pending, so its damage
+ * has to cover theirs as well; no boxes means the whole level
+ */
+static unsigned
+mailbox_damage(struct zink_xlib_present *xp, unsigned nboxes, const struct pipe_box *boxes,
+               struct pipe_box *merged)
+{
+   unsigned n = 0;
+
+   if (!nboxes)
+      return 0;
+   if (nboxes > ZINK_XLIB_MAX_DAMAGE_BOXES) {
+      merged[n] = boxes[0];
+      for (unsigned i = 1; i < nboxes; i++)
+         u_box_union_2d(&merged[n], &merged[n], &boxes[i]);
+      n++;
+   } else {
+      memcpy(merged, boxes, nboxes * sizeof(*boxes));
+      n = nboxes;
+   }
+   for (unsigned i = 0; i < xp->pending; i++) {
+      struct zink_xlib_readback *rb = &xp->frames[(xp->head + i) % xp->num_frames];
+      if (rb->full)
+         return 0;
+      memcpy(&merged[n], rb->boxes, rb->nboxes * sizeof(*rb->boxes));
+      n += rb->nboxes;
+   }
+   return n;
+}
+
+void
+zink_xlib_flush_frontbuffer(struct zink_screen *screen,
+                            struct pipe_context *pctx,
+                            struct zink_resource *res,
+                            unsigned level, unsigned layer,
+                            void *winsys_drawable_handle,
+                            unsigned nboxes,
+                            struct pipe_box *sub_box)
+{
+   struct sw_winsys *winsys = screen->winsys;
+
+   if (!winsys || !res->dt)
+      return;
+   struct zink_xlib_present *xp = lock_present(screen, res);
+   if (!xp)
+      return;
+
+   /* the xlib frontend describes the X image layout in the drawable it hands the winsys */
+   const struct xlib_drawable *drawable = winsys_drawable_handle;
+   set_display_format(xp, res->base.b.format, drawable ? drawable->format : PIPE_FORMAT_NONE);
+
+   /* the rendering context only needs to be submitted: queue order then guarantees
+    * that the present context's copy sees its results
+    */
+   if (pctx)
+      pctx->flush(pctx, NULL, 0);
+
+   /* a mailbox pushes whatever is already done and makes room for this frame */
+   if (xp->mailbox)
+      present_mailbox(screen, res, xp, xp->dt_buffer ? xp->pending : xp->num_frames - 1,
+                      winsys_drawable_handle);
+
+   /* older frames must be out before the gpu writes into the shared display target,
+    * and the winsys must be done reading them: mapping waits for that
+    */
+   if (xp->dt_buffer) {
+      if (!xp->mailbox)
+         present_retire(screen, res, xp, 0, winsys_drawable_handle);
+      winsys->displaytarget_map(winsys, res->dt, PIPE_MAP_WRITE);
+      winsys->displaytarget_unmap(winsys, res->dt);
+   }
+
+   struct zink_context *ctx = lock_present_context(screen);
+   /* without damage from the frontend, find out on the gpu which tiles actually changed */
+   struct pipe_box damage[ZINK_XLIB_MAX_DAMAGE_BOXES];
+   if (ctx && !nboxes && drawable && debug_get_option_zink_xlib_tile_hash()) {
+      int ndamage = hash_damage(ctx, res, xp, level, drawable->drawable, damage);
+      if (!ndamage) {
+         /* identical frame: nothing to read back or push */
+         unlock_present_context(screen);
+         present_all(screen, res, xp, winsys_drawable_handle);
+         simple_mtx_unlock(&xp->lock);
+         return;
+      }
+      if (ndamage > 0) {
+         nboxes = ndamage;
+         sub_box = damage;
+      }
+   }
+   struct pipe_box merged[ZINK_XLIB_MAX_DAMAGE_BOXES * (ZINK_XLIB_MAX_READBACKS + 1)];
+   if (xp->mailbox && xp->pending) {
+      nboxes = mailbox_damage(xp, nboxes, sub_box, merged);
+      sub_box = merged;
+      /* this frame's copy overwrites the display target which the pending frames would have pushed */
+      if (xp->dt_buffer) {
+         while (xp->pending)
+            present_drop(screen, xp, winsys_drawable_handle);
+      }
+   }
+   struct zink_xlib_readback *rb = &xp->frames[(xp->head + xp->pending) % xp->num_frames];
+   bool recorded = ctx && readback_record(ctx, res, xp, level, layer, nboxes, sub_box, rb);
+   if (!recorded)
+      tiles_resize(&xp->tiles, 0, 0);
+   if (ctx)
+      unlock_present_context(screen);
+   if (!recorded) {
+      present_all(screen, res, xp, winsys_drawable_handle);
+      simple_mtx_unlock(&xp->lock);
+      return;
+   }
+   xp->pending++;
+
+   /* nothing may come after this frame (an idle or expose-driven app), so only a ring
+    * explicitly deepened with ZINK_XLIB_READBACK_FRAMES keeps it pending; zero-copy writes
+    * straight into the display target and has no cpu copy to overlap, so it always pushes now
+    */
+   if (xp->dt_buffer)
+      present_all(screen, res, xp, winsys_drawable_handle);
+   else if (xp->mailbox)
+      present_mailbox(screen, res, xp, xp->num_frames - 1, winsys_drawable_handle);
+   else
+      present_retire(screen, res, xp, xp->num_frames - 1, winsys_drawable_handle);
+   simple_mtx_unlock(&xp->lock);
+}
+
+void
+zink_xlib_present_destroy(struct zink_screen *screen, struct zink_resource *res)
+{
+   struct zink_xlib_present *xp = res->xlib;
+
+   if (xp) {
+      /* the drawable may already be gone: pending frames are dropped */
+      for (unsigned i = 0; i < ARRAY_SIZE(xp->frames); i++) {
+         struct zink_xlib_readback *rb = &xp->frames[i];
+         if (rb->fence) {
+            screen->base.fence_finish(&screen->base, NULL, rb->fence, OS_TIMEOUT_INFINITE);
+            screen->base.fence_reference(&screen->base, &rb->fence, NULL);
+         }
+         pipe_resource_reference(&rb->staging, NULL);
+      }
+      pipe_resource_reference(&xp->convert, NULL);
+      pipe_resource_reference(&xp->hash_buffer, NULL);
+      free(xp->tiles.hashes);
+      if (xp->dt_buffer) {
+         pipe_resource_reference(&xp->dt_buffer, NULL);
+         screen->winsys->displaytarget_unmap(screen->winsys, res->dt);
+      }
+      simple_mtx_destroy(&xp->lock);
+      FREE(xp);
+      res->xlib = NULL;
+   }
+   if (res->dt) {
+      screen->winsys->displaytarget_destroy(screen->winsys, res->dt);
+      res->dt = NULL;
+   }
+}
+
+void
+zink_xlib_screen_init(struct zink_screen *screen)
+{
+   simple_mtx_init(&screen->present_windows_lock, mtx_plain);
+   screen->present_windows = _mesa_hash_table_u64_create(NULL);
+
+   const char *path = debug_get_option_zink_xlib_present_trace();
+   if (!path)
+      return;
+   screen->present_trace = fopen(path, "w");
+   if (!screen->present_trace) {
+      mesa_loge("zink: failed to open present trace %s", path);
+      return;
+   }
+   fprintf(screen->present_trace, "time_us,resource,boxes,fence_wait_us,map_us,copy_us,put_us,window,dropped\n");
+}
+
+/* for the present-* driver queries */
+uint64_t
+zink_xlib_present_stat(struct zink_screen *screen, enum zink_present_stat stat)
+{
+   return p_atomic_read(&screen->present_stats[stat]);
+}
+
+void
+zink_xlib_screen_destroy(struct zink_screen *screen)
+{
+   if (screen->present_trace)
+      fclose(screen->present_trace);
+   if (screen->present_hash_cs && screen->present_context)
+      screen->present_context->base.delete_compute_state(&screen->present_context->base,
+                                                          screen->present_hash_cs);
+   if (screen->present_window_tiles) {
+      hash_table_u64_foreach(screen->present_window_tiles, entry)
+         free(((struct zink_xlib_tiles *)entry.data)->hashes);
+      _mesa_hash_table_u64_destroy(screen->present_window_tiles);
+   }
+   if (screen->present_windows) {
+      if (debug_get_option_zink_xlib_mailbox()) {
+         hash_table_u64_foreach(screen->present_windows, entry) {
+            const struct zink_xlib_window_stats *stats = entry.data;
+            mesa_logi("zink: window 0x%" PRIx64 ": %" PRIu64 " frames presented, %" PRIu64 " dropped",
+                      entry.key, stats->presented, stats->dropped);
+         }
+      }
+      _mesa_hash_table_u64_destroy(screen->present_windows);
+   }
+   simple_mtx_destroy(&screen->present_windows_lock);
+}
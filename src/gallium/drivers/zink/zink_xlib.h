@@ -0,0 +1,124 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ZINK_XLIB_H
+#define ZINK_XLIB_H
+
+#include "zink_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* maximum number of frames which can be queued for readback on the sw winsys path */
+#define ZINK_XLIB_MAX_READBACKS 3
+
+/* damage beyond this many boxes is collapsed into its bounding box */
+#define ZINK_XLIB_MAX_DAMAGE_BOXES 16
+
+/* edge of the square tiles hashed to detect what changed between frames */
+#define ZINK_XLIB_TILE_SIZE 64
+
+/* per-tile hashes of some contents: a display target's or a window's */
+struct zink_xlib_tiles {
+   unsigned tiles_x, tiles_y;
+   uint64_t *hashes;
+};
+
+/* a single frame's image->buffer copy, recorded into the frame's own batch;
+ * only the damaged boxes are copied, tightly packed one after another
+ */
+struct zink_xlib_readback {
+   struct pipe_resource *staging;
+   struct pipe_fence_handle *fence;
+   struct pipe_box boxes[ZINK_XLIB_MAX_DAMAGE_BOXES];
+   unsigned offsets[ZINK_XLIB_MAX_DAMAGE_BOXES]; //offset of each box in staging
+   unsigned nboxes;
+   unsigned size; //bytes of staging used
+   bool full; //whole level, no damage was provided
+};
+
+/* frames pushed to and dropped for a single window */
+struct zink_xlib_window_stats {
+   uint64_t presented;
+   uint64_t dropped;
+   unsigned dropped_since_put; //reset by every present, for the present trace
+};
+
+/* per-display target ring of in-flight readbacks:
+ * frame N is copied on the gpu while frame N-1 is pushed to the winsys
+ */
+struct zink_xlib_present {
+   simple_mtx_t lock; //held for the whole flush, any context may present the resource
+   struct zink_xlib_readback frames[ZINK_XLIB_MAX_READBACKS];
+   unsigned num_frames; //ring depth
+   unsigned head; //oldest pending frame
+   unsigned pending;
+   /* only the newest completed frame is pushed, older pending ones are dropped;
+    * each frame's damage covers that of the frames pending when it was recorded
+    */
+   bool mailbox;
+
+   /* the display target's own memory imported as a buffer: readbacks land directly in it */
+   struct pipe_resource *dt_buffer;
+   void *dt_map;
+
+   /* the X visual's layout differs from the resource's: damage is first converted
+    * on the gpu into an rgba8 image whose bytes are exactly the X pixels
+    */
+   enum pipe_format display_format;
+   bool convert_needed;
+   unsigned char convert_swizzle[4];
+   struct pipe_resource *convert;
+
+   /* tile hashes of the display target's contents and the buffer they are computed into */
+   struct zink_xlib_tiles tiles;
+   struct pipe_resource *hash_buffer;
+};
+
+void
+zink_xlib_flush_frontbuffer(struct zink_screen *screen,
+                            struct pipe_context *pctx,
+                            struct zink_resource *res,
+                            unsigned level, unsigned layer,
+                            void *winsys_drawable_handle,
+                            unsigned nboxes,
+                            struct pipe_box *sub_box);
+
+void
+zink_xlib_present_destroy(struct zink_screen *screen, struct zink_resource *res);
+
+void
+zink_xlib_screen_init(struct zink_screen *screen);
+
+void
+zink_xlib_screen_destroy(struct zink_screen *screen);
+
+uint64_t
+zink_xlib_present_stat(struct zink_screen *screen, enum zink_present_stat stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -35,6 +35,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <X11/Xmd.h>
 #include <GL/glxproto.h>
 
@@ -70,14 +71,18 @@
    "GLX_MESA_copy_sub_buffer " \
    "GLX_MESA_pixmap_colormap " \
    "GLX_MESA_release_buffers " \
+   "GLX_MESA_swap_control " \
    "GLX_ARB_create_context " \
    "GLX_ARB_create_context_profile " \
    "GLX_ARB_get_proc_address " \
+   "GLX_EXT_buffer_age " \
    "GLX_EXT_create_context_es_profile " \
    "GLX_EXT_create_context_es2_profile " \
+   "GLX_EXT_swap_control " \
    "GLX_EXT_texture_from_pixmap " \
    "GLX_EXT_visual_info " \
    "GLX_EXT_visual_rating " \
+   "GLX_SGI_swap_control " \
    /*"GLX_SGI_video_sync "*/ \
    "GLX_SGIX_fbconfig " \
    "GLX_SGIX_pbuffer "
@@ -2140,6 +2145,15 @@ glXQueryDrawable(Display *dpy, GLXDrawable draw, int attribute,
       case GLX_MIPMAP_TEXTURE_EXT:
          *value = xmbuf->TextureMipmap;
          break;
+      case GLX_BACK_BUFFER_AGE_EXT:
+         *value = XMesaGetBackBufferAge(xmbuf);
+         break;
+      case GLX_SWAP_INTERVAL_EXT:
+         *value = xmbuf->SwapInterval;
+         break;
+      case GLX_MAX_SWAP_INTERVAL_EXT:
+         *value = INT_MAX;
+         break;
 
       default:
          generate_error(dpy, BadValue, 0, X_GLXCreateContextAttribsARB, true);
@@ -2217,12 +2231,69 @@ glXGetSelectedEvent(Display *dpy, GLXDrawable drawable, unsigned long *mask)
 PUBLIC int
 glXSwapIntervalSGI(int interval)
 {
-   (void) interval;
+   XMesaContext xmctx = XMesaGetCurrentContext();
+
+   if (interval <= 0)
+      return GLX_BAD_VALUE;
+   if (!xmctx || !xmctx->xm_buffer)
+      return GLX_BAD_CONTEXT;
+
+   xmctx->xm_buffer->SwapInterval = interval;
    return 0;
 }
 
 
 
+/*** GLX_EXT_swap_control ***/
+
+PUBLIC void
+glXSwapIntervalEXT(Display *dpy, GLXDrawable drawable, int interval)
+{
+   XMesaBuffer xmbuf = XMesaFindBuffer(dpy, drawable);
+
+   if (!xmbuf) {
+      generate_error(dpy, BadWindow, drawable, X_GLXVendorPrivate, True);
+      return;
+   }
+   if (interval < 0) {
+      generate_error(dpy, BadValue, interval, X_GLXVendorPrivate, True);
+      return;
+   }
+
+   xmbuf->SwapInterval = interval;
+}
+
+
+
+/*** GLX_MESA_swap_control ***/
+
+PUBLIC int
+glXSwapIntervalMESA(unsigned int interval)
+{
+   XMesaContext xmctx = XMesaGetCurrentContext();
+
+   if (interval > INT_MAX)
+      return GLX_BAD_VALUE;
+   if (!xmctx || !xmctx->xm_buffer)
+      return GLX_BAD_CONTEXT;
+
+   xmctx->xm_buffer->SwapInterval = interval;
+   return 0;
+}
+
+PUBLIC int
+glXGetSwapIntervalMESA(void)
+{
+   XMesaContext xmctx = XMesaGetCurrentContext();
+
+   if (!xmctx || !xmctx->xm_buffer)
+      return 0;
+
+   return xmctx->xm_buffer->SwapInterval;
+}
+
+
+
 /*** GLX_SGI_video_sync ***/
 
 static unsigned int FrameCounter = 0;
@@ -96,6 +96,13 @@ static const struct name_address_pair GLX_functions[] = {
    /*** GLX_SGI_swap_control ***/
    { "glXSwapIntervalSGI", (__GLXextFuncPtr) glXSwapIntervalSGI },
 
+   /*** GLX_EXT_swap_control ***/
+   { "glXSwapIntervalEXT", (__GLXextFuncPtr) glXSwapIntervalEXT },
+
+   /*** GLX_MESA_swap_control ***/
+   { "glXSwapIntervalMESA", (__GLXextFuncPtr) glXSwapIntervalMESA },
+   { "glXGetSwapIntervalMESA", (__GLXextFuncPtr) glXGetSwapIntervalMESA },
+
    /*** GLX_SGI_video_sync ***/
    { "glXGetVideoSyncSGI", (__GLXextFuncPtr) glXGetVideoSyncSGI },
    { "glXWaitVideoSyncSGI", (__GLXextFuncPtr) glXWaitVideoSyncSGI },
@@ -63,11 +63,13 @@
 #include "pipe/p_state.h"
 #include "frontend/api.h"
 
+#include "util/format/u_format.h"
 #include "util/simple_mtx.h"
 #include "util/u_atomic.h"
 #include "util/u_inlines.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/os_time.h"
 
 #include "hud/hud_context.h"
 
@@ -110,6 +112,24 @@ xmesa_strict_invalidate(void)
    return debug_get_option_xmesa_strict_invalidate();
 }
 
+/* Number of frames in flight, counting the one being recorded.  1 waits for
+ * each frame to complete in XMesaSwapBuffers, larger values let the
+ * application record the next frame while the GPU executes the previous ones.
+ */
+DEBUG_GET_ONCE_NUM_OPTION(xmesa_frames_in_flight, "XMESA_FRAMES_IN_FLIGHT", 2)
+
+/* There is no vblank to sync to here, so a swap interval is honoured by
+ * pacing swaps against this nominal refresh rate.
+ */
+DEBUG_GET_ONCE_NUM_OPTION(xmesa_refresh_rate, "XMESA_REFRESH_RATE", 60)
+
+static unsigned
+xmesa_frames_in_flight(void)
+{
+   return CLAMP(debug_get_option_xmesa_frames_in_flight(),
+                1, XMESA_MAX_FRAMES_IN_FLIGHT);
+}
+
 static int
 xmesa_get_param(struct pipe_frontend_screen *fscreen,
                 enum st_manager_param param)
@@ -390,6 +410,47 @@ xmesa_get_window_size(Display *dpy, XMesaBuffer b,
 #define GET_BLUEMASK(__v)       __v->mesa_visual.blueMask
 
 
+/**
+ * Choose the format the color buffers are rendered in for XImages in the
+ * given display format.  That's the display format itself if the driver
+ * can render to it at the requested num_samples, otherwise a renderable
+ * format with the same channel sizes if the driver can convert into the
+ * display format when presenting (PIPE_BIND_DISPLAY_TARGET support).
+ */
+static enum pipe_format
+choose_render_format(struct pipe_screen *screen, enum pipe_format display_format,
+                     int num_samples)
+{
+   static const enum pipe_format rgba8_formats[] = {
+      PIPE_FORMAT_BGRA8888_UNORM,
+      PIPE_FORMAT_RGBA8888_UNORM,
+   };
+
+   if (display_format == PIPE_FORMAT_NONE)
+      return PIPE_FORMAT_NONE;
+
+   if (screen->is_format_supported(screen, display_format, PIPE_TEXTURE_2D,
+                                   num_samples, num_samples,
+                                   PIPE_BIND_RENDER_TARGET))
+      return display_format;
+
+   if (!util_format_is_rgba8_variant(util_format_description(display_format)) ||
+       !screen->is_format_supported(screen, display_format, PIPE_TEXTURE_2D,
+                                    0, 0, PIPE_BIND_DISPLAY_TARGET))
+      return PIPE_FORMAT_NONE;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(rgba8_formats); i++) {
+      if (screen->is_format_supported(screen, rgba8_formats[i], PIPE_TEXTURE_2D,
+                                      num_samples, num_samples,
+                                      PIPE_BIND_RENDER_TARGET |
+                                      PIPE_BIND_DISPLAY_TARGET))
+         return rgba8_formats[i];
+   }
+
+   return PIPE_FORMAT_NONE;
+}
+
+
 /**
  * Choose the pixel format for the given visual.
  * This will tell the gallium driver how to pack pixel data into
@@ -532,6 +593,7 @@ create_xmesa_buffer(Drawable d, BufferType type,
    b->ws.drawable = d;
    b->ws.visual = vis->visinfo->visual;
    b->ws.depth = vis->visinfo->depth;
+   b->ws.format = vis->display_format;
 
    b->xm_visual = vis;
    b->type = type;
@@ -576,6 +638,23 @@ xmesa_find_buffer(Display *dpy, Colormap cmap, XMesaBuffer notThis)
 }
 
 
+/**
+ * Drop the fences of frames still in flight for this buffer, no waiting.
+ */
+static void
+xmesa_release_swap_fences(XMesaBuffer b)
+{
+   XMesaDisplay xmdpy = xmesa_init_display(b->xm_visual->display);
+   struct pipe_screen *screen = xmdpy->screen;
+
+   while (b->NumSwapFences) {
+      screen->fence_reference(screen, &b->SwapFences[b->SwapFenceHead], NULL);
+      b->SwapFenceHead = (b->SwapFenceHead + 1) % XMESA_MAX_FRAMES_IN_FLIGHT;
+      b->NumSwapFences--;
+   }
+}
+
+
 /**
  * Remove buffer from linked list, delete if no longer referenced.
  */
@@ -607,6 +686,8 @@ xmesa_free_buffer(XMesaBuffer buffer)
           */
          xmesa_destroy_st_framebuffer(buffer->drawable);
 
+         xmesa_release_swap_fences(buffer);
+
          free(buffer);
 
          return;
@@ -863,15 +944,10 @@ XMesaVisual XMesaCreateVisual( Display *display,
          v->stvis.buffer_mask |= ST_ATTACHMENT_BACK_RIGHT_MASK;
    }
 
-   v->stvis.color_format = choose_pixel_format(v);
-
-   /* Check format support at requested num_samples (for multisample) */
-   if (!xmdpy->screen->is_format_supported(xmdpy->screen,
-                                           v->stvis.color_format,
-                                           PIPE_TEXTURE_2D, num_samples,
-                                           num_samples,
-                                           PIPE_BIND_RENDER_TARGET))
-      v->stvis.color_format = PIPE_FORMAT_NONE;
+   v->display_format = choose_pixel_format(v);
+   v->stvis.color_format = choose_render_format(xmdpy->screen,
+                                                v->display_format,
+                                                num_samples);
 
    if (v->stvis.color_format == PIPE_FORMAT_NONE) {
       free(v->visinfo);
@@ -1327,6 +1403,64 @@ XMesaContext XMesaGetCurrentContext( void )
 
 
 
+/**
+ * Queue the fence of a swapped frame and wait for the oldest ones until no
+ * more than the allowed number of frames are in flight.  Takes ownership of
+ * the fence reference.
+ */
+static void
+xmesa_throttle_swap(XMesaBuffer b, struct pipe_fence_handle *fence)
+{
+   XMesaDisplay xmdpy = xmesa_init_display(b->xm_visual->display);
+   struct pipe_screen *screen = xmdpy->screen;
+   /* the swap interval is honoured by xmesa_pace_swap() alone, vsync'd
+    * applications still get to record the next frame during the wait
+    */
+   unsigned max_frames = xmesa_frames_in_flight();
+   unsigned tail;
+
+   assert(b->NumSwapFences < XMESA_MAX_FRAMES_IN_FLIGHT);
+   tail = (b->SwapFenceHead + b->NumSwapFences) % XMESA_MAX_FRAMES_IN_FLIGHT;
+   b->SwapFences[tail] = fence;
+   b->NumSwapFences++;
+
+   while (b->NumSwapFences >= max_frames) {
+      struct pipe_fence_handle **oldest = &b->SwapFences[b->SwapFenceHead];
+
+      screen->fence_finish(screen, NULL, *oldest, OS_TIMEOUT_INFINITE);
+      screen->fence_reference(screen, oldest, NULL);
+      b->SwapFenceHead = (b->SwapFenceHead + 1) % XMESA_MAX_FRAMES_IN_FLIGHT;
+      b->NumSwapFences--;
+   }
+}
+
+
+/**
+ * Honour the swap interval by keeping at least interval refresh periods
+ * between two swaps.
+ */
+static void
+xmesa_pace_swap(XMesaBuffer b)
+{
+   int64_t period, target, now;
+
+   if (b->SwapInterval <= 0)
+      return;
+
+   period = b->SwapInterval * (INT64_C(1000000000) /
+                               MAX2(debug_get_option_xmesa_refresh_rate(), 1));
+   target = b->LastSwapTime + period;
+   now = os_time_get_nano();
+
+   if (b->LastSwapTime && now < target) {
+      os_time_sleep((target - now) / 1000);
+      /* stay on the refresh grid rather than drifting by the sleep error */
+      now = target;
+   }
+   b->LastSwapTime = now;
+}
+
+
 /**
  * Swap front and back color buffers and have winsys display front buffer.
  * If there's no front color buffer no swap actually occurs.
@@ -1344,19 +1478,29 @@ void XMesaSwapBuffers( XMesaBuffer b )
    }
 
    if (xmctx && xmctx->xm_buffer == b) {
+      struct pipe_context *pipe = xmctx->st->pipe;
+      struct pipe_resource *zs =
+         xmesa_get_framebuffer_resource(b->drawable, ST_ATTACHMENT_DEPTH_STENCIL);
       struct pipe_fence_handle *fence = NULL;
+
+      /* Like the DRI frontends, consider the ancillary buffers dead after
+       * a swap so the driver doesn't need to write them back.
+       */
+      if (zs && pipe->invalidate_resource)
+         pipe->invalidate_resource(pipe, zs);
+
       st_context_flush(xmctx->st, ST_FLUSH_FRONT, &fence, NULL, NULL);
-      /* Wait until all rendering is complete */
-      if (fence) {
-         XMesaDisplay xmdpy = xmesa_init_display(b->xm_visual->display);
-         struct pipe_screen *screen = xmdpy->screen;
-         xmdpy->screen->fence_finish(screen, NULL, fence,
-                                     OS_TIMEOUT_INFINITE);
-         xmdpy->screen->fence_reference(screen, &fence, NULL);
-      }
+      /* Only wait for the frame from N swaps ago, the driver orders the
+       * display of this one after its rendering.
+       */
+      if (fence)
+         xmesa_throttle_swap(b, fence);
    }
 
-   xmesa_swap_st_framebuffer(b->drawable);
+   xmesa_pace_swap(b);
+
+   xmesa_swap_st_framebuffer(b->drawable,
+                             xmctx && xmctx->xm_buffer == b ? xmctx->st : NULL);
 
    /* TODO: remove this if the framebuffer state doesn't change. */
    st_context_invalidate_state(xmctx->st, ST_INVALIDATE_FB_STATE);
@@ -1380,6 +1524,13 @@ void XMesaCopySubBuffer( XMesaBuffer b, int x, int y, int width, int height )
 
 
 
+unsigned XMesaGetBackBufferAge( XMesaBuffer b )
+{
+   return xmesa_get_st_framebuffer_age(b->drawable);
+}
+
+
+
 void XMesaFlush( XMesaContext c )
 {
    if (c && c->xm_visual->display) {
@@ -228,6 +228,12 @@ extern void XMesaCopySubBuffer( XMesaBuffer b,
 				int height );
 
 
+/*
+ * Return the age of the back buffer contents (GLX_EXT_buffer_age).
+ */
+extern unsigned XMesaGetBackBufferAge( XMesaBuffer b );
+
+
 
 
 
@@ -296,6 +302,8 @@ struct xmesa_visual {
 
    GLboolean ximage_flag;	/* Use XImage for back buffer (not pixmap)? */
 
+   enum pipe_format display_format; /* pixel layout of the visual's XImages */
+
    struct st_visual stvis;
 };
 
@@ -324,6 +332,10 @@ typedef enum {
 } BufferType;
 
 
+/** Upper bound for XMESA_FRAMES_IN_FLIGHT */
+#define XMESA_MAX_FRAMES_IN_FLIGHT 4
+
+
 /**
  * Framebuffer information, derived from.
  * Basically corresponds to a GLXDrawable.
@@ -351,6 +363,14 @@ struct xmesa_buffer {
    GLint TextureFormat; /** GLX_TEXTURE_FORMAT_RGB_EXT, for example */
    GLint TextureMipmap; /** 0 or 1 */
 
+   /* GLX_EXT_swap_control / GLX_MESA_swap_control */
+   int SwapInterval;
+   int64_t LastSwapTime;        /**< os_time_get_nano() of the last paced swap */
+
+   /* fences of swapped frames the GPU may still be working on, oldest first */
+   struct pipe_fence_handle *SwapFences[XMESA_MAX_FRAMES_IN_FLIGHT];
+   unsigned SwapFenceHead, NumSwapFences;
+
    struct xmesa_buffer *Next;	/* Linked list pointer: */
 
    unsigned width, height;
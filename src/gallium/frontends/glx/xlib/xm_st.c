@@ -47,6 +47,10 @@ struct xmesa_st_framebuffer {
    unsigned texture_width, texture_height, texture_mask;
    struct pipe_resource *textures[ST_ATTACHMENT_COUNT];
 
+   /* swap number at which each texture was last presented, 0 if never */
+   unsigned swap_count;
+   unsigned texture_swap[ST_ATTACHMENT_COUNT];
+
    struct pipe_resource *display_resource;
 };
 
@@ -132,8 +136,10 @@ xmesa_st_framebuffer_validate_textures(struct pipe_frontend_drawable *drawable,
 
    /* remove outdated textures */
    if (xstfb->texture_width != width || xstfb->texture_height != height) {
-      for (i = 0; i < ST_ATTACHMENT_COUNT; i++)
+      for (i = 0; i < ST_ATTACHMENT_COUNT; i++) {
          pipe_resource_reference(&xstfb->textures[i], NULL);
+         xstfb->texture_swap[i] = 0;
+      }
    }
 
    memset(&templ, 0, sizeof(templ));
@@ -355,22 +361,32 @@ xmesa_get_framebuffer_resource(struct pipe_frontend_drawable *drawable,
 
 
 void
-xmesa_swap_st_framebuffer(struct pipe_frontend_drawable *drawable)
+xmesa_swap_st_framebuffer(struct pipe_frontend_drawable *drawable,
+                          struct st_context *st)
 {
    struct xmesa_st_framebuffer *xstfb = xmesa_st_framebuffer(drawable);
    bool ret;
 
-   ret = xmesa_st_framebuffer_display(drawable, NULL, ST_ATTACHMENT_BACK_LEFT, 0, NULL);
+   /* with the rendering context passed, the driver orders the display after
+    * the pending rendering to the back buffer instead of the caller waiting
+    */
+   ret = xmesa_st_framebuffer_display(drawable, st, ST_ATTACHMENT_BACK_LEFT, 0, NULL);
    if (ret) {
       struct pipe_resource **front, **back, *tmp;
 
       front = &xstfb->textures[ST_ATTACHMENT_FRONT_LEFT];
       back = &xstfb->textures[ST_ATTACHMENT_BACK_LEFT];
+      if (*back)
+         xstfb->texture_swap[ST_ATTACHMENT_BACK_LEFT] = ++xstfb->swap_count;
       /* swap textures only if the front texture has been allocated */
       if (*front) {
+         unsigned tmp_swap = xstfb->texture_swap[ST_ATTACHMENT_FRONT_LEFT];
+
          tmp = *front;
          *front = *back;
          *back = tmp;
+         xstfb->texture_swap[ST_ATTACHMENT_FRONT_LEFT] = xstfb->texture_swap[ST_ATTACHMENT_BACK_LEFT];
+         xstfb->texture_swap[ST_ATTACHMENT_BACK_LEFT] = tmp_swap;
 
          /* the current context should validate the buffer after swapping */
          if (!xmesa_strict_invalidate())
@@ -383,6 +399,22 @@ xmesa_swap_st_framebuffer(struct pipe_frontend_drawable *drawable)
 }
 
 
+/**
+ * Return the age of the back buffer contents in the GLX_EXT_buffer_age sense:
+ * the number of swaps since they were presented, or 0 if undefined.
+ */
+unsigned
+xmesa_get_st_framebuffer_age(struct pipe_frontend_drawable *drawable)
+{
+   struct xmesa_st_framebuffer *xstfb = xmesa_st_framebuffer(drawable);
+   unsigned swap = xstfb->texture_swap[ST_ATTACHMENT_BACK_LEFT];
+
+   if (!swap || !xstfb->textures[ST_ATTACHMENT_BACK_LEFT])
+      return 0;
+   return xstfb->swap_count - swap + 1;
+}
+
+
 void
 xmesa_copy_st_framebuffer(struct pipe_frontend_drawable *drawable,
                           enum st_attachment_type src,
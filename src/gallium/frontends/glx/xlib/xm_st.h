@@ -44,7 +44,11 @@ xmesa_get_framebuffer_resource(struct pipe_frontend_drawable *drawable,
                                enum st_attachment_type att);
 
 void
-xmesa_swap_st_framebuffer(struct pipe_frontend_drawable *drawable);
+xmesa_swap_st_framebuffer(struct pipe_frontend_drawable *drawable,
+                          struct st_context *st);
+
+unsigned
+xmesa_get_st_framebuffer_age(struct pipe_frontend_drawable *drawable);
 
 void
 xmesa_copy_st_framebuffer(struct pipe_frontend_drawable *drawable,
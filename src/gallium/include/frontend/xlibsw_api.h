@@ -2,6 +2,7 @@
 #define XLIB_SW_WINSYS_H
 
 #include "frontend/sw_winsys.h"
+#include "util/format/u_formats.h"
 #include <X11/Xlib.h>
 
 
@@ -14,6 +15,7 @@ struct xlib_drawable {
    Visual *visual;
    int depth;
    Drawable drawable;
+   enum pipe_format format; /* pixel layout of the visual's XImages */
 };
 
 #endif
@@ -38,6 +38,10 @@
 #include "util/format/u_format.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/os_time.h"
+#include "util/u_queue.h"
+#include "util/list.h"
+#include "util/simple_mtx.h"
 
 #include "frontend/xlibsw_api.h"
 #include "xlib_sw_winsys.h"
@@ -45,11 +49,17 @@
 #include <X11/Xlib.h>
 #include <X11/Xlibint.h>
 #include <X11/Xutil.h>
+#include <poll.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <X11/extensions/XShm.h>
 
 DEBUG_GET_ONCE_BOOL_OPTION(xlib_no_shm, "XLIB_NO_SHM", false)
+DEBUG_GET_ONCE_BOOL_OPTION(xlib_present_thread, "XLIB_PRESENT_THREAD", false)
+DEBUG_GET_ONCE_NUM_OPTION(xlib_shm_pool_size, "XLIB_SHM_POOL_SIZE", 64)
+
+/* freed shared memory display targets stay attached in the pool this long */
+#define XLIB_SHM_POOL_TIMEOUT_NS (2 * 1000000000ll)
 
 /**
  * Display target for Xlib winsys.
@@ -57,6 +67,7 @@ DEBUG_GET_ONCE_BOOL_OPTION(xlib_no_shm, "XLIB_NO_SHM", false)
  */
 struct xlib_displaytarget
 {
+   struct xlib_sw_winsys *ws;
    enum pipe_format format;
    unsigned width;
    unsigned height;
@@ -66,17 +77,27 @@ struct xlib_displaytarget
    void *mapped;
 
    Display *display;
-   Visual *visual;
    XImage *tempImage;
    GC gc;
 
-   /* This is the last drawable that this display target was presented
-    * against.  May need to recreate gc, tempImage when this changes??
+   /* The drawable, visual and depth this display target was last presented
+    * against: gc and tempImage are recreated when any of them changes.
     */
    Drawable drawable;
+   Visual *visual;
+   int depth;
 
    XShmSegmentInfo shminfo;
    Bool shm;  /** Using shared memory images? */
+   Bool shm_attached; /** Segment attached on the server */
+   unsigned shm_size; /** Bucketed size of the segment */
+
+   /* in the winsys' pool once freed, see xlib_displaytarget_recycle() */
+   struct list_head pool_link;
+   int64_t pool_time;
+
+   /* signalled once the last queued present has been read by the server */
+   struct util_queue_fence present_fence;
 };
 
 
@@ -87,6 +108,42 @@ struct xlib_sw_winsys
 {
    struct sw_winsys base;
    Display *display;
+
+   /* Optional present thread: X requests for display targets go through
+    * their own connection on a worker, so the render thread never waits
+    * on the X server.  Everything on present_display is only touched by
+    * that worker once the queue is running.
+    */
+   Display *present_display;
+   struct util_queue present_queue;
+   int shm_completion_type;
+   bool present_error; /* X error while executing the current job */
+   struct list_head link; /* in present_winsys_list */
+
+   Bool has_shm; /* MIT-SHM usable, queried once */
+
+   /* Freed shared memory display targets, most recently freed last.  They
+    * keep their segment attached so that resizing a window doesn't
+    * allocate and attach a new one, which costs a server round trip.
+    */
+   simple_mtx_t pool_lock;
+   struct list_head pool;
+   uint64_t pool_size; /* bytes */
+   uint64_t pool_max_size;
+};
+
+
+/**
+ * A present queued to the present thread; the drawable is copied since the
+ * frontend's may be gone by the time the job runs.
+ */
+struct xlib_present_job
+{
+   struct xlib_sw_winsys *ws;
+   struct xlib_displaytarget *xlib_dt;
+   struct xlib_drawable drawable;
+   unsigned nboxes;
+   struct pipe_box boxes[];
 };
 
 
@@ -105,6 +162,14 @@ xlib_displaytarget(struct sw_displaytarget *dt)
 
 static volatile int XErrorFlag = 0;
 
+/* winsys with a present thread, so their connection's errors can be told
+ * apart from the application's; the application's own handler is chained
+ * to and restored once the last of them is destroyed
+ */
+static struct list_head present_winsys_list = { &present_winsys_list, &present_winsys_list };
+static simple_mtx_t present_winsys_lock = SIMPLE_MTX_INITIALIZER;
+static int (*present_app_handler)(Display *, XErrorEvent *);
+
 /**
  * Catches potential Xlib errors.
  */
@@ -118,6 +183,50 @@ handle_xerror(Display *dpy, XErrorEvent *event)
 }
 
 
+/**
+ * Swallows errors on present thread connections, typically a window which
+ * was destroyed by the application while its present was still queued,
+ * and forwards everything else.
+ */
+static int
+handle_present_xerror(Display *dpy, XErrorEvent *event)
+{
+   int ret = 0;
+   bool found = false;
+
+   simple_mtx_lock(&present_winsys_lock);
+   list_for_each_entry(struct xlib_sw_winsys, ws, &present_winsys_list, link) {
+      if (ws->present_display == dpy) {
+         ws->present_error = true;
+         found = true;
+         break;
+      }
+   }
+   simple_mtx_unlock(&present_winsys_lock);
+
+   if (!found && present_app_handler)
+      ret = present_app_handler(dpy, event);
+   return ret;
+}
+
+
+/**
+ * The error handler is process global, and applications (Wine, for one) may
+ * install their own after the present thread's: errors on its connection
+ * would then reach the application's handler, or kill the process with the
+ * default one.  Put handle_present_xerror() back in front of whatever was
+ * installed since, which it then forwards to.  Only called on the
+ * application's thread, with present_winsys_lock held.
+ */
+static void
+present_claim_xerror(void)
+{
+   int (*prev)(Display *, XErrorEvent *) = XSetErrorHandler(handle_present_xerror);
+   if (prev != handle_present_xerror)
+      present_app_handler = prev;
+}
+
+
 static char *
 alloc_shm(struct xlib_displaytarget *buf, unsigned size)
 {
@@ -127,6 +236,7 @@ alloc_shm(struct xlib_displaytarget *buf, unsigned size)
    shminfo->shmaddr = (char *) -1;
 
    /* 0600 = user read+write */
+   buf->shm_size = size;
    shminfo->shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
    if (shminfo->shmid < 0) {
       return NULL;
@@ -158,7 +268,9 @@ alloc_shm_ximage(struct xlib_displaytarget *xlib_dt,
     * errors at different points if the extension won't work.  Therefore
     * we have to be very careful...
     */
+   struct xlib_sw_winsys *ws = xlib_dt->ws;
    int (*old_handler)(Display *, XErrorEvent *);
+   bool failed;
 
    xlib_dt->tempImage = XShmCreateImage(xlib_dt->display,
                                       xmb->visual,
@@ -173,30 +285,47 @@ alloc_shm_ximage(struct xlib_displaytarget *xlib_dt,
       return;
    }
 
+   /* a recycled segment is still attached, only the image is new */
+   if (xlib_dt->shm_attached)
+      return;
 
-   XErrorFlag = 0;
-   old_handler = XSetErrorHandler(handle_xerror);
-   /* This may trigger the X protocol error we're ready to catch: */
-   XShmAttach(xlib_dt->display, &xlib_dt->shminfo);
-   XSync(xlib_dt->display, False);
+   if (xlib_dt->display == ws->present_display) {
+      /* On the present thread, handle_present_xerror() already catches this
+       * connection's errors; the error handler is process global and must
+       * not be swapped behind the application's back from here.
+       */
+      ws->present_error = false;
+      XShmAttach(xlib_dt->display, &xlib_dt->shminfo);
+      XSync(xlib_dt->display, False);
+      failed = ws->present_error;
+      ws->present_error = false;
+   } else {
+      XErrorFlag = 0;
+      old_handler = XSetErrorHandler(handle_xerror);
+      /* This may trigger the X protocol error we're ready to catch: */
+      XShmAttach(xlib_dt->display, &xlib_dt->shminfo);
+      XSync(xlib_dt->display, False);
+      (void) XSetErrorHandler(old_handler);
+      failed = XErrorFlag;
+      XErrorFlag = 0;
+   }
 
    /* Mark the segment to be destroyed, so that it is automatically destroyed
     * when this process dies.  Needs to be after XShmAttach() for *BSD.
     */
    shmctl(xlib_dt->shminfo.shmid, IPC_RMID, 0);
 
-   if (XErrorFlag) {
+   if (failed) {
       /* we are on a remote display, this error is normal, don't print it */
       XFlush(xlib_dt->display);
-      XErrorFlag = 0;
       XDestroyImage(xlib_dt->tempImage);
       xlib_dt->tempImage = NULL;
       xlib_dt->shm = False;
-      (void) XSetErrorHandler(old_handler);
       return;
    }
 
    xlib_dt->shm = True;
+   xlib_dt->shm_attached = True;
 }
 
 
@@ -237,6 +366,8 @@ xlib_displaytarget_map(struct sw_winsys *ws,
                        unsigned flags)
 {
    struct xlib_displaytarget *xlib_dt = xlib_displaytarget(dt);
+   /* don't let the contents change while the server still reads them */
+   util_queue_fence_wait(&xlib_dt->present_fence);
    xlib_dt->mapped = xlib_dt->data;
    return xlib_dt->mapped;
 }
@@ -252,13 +383,12 @@ xlib_displaytarget_unmap(struct sw_winsys *ws,
 
 
 static void
-xlib_displaytarget_destroy(struct sw_winsys *ws,
-                           struct sw_displaytarget *dt)
+xlib_displaytarget_free(struct xlib_displaytarget *xlib_dt)
 {
-   struct xlib_displaytarget *xlib_dt = xlib_displaytarget(dt);
-
    if (xlib_dt->data) {
       if (xlib_dt->shminfo.shmid >= 0) {
+         if (xlib_dt->shm_attached)
+            XShmDetach(xlib_dt->display, &xlib_dt->shminfo);
          shmdt(xlib_dt->shminfo.shmaddr);
          shmctl(xlib_dt->shminfo.shmid, IPC_RMID, 0);
          
@@ -286,19 +416,129 @@ xlib_displaytarget_destroy(struct sw_winsys *ws,
    if (xlib_dt->gc)
       XFreeGC(xlib_dt->display, xlib_dt->gc);
 
+   util_queue_fence_destroy(&xlib_dt->present_fence);
    FREE(xlib_dt);
 }
 
 
 /**
- * Display/copy the image in the surface into the X window specified
- * by the display target.
+ * Size of the segment allocated for a display target of the given size:
+ * rounded up to an eighth of its power of two, so that the sizes seen
+ * while interactively resizing a window fall into few buckets.
+ */
+static unsigned
+shm_bucket_size(unsigned size)
+{
+   unsigned granularity = MAX2(util_next_power_of_two(size) / 8, 4096);
+   return align(size, granularity);
+}
+
+
+/**
+ * Free the pooled display targets which haven't been reused in a while,
+ * and the oldest ones while the pool is over its budget.
+ */
+static void
+xlib_pool_trim(struct xlib_sw_winsys *ws, int64_t now, bool all)
+{
+   list_for_each_entry_safe(struct xlib_displaytarget, xlib_dt, &ws->pool, pool_link) {
+      if (!all && ws->pool_size <= ws->pool_max_size &&
+          now - xlib_dt->pool_time < XLIB_SHM_POOL_TIMEOUT_NS)
+         break;
+      list_del(&xlib_dt->pool_link);
+      ws->pool_size -= xlib_dt->shm_size;
+      xlib_displaytarget_free(xlib_dt);
+   }
+}
+
+
+/**
+ * Put a freed shared memory display target into the pool instead of
+ * detaching and freeing its segment.
+ */
+static void
+xlib_displaytarget_recycle(struct xlib_sw_winsys *ws,
+                           struct xlib_displaytarget *xlib_dt)
+{
+   if (!xlib_dt->shm || !ws->pool_max_size ||
+       xlib_dt->shm_size > ws->pool_max_size) {
+      xlib_displaytarget_free(xlib_dt);
+      return;
+   }
+
+   simple_mtx_lock(&ws->pool_lock);
+   xlib_dt->pool_time = os_time_get_nano();
+   list_addtail(&xlib_dt->pool_link, &ws->pool);
+   ws->pool_size += xlib_dt->shm_size;
+   xlib_pool_trim(ws, xlib_dt->pool_time, false);
+   simple_mtx_unlock(&ws->pool_lock);
+}
+
+
+/**
+ * Take the smallest pooled display target whose segment fits, as long as
+ * it doesn't waste more than half of it.
  */
+static struct xlib_displaytarget *
+xlib_pool_get(struct xlib_sw_winsys *ws, unsigned size)
+{
+   struct xlib_displaytarget *best = NULL;
+
+   simple_mtx_lock(&ws->pool_lock);
+   /* with a present thread, the pool is only trimmed there */
+   if (!ws->present_display)
+      xlib_pool_trim(ws, os_time_get_nano(), false);
+   list_for_each_entry(struct xlib_displaytarget, xlib_dt, &ws->pool, pool_link) {
+      if (xlib_dt->shm_size >= size && xlib_dt->shm_size / 2 <= size &&
+          (!best || xlib_dt->shm_size < best->shm_size))
+         best = xlib_dt;
+   }
+   if (best) {
+      list_del(&best->pool_link);
+      ws->pool_size -= best->shm_size;
+   }
+   simple_mtx_unlock(&ws->pool_lock);
+
+   return best;
+}
+
+
+static void
+xlib_displaytarget_free_job(void *job, void *gdata, int thread_index)
+{
+   struct xlib_displaytarget *xlib_dt = job;
+   xlib_displaytarget_recycle(xlib_dt->ws, xlib_dt);
+}
+
+
 static void
+xlib_displaytarget_destroy(struct sw_winsys *ws,
+                           struct sw_displaytarget *dt)
+{
+   struct xlib_sw_winsys *xlib_ws = (struct xlib_sw_winsys *)ws;
+   struct xlib_displaytarget *xlib_dt = xlib_displaytarget(dt);
+
+   /* the X resources belong to the present thread's connection, free them
+    * there once the queued presents are done with the display target
+    */
+   if (xlib_ws->present_display)
+      util_queue_add_job(&xlib_ws->present_queue, xlib_dt, NULL,
+                         xlib_displaytarget_free_job, NULL, 0);
+   else
+      xlib_displaytarget_recycle(xlib_ws, xlib_dt);
+}
+
+
+/**
+ * Display/copy the image in the surface into the X window specified
+ * by the display target.  Returns the number of shared memory puts issued.
+ */
+static unsigned
 xlib_sw_display(struct xlib_drawable *xlib_drawable,
                 struct sw_displaytarget *dt,
                 unsigned nboxes,
-                struct pipe_box *box)
+                struct pipe_box *box,
+                Bool send_event)
 {
    static bool no_swap = false;
    static bool firsttime = true;
@@ -313,7 +553,7 @@ xlib_sw_display(struct xlib_drawable *xlib_drawable,
    }
 
    if (no_swap)
-      return;
+      return 0;
 
    if (!nboxes) {
       nboxes = 1;
@@ -322,18 +562,25 @@ xlib_sw_display(struct xlib_drawable *xlib_drawable,
       box = &_box;
    }
 
-   if (xlib_dt->drawable != xlib_drawable->drawable) {
+   if (xlib_dt->drawable != xlib_drawable->drawable ||
+       xlib_dt->visual != xlib_drawable->visual ||
+       xlib_dt->depth != xlib_drawable->depth) {
       if (xlib_dt->gc) {
          XFreeGC(display, xlib_dt->gc);
          xlib_dt->gc = NULL;
       }
 
       if (xlib_dt->tempImage) {
+         /* a shared memory image doesn't own the segment */
+         if (xlib_dt->shm)
+            xlib_dt->tempImage->data = NULL;
          XDestroyImage(xlib_dt->tempImage);
          xlib_dt->tempImage = NULL;
       }
 
       xlib_dt->drawable = xlib_drawable->drawable;
+      xlib_dt->visual = xlib_drawable->visual;
+      xlib_dt->depth = xlib_drawable->depth;
    }
 
    if (xlib_dt->tempImage == NULL) {
@@ -343,7 +590,7 @@ xlib_sw_display(struct xlib_drawable *xlib_drawable,
                    xlib_dt->stride / util_format_get_blocksize(xlib_dt->format),
                    xlib_dt->height);
       if (!xlib_dt->tempImage)
-         return;
+         return 0;
    }
 
    if (xlib_dt->gc == NULL) {
@@ -359,7 +606,7 @@ xlib_sw_display(struct xlib_drawable *xlib_drawable,
          /* _debug_printf("XSHM\n"); */
          XShmPutImage(xlib_dt->display, xlib_drawable->drawable, xlib_dt->gc,
                      ximage, box[i].x, box[i].y, box[i].x, box[i].y,
-                     box[i].width, box[i].height, False);
+                     box[i].width, box[i].height, send_event);
       }
       else {
          /* display image in Window */
@@ -383,6 +630,76 @@ xlib_sw_display(struct xlib_drawable *xlib_drawable,
    }
 
    XFlush(xlib_dt->display);
+
+   return xlib_dt->shm ? nboxes : 0;
+}
+
+
+/* a completion which never arrives must not stall the present thread for good */
+#define XLIB_SHM_COMPLETION_TIMEOUT_MS 1000
+
+static Bool
+is_shm_completion(Display *display, XEvent *event, XPointer arg)
+{
+   struct xlib_present_job *job = (struct xlib_present_job *)arg;
+   XShmCompletionEvent *completion = (XShmCompletionEvent *)event;
+
+   return event->type == job->ws->shm_completion_type &&
+          completion->shmseg == job->xlib_dt->shminfo.shmseg;
+}
+
+
+/**
+ * Present thread side of xlib_displaytarget_display(): put the image, then
+ * wait until the server is done reading the segment before the display
+ * target's fence signals.
+ */
+static void
+xlib_present_execute(void *data, void *gdata, int thread_index)
+{
+   struct xlib_present_job *job = data;
+   struct xlib_sw_winsys *ws = job->ws;
+   struct xlib_displaytarget *xlib_dt = job->xlib_dt;
+   unsigned num_puts;
+   int64_t deadline;
+   XEvent event;
+
+   ws->present_error = false;
+   num_puts = xlib_sw_display(&job->drawable, (struct sw_displaytarget *)xlib_dt,
+                              job->nboxes, job->nboxes ? job->boxes : NULL, True);
+   if (!num_puts)
+      return;
+
+   /* a failed put, e.g. to a window the application destroyed in the
+    * meantime, generates no completion; the round trip surfaces the error
+    */
+   XSync(ws->present_display, False);
+   deadline = os_time_get_nano() + XLIB_SHM_COMPLETION_TIMEOUT_MS * 1000000ll;
+   while (num_puts && !ws->present_error) {
+      if (XCheckIfEvent(ws->present_display, &event, is_shm_completion, (XPointer)job)) {
+         num_puts--;
+         continue;
+      }
+
+      int64_t timeout = deadline - os_time_get_nano();
+      struct pollfd pfd = {
+         .fd = ConnectionNumber(ws->present_display),
+         .events = POLLIN,
+      };
+      if (timeout <= 0 || poll(&pfd, 1, DIV_ROUND_UP(timeout, 1000000)) == 0)
+         break;
+   }
+
+   /* completions of the puts which went through before the error */
+   while (XCheckIfEvent(ws->present_display, &event, is_shm_completion, (XPointer)job))
+      ;
+}
+
+
+static void
+xlib_present_cleanup(void *data, void *gdata, int thread_index)
+{
+   FREE(data);
 }
 
 
@@ -397,8 +714,34 @@ xlib_displaytarget_display(struct sw_winsys *ws,
                            unsigned nboxes,
                            struct pipe_box *box)
 {
+   struct xlib_sw_winsys *xlib_ws = (struct xlib_sw_winsys *)ws;
+   struct xlib_displaytarget *xlib_dt = xlib_displaytarget(dt);
    struct xlib_drawable *xlib_drawable = (struct xlib_drawable *)context_private;
-   xlib_sw_display(xlib_drawable, dt, nboxes, box);
+   struct xlib_present_job *job;
+
+   if (!xlib_ws->present_display) {
+      xlib_sw_display(xlib_drawable, dt, nboxes, box, False);
+      return;
+   }
+
+   job = MALLOC(sizeof(*job) + nboxes * sizeof(struct pipe_box));
+   if (!job)
+      return;
+   job->ws = xlib_ws;
+   job->xlib_dt = xlib_dt;
+   job->drawable = *xlib_drawable;
+   job->nboxes = nboxes;
+   if (nboxes)
+      memcpy(job->boxes, box, nboxes * sizeof(struct pipe_box));
+
+   simple_mtx_lock(&present_winsys_lock);
+   present_claim_xerror();
+   simple_mtx_unlock(&present_winsys_lock);
+
+   /* one present per display target can be tracked at a time */
+   util_queue_fence_wait(&xlib_dt->present_fence);
+   util_queue_add_job(&xlib_ws->present_queue, job, &xlib_dt->present_fence,
+                      xlib_present_execute, xlib_present_cleanup, 0);
 }
 
 
@@ -409,28 +752,53 @@ xlib_displaytarget_create(struct sw_winsys *winsys,
                           unsigned width, unsigned height,
                           unsigned alignment,
                           const void *front_private,
-                          unsigned *stride)
+                          unsigned *stride_out)
 {
+   struct xlib_sw_winsys *xlib_ws = (struct xlib_sw_winsys *)winsys;
    struct xlib_displaytarget *xlib_dt;
-   unsigned nblocksy, size;
-   int ignore;
+   unsigned nblocksy, size, stride;
+
+   nblocksy = util_format_get_nblocksy(format, height);
+   stride = align(util_format_get_stride(format, width), alignment);
+   size = stride * nblocksy;
+
+   if (xlib_ws->has_shm) {
+      xlib_dt = xlib_pool_get(xlib_ws, size);
+      if (xlib_dt) {
+         /* the image describes the old dimensions, the segment stays */
+         if (xlib_dt->tempImage) {
+            xlib_dt->tempImage->data = NULL;
+            XDestroyImage(xlib_dt->tempImage);
+            xlib_dt->tempImage = NULL;
+         }
+         /* the next present may target another drawable, visual or depth:
+          * have xlib_sw_display() recreate the gc on its thread
+          */
+         xlib_dt->drawable = None;
+         xlib_dt->format = format;
+         xlib_dt->width = width;
+         xlib_dt->height = height;
+         xlib_dt->stride = stride;
+         *stride_out = stride;
+         return (struct sw_displaytarget *)xlib_dt;
+      }
+   }
 
    xlib_dt = CALLOC_STRUCT(xlib_displaytarget);
    if (!xlib_dt)
       goto no_xlib_dt;
 
-   xlib_dt->display = ((struct xlib_sw_winsys *)winsys)->display;
+   xlib_dt->ws = xlib_ws;
+   xlib_dt->display = xlib_ws->present_display ? xlib_ws->present_display
+                                               : xlib_ws->display;
+   util_queue_fence_init(&xlib_dt->present_fence);
    xlib_dt->format = format;
    xlib_dt->width = width;
    xlib_dt->height = height;
+   xlib_dt->stride = stride;
 
-   nblocksy = util_format_get_nblocksy(format, height);
-   xlib_dt->stride = align(util_format_get_stride(format, width), alignment);
-   size = xlib_dt->stride * nblocksy;
-
-   if (!debug_get_option_xlib_no_shm() &&
-       XQueryExtension(xlib_dt->display, "MIT-SHM", &ignore, &ignore, &ignore)) {
-      xlib_dt->data = alloc_shm(xlib_dt, size);
+   if (xlib_ws->has_shm) {
+      xlib_dt->data = alloc_shm(xlib_dt, shm_bucket_size(size));
       if (xlib_dt->data) {
          xlib_dt->shm = True;
       }
@@ -442,10 +810,11 @@ xlib_displaytarget_create(struct sw_winsys *winsys,
          goto no_data;
    }
 
-   *stride = xlib_dt->stride;
+   *stride_out = xlib_dt->stride;
    return (struct sw_displaytarget *)xlib_dt;
 
 no_data:
+   util_queue_fence_destroy(&xlib_dt->present_fence);
    FREE(xlib_dt);
 no_xlib_dt:
    return NULL;
@@ -473,9 +842,61 @@ xlib_displaytarget_get_handle(struct sw_winsys *winsys,
 }
 
 
+/**
+ * Open the present thread's own connection to the display's server and
+ * start the worker.  Leaves presentation synchronous on failure.
+ */
+static void
+xlib_init_present_thread(struct xlib_sw_winsys *ws)
+{
+   ws->present_display = XOpenDisplay(DisplayString(ws->display));
+   if (!ws->present_display)
+      return;
+
+   ws->shm_completion_type = XShmGetEventBase(ws->present_display) + ShmCompletion;
+
+   if (!util_queue_init(&ws->present_queue, "xlibpresent", 8, 1,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL)) {
+      XCloseDisplay(ws->present_display);
+      ws->present_display = NULL;
+      return;
+   }
+
+   simple_mtx_lock(&present_winsys_lock);
+   present_claim_xerror();
+   list_addtail(&ws->link, &present_winsys_list);
+   simple_mtx_unlock(&present_winsys_lock);
+}
+
+
 static void
 xlib_destroy(struct sw_winsys *ws)
 {
+   struct xlib_sw_winsys *xlib_ws = (struct xlib_sw_winsys *)ws;
+
+   if (xlib_ws->present_display) {
+      /* run the queued presents and display target frees */
+      util_queue_finish(&xlib_ws->present_queue);
+      util_queue_destroy(&xlib_ws->present_queue);
+
+      simple_mtx_lock(&present_winsys_lock);
+      list_del(&xlib_ws->link);
+      if (list_is_empty(&present_winsys_list)) {
+         /* hand the application its handler back, unless it has replaced ours since */
+         int (*prev)(Display *, XErrorEvent *) = XSetErrorHandler(present_app_handler);
+         if (prev != handle_present_xerror)
+            (void) XSetErrorHandler(prev);
+         present_app_handler = NULL;
+      }
+      simple_mtx_unlock(&present_winsys_lock);
+   }
+
+   xlib_pool_trim(xlib_ws, 0, true);
+   simple_mtx_destroy(&xlib_ws->pool_lock);
+
+   if (xlib_ws->present_display)
+      XCloseDisplay(xlib_ws->present_display);
+
    FREE(ws);
 }
 
@@ -484,12 +905,18 @@ struct sw_winsys *
 xlib_create_sw_winsys(Display *display)
 {
    struct xlib_sw_winsys *ws;
+   int ignore;
 
    ws = CALLOC_STRUCT(xlib_sw_winsys);
    if (!ws)
       return NULL;
 
    ws->display = display;
+   ws->has_shm = !debug_get_option_xlib_no_shm() &&
+                 XQueryExtension(display, "MIT-SHM", &ignore, &ignore, &ignore);
+   simple_mtx_init(&ws->pool_lock, mtx_plain);
+   list_inithead(&ws->pool);
+   ws->pool_max_size = (uint64_t)debug_get_option_xlib_shm_pool_size() * 1024 * 1024;
    ws->base.destroy = xlib_destroy;
 
    ws->base.is_displaytarget_format_supported = xlib_is_displaytarget_format_supported;
@@ -503,5 +930,8 @@ xlib_create_sw_winsys(Display *display)
 
    ws->base.displaytarget_display = xlib_displaytarget_display;
 
+   if (debug_get_option_xlib_present_thread())
+      xlib_init_present_thread(ws);
+
    return &ws->base;
 }
@@ -25,10 +25,15 @@
 #include <errno.h>
 #include <stdio.h>
 #include <netinet/in.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <util/anon_file.h>
 #include <util/format/u_format.h>
+#include <util/os_mman.h>
+#include <util/u_atomic.h>
+#include <util/u_debug.h>
 #include <util/u_process.h>
 
 #include "virgl_vtest_winsys.h"
@@ -115,6 +120,89 @@ static int virgl_vtest_receive_fd(int socket_fd)
     return *((int *) CMSG_DATA(cmsgh));
 }
 
+static int virgl_vtest_send_fd(int socket_fd, int fd)
+{
+    struct cmsghdr *cmsgh;
+    struct msghdr msgh = { 0 };
+    char buf[CMSG_SPACE(sizeof(int))] = { 0 }, c = 0;
+    struct iovec iovec;
+
+    iovec.iov_base = &c;
+    iovec.iov_len = sizeof(char);
+
+    msgh.msg_iov = &iovec;
+    msgh.msg_iovlen = 1;
+    msgh.msg_control = buf;
+    msgh.msg_controllen = sizeof(buf);
+
+    cmsgh = CMSG_FIRSTHDR(&msgh);
+    cmsgh->cmsg_level = SOL_SOCKET;
+    cmsgh->cmsg_type = SCM_RIGHTS;
+    cmsgh->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsgh), &fd, sizeof(int));
+
+    if (sendmsg(socket_fd, &msgh, 0) < 0) {
+      fprintf(stderr, "Failed with %s\n", strerror(errno));
+      return -1;
+    }
+
+    return 0;
+}
+
+/* Copies a complete command into the shared ring, and rings the doorbell
+ * only if the server went idle.  Returns false if there is no room for the
+ * command, in which case it is sent on the socket: the server drains the
+ * ring before reading it, which keeps the ordering without waiting here.
+ */
+static bool virgl_vtest_ring_write(struct virgl_vtest_winsys *vws,
+                                   const struct iovec *iov, int iovcnt)
+{
+   struct virgl_vtest_ring *ring = &vws->ring;
+   uint32_t kick[VTEST_HDR_SIZE];
+   uint32_t size = 0;
+   int i;
+
+   for (i = 0; i < iovcnt; i++)
+      size += iov[i].iov_len;
+   if (size > ring->size ||
+       ring->tail - p_atomic_read(&ring->header->head) > ring->size - size)
+      return false;
+
+   for (i = 0; i < iovcnt; i++) {
+      uint32_t offset = ring->tail & (ring->size - 1);
+      uint32_t first = MIN2(iov[i].iov_len, ring->size - offset);
+
+      memcpy(ring->data + offset, iov[i].iov_base, first);
+      memcpy(ring->data, (uint8_t *)iov[i].iov_base + first,
+             iov[i].iov_len - first);
+      ring->tail += iov[i].iov_len;
+   }
+   p_atomic_set(&ring->header->tail, ring->tail);
+
+   /* full barrier: the idle check must not be reordered before the tail */
+   if (p_atomic_cmpxchg(&ring->header->status, VCMD_RING_STATUS_IDLE, 0) ==
+       VCMD_RING_STATUS_IDLE) {
+      kick[VTEST_CMD_LEN] = VCMD_RING_KICK_SIZE;
+      kick[VTEST_CMD_ID] = VCMD_RING_KICK;
+      virgl_block_write(vws->sock_fd, &kick, sizeof(kick));
+   }
+   return true;
+}
+
+/* Writes a command that has neither a reply nor an fd attached. */
+static int virgl_vtest_write_cmd(struct virgl_vtest_winsys *vws,
+                                 const struct iovec *iov, int iovcnt)
+{
+   int i;
+
+   if (vws->ring.map && virgl_vtest_ring_write(vws, iov, iovcnt))
+      return 0;
+
+   for (i = 0; i < iovcnt; i++)
+      virgl_block_write(vws->sock_fd, iov[i].iov_base, iov[i].iov_len);
+   return 0;
+}
+
 static int virgl_vtest_send_init(struct virgl_vtest_winsys *vws)
 {
    uint32_t buf[VTEST_HDR_SIZE];
@@ -194,6 +282,131 @@ static int virgl_vtest_negotiate_version(struct virgl_vtest_winsys *vws)
    return 0;
 }
 
+static int virgl_vtest_send_context_init(struct virgl_vtest_winsys *vws,
+                                         uint32_t capset_id)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_CONTEXT_INIT_SIZE];
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_CONTEXT_INIT_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_CONTEXT_INIT;
+   cmd[VCMD_CONTEXT_INIT_CAPSET_ID] = capset_id;
+
+   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+   return 0;
+}
+
+static uint32_t virgl_vtest_send_sync_create(struct virgl_vtest_winsys *vws,
+                                             uint64_t initial_val)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_SYNC_CREATE_SIZE];
+   uint32_t sync_id;
+   ASSERTED int ret;
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_SYNC_CREATE_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_SYNC_CREATE;
+   cmd[VCMD_SYNC_CREATE_VALUE_LO] = (uint32_t)initial_val;
+   cmd[VCMD_SYNC_CREATE_VALUE_HI] = (uint32_t)(initial_val >> 32);
+
+   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+
+   ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
+   assert(ret);
+   assert(vtest_hdr[VTEST_CMD_LEN] == 1 &&
+          vtest_hdr[VTEST_CMD_ID] == VCMD_SYNC_CREATE);
+   ret = virgl_block_read(vws->sock_fd, &sync_id, sizeof(sync_id));
+   assert(ret);
+   return sync_id;
+}
+
+static uint32_t virgl_vtest_send_get_param(struct virgl_vtest_winsys *vws,
+                                           uint32_t param)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_GET_PARAM_SIZE];
+   uint32_t resp[2];
+   ASSERTED int ret;
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_GET_PARAM_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_GET_PARAM;
+   cmd[VCMD_GET_PARAM_PARAM] = param;
+
+   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+
+   ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
+   assert(ret);
+   assert(vtest_hdr[VTEST_CMD_LEN] == 2 &&
+          vtest_hdr[VTEST_CMD_ID] == VCMD_GET_PARAM);
+   ret = virgl_block_read(vws->sock_fd, resp, sizeof(resp));
+   assert(ret);
+   return resp[0] ? resp[1] : 0;
+}
+
+/* Sets up the shared memory command ring if the server supports it and it
+ * wasn't disabled with VTEST_SHM_RING=false.  Command streams then no
+ * longer go through the socket, which only carries doorbells for an idle
+ * server, replies and fds.
+ */
+static void virgl_vtest_ring_init(struct virgl_vtest_winsys *vws)
+{
+   static const uint32_t max_ring_size = 4 * 1024 * 1024;
+   struct virgl_vtest_ring *ring = &vws->ring;
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_RING_INIT_SIZE];
+   uint32_t server_size, size;
+   void *map;
+   int fd;
+
+   server_size = virgl_vtest_send_get_param(vws, VCMD_PARAM_SHM_RING);
+   for (size = max_ring_size; size > server_size; size /= 2)
+      ;
+   if (size < 4096)
+      return;
+
+   fd = os_create_anonymous_file(VCMD_RING_DATA_OFFSET + size,
+                                 "virgl-vtest-ring");
+   if (fd < 0)
+      return;
+
+   map = os_mmap(NULL, VCMD_RING_DATA_OFFSET + size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+   if (map == MAP_FAILED) {
+      close(fd);
+      return;
+   }
+
+   ring->header = map;
+   ring->data = (uint8_t *)map + VCMD_RING_DATA_OFFSET;
+   ring->size = size;
+   ring->tail = 0;
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_RING_INIT_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_RING_INIT;
+   cmd[VCMD_RING_INIT_RING_SIZE] = size;
+   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+   if (virgl_vtest_send_fd(vws->sock_fd, fd) < 0) {
+      os_munmap(map, VCMD_RING_DATA_OFFSET + size);
+      close(fd);
+      return;
+   }
+   close(fd);
+
+   ring->map = map;
+   ring->map_size = VCMD_RING_DATA_OFFSET + size;
+}
+
+void virgl_vtest_ring_fini(struct virgl_vtest_winsys *vws)
+{
+   if (vws->ring.map)
+      os_munmap(vws->ring.map, vws->ring.map_size);
+   vws->ring.map = NULL;
+}
+
 int virgl_vtest_connect(struct virgl_vtest_winsys *vws)
 {
    struct sockaddr_un un;
@@ -224,6 +437,24 @@ int virgl_vtest_connect(struct virgl_vtest_winsys *vws)
    if (vws->protocol_version == 1)
       vws->protocol_version = 0;
 
+   if (vws->protocol_version >= 3) {
+      struct virgl_drm_caps caps;
+
+      virgl_vtest_send_context_init(vws, VIRGL_RENDERER_CAPSET_VIRGL2);
+      vws->timeline_id = virgl_vtest_send_sync_create(vws, 0);
+
+      /* Mappable HOST3D blobs need the host to map buffer storage, the
+       * same requirement the driver has for persistent coherent maps. */
+      memset(&caps, 0, sizeof(caps));
+      virgl_vtest_send_get_caps(vws, &caps);
+      vws->supports_blob =
+         (caps.caps.v2.capability_bits & VIRGL_CAP_ARB_BUFFER_STORAGE) &&
+         caps.caps.v2.host_feature_check_version >= 4;
+
+      if (debug_get_bool_option("VTEST_SHM_RING", true))
+         virgl_vtest_ring_init(vws);
+   }
+
    return 0;
 }
 
@@ -275,8 +506,24 @@ int virgl_vtest_send_get_caps(struct virgl_vtest_winsys *vws,
    return 0;
 }
 
+/* Since protocol v3 the server picks the resource id and sends it back. */
+static uint32_t virgl_vtest_recv_res_id(struct virgl_vtest_winsys *vws,
+                                        uint32_t vcmd)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t res_id;
+   ASSERTED int ret;
+
+   ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
+   assert(ret);
+   assert(vtest_hdr[VTEST_CMD_LEN] == 1 && vtest_hdr[VTEST_CMD_ID] == vcmd);
+   ret = virgl_block_read(vws->sock_fd, &res_id, sizeof(res_id));
+   assert(ret);
+   return res_id;
+}
+
 static int virgl_vtest_send_resource_create2(struct virgl_vtest_winsys *vws,
-                                             uint32_t handle,
+                                             uint32_t *handle,
                                              enum pipe_texture_target target,
                                              uint32_t format,
                                              uint32_t bind,
@@ -294,7 +541,8 @@ static int virgl_vtest_send_resource_create2(struct virgl_vtest_winsys *vws,
    vtest_hdr[VTEST_CMD_LEN] = VCMD_RES_CREATE2_SIZE;
    vtest_hdr[VTEST_CMD_ID] = VCMD_RESOURCE_CREATE2;
 
-   res_create_buf[VCMD_RES_CREATE2_RES_HANDLE] = handle;
+   res_create_buf[VCMD_RES_CREATE2_RES_HANDLE] =
+      vws->protocol_version >= 3 ? 0 : *handle;
    res_create_buf[VCMD_RES_CREATE2_TARGET] = target;
    res_create_buf[VCMD_RES_CREATE2_FORMAT] = format;
    res_create_buf[VCMD_RES_CREATE2_BIND] = bind;
@@ -309,6 +557,9 @@ static int virgl_vtest_send_resource_create2(struct virgl_vtest_winsys *vws,
    virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
    virgl_block_write(vws->sock_fd, &res_create_buf, sizeof(res_create_buf));
 
+   if (vws->protocol_version >= 3)
+      *handle = virgl_vtest_recv_res_id(vws, VCMD_RESOURCE_CREATE2);
+
    /* Multi-sampled textures have no backing store attached. */
    if (size == 0)
       return 0;
@@ -323,7 +574,7 @@ static int virgl_vtest_send_resource_create2(struct virgl_vtest_winsys *vws,
 }
 
 int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
-                                     uint32_t handle,
+                                     uint32_t *handle,
                                      enum pipe_texture_target target,
                                      uint32_t format,
                                      uint32_t bind,
@@ -347,7 +598,7 @@ int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
    vtest_hdr[VTEST_CMD_LEN] = VCMD_RES_CREATE_SIZE;
    vtest_hdr[VTEST_CMD_ID] = VCMD_RESOURCE_CREATE;
 
-   res_create_buf[VCMD_RES_CREATE_RES_HANDLE] = handle;
+   res_create_buf[VCMD_RES_CREATE_RES_HANDLE] = *handle;
    res_create_buf[VCMD_RES_CREATE_TARGET] = target;
    res_create_buf[VCMD_RES_CREATE_FORMAT] = format;
    res_create_buf[VCMD_RES_CREATE_BIND] = bind;
@@ -364,17 +615,99 @@ int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
    return 0;
 }
 
+/* Blob resources are created like on virtio-gpu: the pipe resource is
+ * described in the command stream and tagged with blob_id, then the blob
+ * is instantiated from it and its storage is exported back to us. */
+uint32_t virgl_vtest_send_resource_create_blob(struct virgl_vtest_winsys *vws,
+                                              const uint32_t *cmd,
+                                              uint32_t cmd_dwords,
+                                              uint32_t blob_id,
+                                              uint32_t size,
+                                              int *out_fd)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t blob_buf[VCMD_RES_CREATE_BLOB_SIZE];
+   uint32_t res_id;
+
+   vtest_hdr[VTEST_CMD_LEN] = cmd_dwords;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_SUBMIT_CMD;
+   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_block_write(vws->sock_fd, (void *)cmd, cmd_dwords * 4);
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_RES_CREATE_BLOB_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_RESOURCE_CREATE_BLOB;
+   blob_buf[VCMD_RES_CREATE_BLOB_TYPE] = VCMD_BLOB_TYPE_HOST3D;
+   blob_buf[VCMD_RES_CREATE_BLOB_FLAGS] = VCMD_BLOB_FLAG_MAPPABLE;
+   blob_buf[VCMD_RES_CREATE_BLOB_SIZE_LO] = size;
+   blob_buf[VCMD_RES_CREATE_BLOB_SIZE_HI] = 0;
+   blob_buf[VCMD_RES_CREATE_BLOB_ID_LO] = blob_id;
+   blob_buf[VCMD_RES_CREATE_BLOB_ID_HI] = 0;
+   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_block_write(vws->sock_fd, &blob_buf, sizeof(blob_buf));
+
+   res_id = virgl_vtest_recv_res_id(vws, VCMD_RESOURCE_CREATE_BLOB);
+
+   *out_fd = virgl_vtest_receive_fd(vws->sock_fd);
+   if (*out_fd < 0) {
+      fprintf(stderr, "failed to get blob fd\n");
+      if (res_id)
+         virgl_vtest_send_resource_unref(vws, res_id);
+      return 0;
+   }
+
+   return res_id;
+}
+
 int virgl_vtest_submit_cmd(struct virgl_vtest_winsys *vws,
                            struct virgl_vtest_cmd_buf *cbuf)
 {
    uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   struct iovec iov[] = {
+      { vtest_hdr, sizeof(vtest_hdr) },
+      { cbuf->buf, cbuf->base.cdw * 4 },
+   };
 
    vtest_hdr[VTEST_CMD_LEN] = cbuf->base.cdw;
    vtest_hdr[VTEST_CMD_ID] = VCMD_SUBMIT_CMD;
 
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, cbuf->buf, cbuf->base.cdw * 4);
-   return 0;
+   return virgl_vtest_write_cmd(vws, iov, ARRAY_SIZE(iov));
+}
+
+/* Submits the command buffer as a single batch on ring 0 that signals the
+ * winsys timeline to seqno once the host is done with it. */
+int virgl_vtest_submit_cmd2(struct virgl_vtest_winsys *vws,
+                            struct virgl_vtest_cmd_buf *cbuf,
+                            uint64_t seqno)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   const uint32_t header_dwords =
+      1 + sizeof(struct vcmd_submit_cmd2_batch) / 4;
+   const uint32_t batch_count = 1;
+   struct vcmd_submit_cmd2_batch batch = {
+      .flags = VCMD_SUBMIT_CMD2_FLAG_RING_IDX,
+      .cmd_offset = header_dwords,
+      .cmd_size = cbuf->base.cdw,
+      .sync_offset = header_dwords + cbuf->base.cdw,
+      .sync_count = 1,
+      .ring_idx = 0,
+   };
+   const uint32_t sync[3] = {
+      vws->timeline_id,
+      (uint32_t)seqno,
+      (uint32_t)(seqno >> 32),
+   };
+   struct iovec iov[] = {
+      { vtest_hdr, sizeof(vtest_hdr) },
+      { (void *)&batch_count, sizeof(batch_count) },
+      { &batch, sizeof(batch) },
+      { cbuf->buf, cbuf->base.cdw * 4 },
+      { (void *)sync, sizeof(sync) },
+   };
+
+   vtest_hdr[VTEST_CMD_LEN] = header_dwords + cbuf->base.cdw + ARRAY_SIZE(sync);
+   vtest_hdr[VTEST_CMD_ID] = VCMD_SUBMIT_CMD2;
+
+   return virgl_vtest_write_cmd(vws, iov, ARRAY_SIZE(iov));
 }
 
 int virgl_vtest_send_resource_unref(struct virgl_vtest_winsys *vws,
@@ -382,13 +715,15 @@ int virgl_vtest_send_resource_unref(struct virgl_vtest_winsys *vws,
 {
    uint32_t vtest_hdr[VTEST_HDR_SIZE];
    uint32_t cmd[1];
+   struct iovec iov[] = {
+      { vtest_hdr, sizeof(vtest_hdr) },
+      { cmd, sizeof(cmd) },
+   };
    vtest_hdr[VTEST_CMD_LEN] = 1;
    vtest_hdr[VTEST_CMD_ID] = VCMD_RESOURCE_UNREF;
 
    cmd[0] = handle;
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
-   return 0;
+   return virgl_vtest_write_cmd(vws, iov, ARRAY_SIZE(iov));
 }
 
 static int virgl_vtest_send_transfer_cmd(struct virgl_vtest_winsys *vws,
@@ -436,6 +771,10 @@ static int virgl_vtest_send_transfer_cmd2(struct virgl_vtest_winsys *vws,
 {
    uint32_t vtest_hdr[VTEST_HDR_SIZE];
    uint32_t cmd[VCMD_TRANSFER2_HDR_SIZE];
+   struct iovec iov[] = {
+      { vtest_hdr, sizeof(vtest_hdr) },
+      { cmd, sizeof(cmd) },
+   };
    vtest_hdr[VTEST_CMD_LEN] = VCMD_TRANSFER2_HDR_SIZE;
    vtest_hdr[VTEST_CMD_ID] = vcmd;
 
@@ -454,10 +793,8 @@ static int virgl_vtest_send_transfer_cmd2(struct virgl_vtest_winsys *vws,
    cmd[VCMD_TRANSFER2_DEPTH] = box->depth;
    cmd[VCMD_TRANSFER2_DATA_SIZE] = data_size;
    cmd[VCMD_TRANSFER2_OFFSET] = offset;
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
 
-   return 0;
+   return virgl_vtest_write_cmd(vws, iov, ARRAY_SIZE(iov));
 }
 
 int virgl_vtest_send_transfer_get(struct virgl_vtest_winsys *vws,
@@ -544,3 +881,51 @@ int virgl_vtest_busy_wait(struct virgl_vtest_winsys *vws, int handle,
    assert(ret);
    return result[0];
 }
+
+uint64_t virgl_vtest_sync_read(struct virgl_vtest_winsys *vws)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_SYNC_READ_SIZE];
+   uint64_t val;
+   ASSERTED int ret;
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_SYNC_READ_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_SYNC_READ;
+   cmd[VCMD_SYNC_READ_ID] = vws->timeline_id;
+
+   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+
+   ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
+   assert(ret);
+   assert(vtest_hdr[VTEST_CMD_LEN] == 2 &&
+          vtest_hdr[VTEST_CMD_ID] == VCMD_SYNC_READ);
+   ret = virgl_block_read(vws->sock_fd, &val, sizeof(val));
+   assert(ret);
+   return val;
+}
+
+/* Returns an fd that becomes readable once the timeline reaches seqno. */
+int virgl_vtest_sync_wait(struct virgl_vtest_winsys *vws, uint64_t seqno)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_SYNC_WAIT_SIZE(1)];
+   ASSERTED int ret;
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_SYNC_WAIT_SIZE(1);
+   vtest_hdr[VTEST_CMD_ID] = VCMD_SYNC_WAIT;
+   cmd[VCMD_SYNC_WAIT_FLAGS] = 0;
+   cmd[VCMD_SYNC_WAIT_TIMEOUT] = UINT32_MAX;
+   cmd[VCMD_SYNC_WAIT_ID(0)] = vws->timeline_id;
+   cmd[VCMD_SYNC_WAIT_VALUE_LO(0)] = (uint32_t)seqno;
+   cmd[VCMD_SYNC_WAIT_VALUE_HI(0)] = (uint32_t)(seqno >> 32);
+
+   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+
+   ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
+   assert(ret);
+   assert(vtest_hdr[VTEST_CMD_LEN] == 0 &&
+          vtest_hdr[VTEST_CMD_ID] == VCMD_SYNC_WAIT);
+   return virgl_vtest_receive_fd(vws->sock_fd);
+}
@@ -20,7 +20,11 @@
  * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
  * USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdio.h>
+#include <unistd.h>
 #include "util/macros.h"
 #include "util/u_surface.h"
 #include "util/u_memory.h"
@@ -29,6 +33,8 @@
 #include "util/os_time.h"
 #include "frontend/sw_winsys.h"
 #include "util/os_mman.h"
+#include "util/u_atomic.h"
+#include "virtio-gpu/virgl_protocol.h"
 
 #include "virgl_vtest_winsys.h"
 #include "virgl_vtest_public.h"
@@ -75,6 +81,67 @@ static uint32_t vtest_get_transfer_size(struct virgl_hw_res *res,
    return valid_layer_stride * box->depth;
 }
 
+static void virgl_vtest_update_signaled(struct virgl_vtest_winsys *vtws,
+                                        uint64_t val)
+{
+   uint64_t old = p_atomic_read(&vtws->timeline_signaled);
+
+   while (old < val) {
+      uint64_t cur = p_atomic_cmpxchg(&vtws->timeline_signaled, old, val);
+      if (cur == old)
+         break;
+      old = cur;
+   }
+}
+
+/* Any reply from the server also means that everything sent before the
+ * request has been processed, which is what socket transfers rely on. */
+static void virgl_vtest_refresh_signaled(struct virgl_vtest_winsys *vtws)
+{
+   virgl_vtest_update_signaled(vtws, virgl_vtest_sync_read(vtws));
+}
+
+/* With protocol v3 every submission signals the next point on a single
+ * timeline, so a point is known to be idle without a round trip as soon as
+ * any later point has been seen signalled.
+ */
+static bool virgl_vtest_seqno_is_busy(struct virgl_vtest_winsys *vtws,
+                                      uint64_t seqno)
+{
+   if (seqno <= p_atomic_read(&vtws->timeline_signaled))
+      return false;
+
+   virgl_vtest_refresh_signaled(vtws);
+   return seqno > p_atomic_read(&vtws->timeline_signaled);
+}
+
+static bool virgl_vtest_seqno_wait(struct virgl_vtest_winsys *vtws,
+                                   uint64_t seqno, int timeout_ms)
+{
+   struct pollfd pfd;
+   int fd, ret;
+
+   if (seqno <= p_atomic_read(&vtws->timeline_signaled))
+      return true;
+
+   fd = virgl_vtest_sync_wait(vtws, seqno);
+   if (fd < 0)
+      return false;
+
+   pfd.fd = fd;
+   pfd.events = POLLIN;
+   do {
+      ret = poll(&pfd, 1, timeout_ms);
+   } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+   close(fd);
+
+   if (ret <= 0)
+      return false;
+
+   virgl_vtest_update_signaled(vtws, seqno);
+   return true;
+}
+
 static int
 virgl_vtest_transfer_put(struct virgl_winsys *vws,
                          struct virgl_hw_res *res,
@@ -94,6 +161,9 @@ virgl_vtest_transfer_put(struct virgl_winsys *vws,
                                  level, stride, layer_stride,
                                  box, size, buf_offset);
 
+   if (vtws->protocol_version >= 3)
+      res->transfer_pending = true;
+
    if (vtws->protocol_version >= 2)
       return 0;
 
@@ -122,7 +192,11 @@ virgl_vtest_transfer_get_internal(struct virgl_winsys *vws,
                                  level, stride, layer_stride,
                                  box, size, buf_offset);
 
-   if (flush_front_buffer || vtws->protocol_version >= 2)
+   /* The server reads back synchronously, so v3 only needs the reply to
+    * any later request instead of waiting for the whole GPU to idle. */
+   if (vtws->protocol_version >= 3)
+      virgl_vtest_refresh_signaled(vtws);
+   else if (flush_front_buffer || vtws->protocol_version >= 2)
       virgl_vtest_busy_wait(vtws, res->res_handle, VCMD_BUSY_WAIT_FLAG_WAIT);
 
    if (vtws->protocol_version >= 2) {
@@ -193,6 +267,14 @@ static bool virgl_vtest_resource_is_busy(struct virgl_winsys *vws,
 {
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
 
+   if (vtws->protocol_version >= 3) {
+      if (res->transfer_pending) {
+         virgl_vtest_refresh_signaled(vtws);
+         res->transfer_pending = false;
+      }
+      return virgl_vtest_seqno_is_busy(vtws, res->seqno);
+   }
+
    /* implement busy check */
    int ret;
    ret = virgl_vtest_busy_wait(vtws, res->res_handle, 0);
@@ -239,6 +321,7 @@ virgl_vtest_winsys_resource_create(struct virgl_winsys *vws,
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
    struct virgl_hw_res *res;
    static int handle = 1;
+   uint32_t res_handle = handle;
    int fd = -1;
    struct virgl_resource_params params = { .size = size,
                                            .bind = bind,
@@ -274,14 +357,14 @@ virgl_vtest_winsys_resource_create(struct virgl_winsys *vws,
    res->height = height;
    res->width = width;
    res->size = size;
-   virgl_vtest_send_resource_create(vtws, handle, target, pipe_to_virgl_format(format), bind,
+   virgl_vtest_send_resource_create(vtws, &res_handle, target, pipe_to_virgl_format(format), bind,
                                     width, height, depth, array_size,
                                     last_level, nr_samples, size, &fd);
 
    if (vtws->protocol_version >= 2) {
       if (res->size == 0) {
          res->ptr = NULL;
-         res->res_handle = handle;
+         res->res_handle = res_handle;
          goto out;
       }
 
@@ -304,7 +387,7 @@ virgl_vtest_winsys_resource_create(struct virgl_winsys *vws,
       close(fd);
    }
 
-   res->res_handle = handle;
+   res->res_handle = res_handle;
    if (map_front_private && res->ptr && res->dt) {
       void *dt_map = vtws->sws->displaytarget_map(vtws->sws, res->dt, PIPE_MAP_READ_WRITE);
       uint32_t shm_stride = util_format_get_stride(res->format, res->width);
@@ -359,9 +442,100 @@ static void virgl_vtest_resource_wait(struct virgl_winsys *vws,
 {
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
 
+   if (vtws->protocol_version >= 3) {
+      if (res->transfer_pending) {
+         virgl_vtest_refresh_signaled(vtws);
+         res->transfer_pending = false;
+      }
+      virgl_vtest_seqno_wait(vtws, res->seqno, -1);
+      return;
+   }
+
    virgl_vtest_busy_wait(vtws, res->res_handle, VCMD_BUSY_WAIT_FLAG_WAIT);
 }
 
+static struct virgl_hw_res *
+virgl_vtest_winsys_resource_create_blob(struct virgl_winsys *vws,
+                                        enum pipe_texture_target target,
+                                        uint32_t format,
+                                        uint32_t bind,
+                                        uint32_t width,
+                                        uint32_t height,
+                                        uint32_t depth,
+                                        uint32_t array_size,
+                                        uint32_t last_level,
+                                        uint32_t nr_samples,
+                                        uint32_t flags,
+                                        uint32_t size)
+{
+   struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
+   uint32_t cmd[VIRGL_PIPE_RES_CREATE_SIZE + 1] = { 0 };
+   struct virgl_hw_res *res;
+   int32_t blob_id;
+   int fd = -1;
+   struct virgl_resource_params params = { .size = size,
+                                           .bind = bind,
+                                           .format = format,
+                                           .flags = flags,
+                                           .nr_samples = nr_samples,
+                                           .width = width,
+                                           .height = height,
+                                           .depth = depth,
+                                           .array_size = array_size,
+                                           .last_level = last_level,
+                                           .target = target };
+
+   res = CALLOC_STRUCT(virgl_hw_res);
+   if (!res)
+      return NULL;
+
+   /* Make sure blob is page aligned. */
+   width = ALIGN(width, getpagesize());
+   size = ALIGN(size, getpagesize());
+
+   blob_id = p_atomic_inc_return(&vtws->blob_id);
+   cmd[0] = VIRGL_CMD0(VIRGL_CCMD_PIPE_RESOURCE_CREATE, 0, VIRGL_PIPE_RES_CREATE_SIZE);
+   cmd[VIRGL_PIPE_RES_CREATE_FORMAT] = pipe_to_virgl_format(format);
+   cmd[VIRGL_PIPE_RES_CREATE_BIND] = bind;
+   cmd[VIRGL_PIPE_RES_CREATE_TARGET] = target;
+   cmd[VIRGL_PIPE_RES_CREATE_WIDTH] = width;
+   cmd[VIRGL_PIPE_RES_CREATE_HEIGHT] = height;
+   cmd[VIRGL_PIPE_RES_CREATE_DEPTH] = depth;
+   cmd[VIRGL_PIPE_RES_CREATE_ARRAY_SIZE] = array_size;
+   cmd[VIRGL_PIPE_RES_CREATE_LAST_LEVEL] = last_level;
+   cmd[VIRGL_PIPE_RES_CREATE_NR_SAMPLES] = nr_samples;
+   cmd[VIRGL_PIPE_RES_CREATE_FLAGS] = flags;
+   cmd[VIRGL_PIPE_RES_CREATE_BLOB_ID] = blob_id;
+
+   res->res_handle = virgl_vtest_send_resource_create_blob(vtws, cmd,
+                                                           ARRAY_SIZE(cmd),
+                                                           blob_id, size, &fd);
+   if (!res->res_handle) {
+      FREE(res);
+      return NULL;
+   }
+
+   res->ptr = os_mmap(NULL, size, PROT_WRITE | PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (res->ptr == MAP_FAILED) {
+      fprintf(stderr, "Client failed to map blob resource\n");
+      virgl_vtest_send_resource_unref(vtws, res->res_handle);
+      FREE(res);
+      return NULL;
+   }
+
+   res->bind = bind;
+   res->flags = flags;
+   res->format = format;
+   res->height = height;
+   res->width = width;
+   res->size = size;
+   virgl_resource_cache_entry_init(&res->cache_entry, params);
+   pipe_reference_init(&res->reference, 1);
+   p_atomic_set(&res->num_cs_references, 0);
+   return res;
+}
+
 static struct virgl_hw_res *
 virgl_vtest_winsys_resource_cache_create(struct virgl_winsys *vws,
                                          enum pipe_texture_target target,
@@ -383,7 +557,7 @@ virgl_vtest_winsys_resource_cache_create(struct virgl_winsys *vws,
    struct virgl_resource_params params = { .size = size,
                                            .bind = bind,
                                            .format = format,
-                                           .flags = 0,
+                                           .flags = flags,
                                            .nr_samples = nr_samples,
                                            .width = width,
                                            .height = height,
@@ -408,6 +582,18 @@ virgl_vtest_winsys_resource_cache_create(struct virgl_winsys *vws,
    mtx_unlock(&vtws->mutex);
 
 alloc:
+   if (vtws->supports_blob &&
+       (flags & (VIRGL_RESOURCE_FLAG_MAP_PERSISTENT |
+                 VIRGL_RESOURCE_FLAG_MAP_COHERENT))) {
+      res = virgl_vtest_winsys_resource_create_blob(vws, target, format, bind,
+                                                    width, height, depth,
+                                                    array_size, last_level,
+                                                    nr_samples, flags, size);
+      if (res)
+         return res;
+      /* fall back to a shared memory backed resource */
+   }
+
    res = virgl_vtest_winsys_resource_create(vws, target, map_front_private,
                                             format, bind, width, height, depth,
                                             array_size, last_level, nr_samples,
@@ -518,8 +704,19 @@ static void virgl_vtest_cmd_buf_destroy(struct virgl_cmd_buf *_cbuf)
 static struct pipe_fence_handle *
 virgl_vtest_fence_create(struct virgl_winsys *vws)
 {
+   struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
    struct virgl_hw_res *res;
 
+   if (vtws->protocol_version >= 3) {
+      struct virgl_vtest_fence *fence = CALLOC_STRUCT(virgl_vtest_fence);
+      if (!fence)
+         return NULL;
+
+      pipe_reference_init(&fence->reference, 1);
+      fence->seqno = p_atomic_read(&vtws->timeline_seqno);
+      return (struct pipe_fence_handle *)fence;
+   }
+
    /* Resources for fences should not be from the cache, since we are basing
     * the fence status on the resource creation busy status.
     */
@@ -544,7 +741,16 @@ static int virgl_vtest_winsys_submit_cmd(struct virgl_winsys *vws,
    if (cbuf->base.cdw == 0)
       return 0;
 
-   ret = virgl_vtest_submit_cmd(vtws, cbuf);
+   if (vtws->protocol_version >= 3) {
+      uint64_t seqno = p_atomic_inc_return(&vtws->timeline_seqno);
+
+      ret = virgl_vtest_submit_cmd2(vtws, cbuf, seqno);
+      for (unsigned i = 0; i < cbuf->cres; i++)
+         cbuf->res_bo[i]->seqno = seqno;
+   } else {
+      ret = virgl_vtest_submit_cmd(vtws, cbuf);
+   }
+
    if (fence && ret == 0)
       *fence = virgl_vtest_fence_create(vws);
 
@@ -602,8 +808,21 @@ static bool virgl_fence_wait(struct virgl_winsys *vws,
                              struct pipe_fence_handle *fence,
                              uint64_t timeout)
 {
+   struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
    struct virgl_hw_res *res = virgl_hw_res(fence);
 
+   if (vtws->protocol_version >= 3) {
+      uint64_t seqno = virgl_vtest_fence(fence)->seqno;
+
+      if (timeout == 0)
+         return !virgl_vtest_seqno_is_busy(vtws, seqno);
+      if (timeout == OS_TIMEOUT_INFINITE)
+         return virgl_vtest_seqno_wait(vtws, seqno, -1);
+      return virgl_vtest_seqno_wait(vtws, seqno,
+                                    MIN2(DIV_ROUND_UP(timeout, 1000000),
+                                         INT_MAX));
+   }
+
    if (timeout == 0)
       return !virgl_vtest_resource_is_busy(vws, res);
 
@@ -626,6 +845,16 @@ static void virgl_fence_reference(struct virgl_winsys *vws,
                                   struct pipe_fence_handle *src)
 {
    struct virgl_vtest_winsys *vdws = virgl_vtest_winsys(vws);
+
+   if (vdws->protocol_version >= 3) {
+      struct virgl_vtest_fence *old = virgl_vtest_fence(*dst);
+
+      if (pipe_reference(&old->reference, &virgl_vtest_fence(src)->reference))
+         FREE(old);
+      *dst = src;
+      return;
+   }
+
    virgl_vtest_resource_reference(&vdws->base, (struct virgl_hw_res **)dst,
                                   virgl_hw_res(src));
 }
@@ -670,6 +899,7 @@ virgl_vtest_winsys_destroy(struct virgl_winsys *vws)
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
 
    virgl_resource_cache_flush(&vtws->cache);
+   virgl_vtest_ring_fini(vtws);
 
    mtx_destroy(&vtws->mutex);
    FREE(vtws);
@@ -737,6 +967,7 @@ virgl_vtest_winsys_wrap(struct sw_winsys *sws)
    vtws->base.fence_reference = virgl_fence_reference;
    vtws->base.supports_fences =  0;
    vtws->base.supports_encoded_transfers = (vtws->protocol_version >= 2);
+   vtws->base.supports_coherent = vtws->supports_blob;
 
    vtws->base.flush_frontbuffer = virgl_vtest_flush_frontbuffer;
 
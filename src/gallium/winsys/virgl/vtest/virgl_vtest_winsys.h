@@ -31,6 +31,11 @@
 #include "util/u_thread.h"
 
 #include "virgl/virgl_winsys.h"
+
+/* Protocol v3 (sync objects, blob resources, SUBMIT_CMD2) is still marked
+ * unstable in virglrenderer, like for venus. */
+#define VIRGL_RENDERER_UNSTABLE_APIS
+#include "virtio-gpu/virglrenderer_hw.h"
 #include "vtest/vtest_protocol.h"
 #include "virgl_resource_cache.h"
 
@@ -38,6 +43,16 @@ struct pipe_fence_handle;
 struct sw_winsys;
 struct sw_displaytarget;
 
+/* optional shared memory command ring, see struct vcmd_ring_header */
+struct virgl_vtest_ring {
+   void *map;                        /* NULL when the ring is not in use */
+   size_t map_size;
+   struct vcmd_ring_header *header;
+   uint8_t *data;
+   uint32_t size;
+   uint32_t tail;
+};
+
 struct virgl_vtest_winsys {
    struct virgl_winsys base;
 
@@ -50,6 +65,15 @@ struct virgl_vtest_winsys {
    mtx_t mutex;
 
    unsigned protocol_version;
+
+   /* protocol v3: one timeline sync signalled by every submission */
+   uint32_t timeline_id;
+   uint64_t timeline_seqno;    /* last submitted value */
+   uint64_t timeline_signaled; /* last value seen signalled by the server */
+   int32_t blob_id;
+   bool supports_blob; /* host can back mappable HOST3D blobs, probed at connect */
+
+   struct virgl_vtest_ring ring;
 };
 
 struct virgl_hw_res {
@@ -69,7 +93,19 @@ struct virgl_hw_res {
    void *mapped;
 
    uint32_t bind;
+   uint32_t flags;
    struct virgl_resource_cache_entry cache_entry;
+
+   /* protocol v3: timeline value of the last submission using this resource */
+   uint64_t seqno;
+   /* a transfer was sent on the socket but may not be processed yet */
+   bool transfer_pending;
+};
+
+/* protocol v3 fences are timeline points, not dummy resources */
+struct virgl_vtest_fence {
+   struct pipe_reference reference;
+   uint64_t seqno;
 };
 
 struct virgl_vtest_cmd_buf {
@@ -90,6 +126,12 @@ virgl_hw_res(struct pipe_fence_handle *f)
    return (struct virgl_hw_res *)f;
 }
 
+static inline struct virgl_vtest_fence *
+virgl_vtest_fence(struct pipe_fence_handle *f)
+{
+   return (struct virgl_vtest_fence *)f;
+}
+
 static inline struct virgl_vtest_winsys *
 virgl_vtest_winsys(struct virgl_winsys *iws)
 {
@@ -104,11 +146,12 @@ virgl_vtest_cmd_buf(struct virgl_cmd_buf *cbuf)
 
 
 int virgl_vtest_connect(struct virgl_vtest_winsys *vws);
+void virgl_vtest_ring_fini(struct virgl_vtest_winsys *vws);
 int virgl_vtest_send_get_caps(struct virgl_vtest_winsys *vws,
                               struct virgl_drm_caps *caps);
 
 int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
-                                     uint32_t handle,
+                                     uint32_t *handle,
                                      enum pipe_texture_target target,
                                      uint32_t format,
                                      uint32_t bind,
@@ -121,10 +164,20 @@ int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
                                      uint32_t size,
                                      int *out_fd);
 
+uint32_t virgl_vtest_send_resource_create_blob(struct virgl_vtest_winsys *vws,
+                                              const uint32_t *cmd,
+                                              uint32_t cmd_dwords,
+                                              uint32_t blob_id,
+                                              uint32_t size,
+                                              int *out_fd);
+
 int virgl_vtest_send_resource_unref(struct virgl_vtest_winsys *vws,
                                     uint32_t handle);
 int virgl_vtest_submit_cmd(struct virgl_vtest_winsys *vtws,
                            struct virgl_vtest_cmd_buf *cbuf);
+int virgl_vtest_submit_cmd2(struct virgl_vtest_winsys *vws,
+                            struct virgl_vtest_cmd_buf *cbuf,
+                            uint64_t seqno);
 
 int virgl_vtest_send_transfer_get(struct virgl_vtest_winsys *vws,
                                   uint32_t handle,
@@ -154,4 +207,7 @@ int virgl_vtest_recv_transfer_get_data(struct virgl_vtest_winsys *vws,
 
 int virgl_vtest_busy_wait(struct virgl_vtest_winsys *vws, int handle,
                           int flags);
+
+uint64_t virgl_vtest_sync_read(struct virgl_vtest_winsys *vws);
+int virgl_vtest_sync_wait(struct virgl_vtest_winsys *vws, uint64_t seqno);
 #endif
@@ -89,7 +89,8 @@ disk_cache_init_queue(struct disk_cache *cache)
    return util_queue_init(&cache->cache_queue, "disk$", 32, 4,
                           UTIL_QUEUE_INIT_RESIZE_IF_FULL |
                           UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY |
-                          UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY, NULL);
+                          UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY |
+                          UTIL_QUEUE_INIT_BACKGROUND_THREADS, NULL);
 }
 
 static struct disk_cache *
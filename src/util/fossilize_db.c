@@ -489,40 +489,51 @@ foz_dbs_list_updater_init(struct foz_db *foz_db, char *list_filename)
 }
 #endif
 
-/* Here we open mesa cache foz dbs files. If the files exist we load the index
- * db into a hash table. The index db contains the offsets needed to later
- * read cache entries from the foz db containing the actual cache entries.
- */
-bool
-foz_prepare(struct foz_db *foz_db, char *cache_path)
+static void
+foz_init(struct foz_db *foz_db, char *cache_path)
 {
-   char *filename = NULL;
-   char *idx_filename = NULL;
-
    simple_mtx_init(&foz_db->mtx, mtx_plain);
    simple_mtx_init(&foz_db->flock_mtx, mtx_plain);
    foz_db->mem_ctx = ralloc_context(NULL);
    foz_db->index_db = _mesa_hash_table_u64_create(NULL);
    foz_db->cache_path = cache_path;
+}
 
-   /* Open the default foz dbs for read/write. If the files didn't already exist
-    * create them.
-    */
-   if (debug_get_bool_option("MESA_DISK_CACHE_SINGLE_FILE", false)) {
-      if (!create_foz_db_filenames(cache_path, "foz_cache",
-                                   &filename, &idx_filename))
-         goto fail;
+/* Open the default foz dbs for read/write. If the files didn't already exist
+ * create them.
+ */
+static bool
+open_foz_db_rw(struct foz_db *foz_db, char *cache_path, char *name)
+{
+   char *filename = NULL;
+   char *idx_filename = NULL;
 
-      foz_db->file[0] = fopen(filename, "a+b");
-      foz_db->db_idx = fopen(idx_filename, "a+b");
+   if (!create_foz_db_filenames(cache_path, name, &filename, &idx_filename))
+      return false;
 
-      free(filename);
-      free(idx_filename);
+   foz_db->file[0] = fopen(filename, "a+b");
+   foz_db->db_idx = fopen(idx_filename, "a+b");
 
-      if (!check_files_opened_successfully(foz_db->file[0], foz_db->db_idx))
-         goto fail;
+   free(filename);
+   free(idx_filename);
 
-      if (!load_foz_dbs(foz_db, foz_db->db_idx, 0, false))
+   if (!check_files_opened_successfully(foz_db->file[0], foz_db->db_idx))
+      return false;
+
+   return load_foz_dbs(foz_db, foz_db->db_idx, 0, false);
+}
+
+/* Here we open mesa cache foz dbs files. If the files exist we load the index
+ * db into a hash table. The index db contains the offsets needed to later
+ * read cache entries from the foz db containing the actual cache entries.
+ */
+bool
+foz_prepare(struct foz_db *foz_db, char *cache_path)
+{
+   foz_init(foz_db, cache_path);
+
+   if (debug_get_bool_option("MESA_DISK_CACHE_SINGLE_FILE", false)) {
+      if (!open_foz_db_rw(foz_db, cache_path, "foz_cache"))
          goto fail;
    }
 
@@ -545,6 +556,23 @@ fail:
    return false;
 }
 
+/* Open a single private read/write foz db named "name" inside cache_path,
+ * independent of the MESA_DISK_CACHE_* environment. This is meant for small
+ * driver-side databases that live next to the shader cache.
+ */
+bool
+foz_prepare_single(struct foz_db *foz_db, char *cache_path, const char *name)
+{
+   foz_init(foz_db, cache_path);
+
+   if (!open_foz_db_rw(foz_db, cache_path, (char *)name)) {
+      foz_destroy(foz_db);
+      return false;
+   }
+
+   return true;
+}
+
 void
 foz_destroy(struct foz_db *foz_db)
 {
@@ -764,6 +792,12 @@ foz_prepare(struct foz_db *foz_db, char *filename)
    return false;
 }
 
+bool
+foz_prepare_single(struct foz_db *foz_db, char *cache_path, const char *name)
+{
+   return false;
+}
+
 void
 foz_destroy(struct foz_db *foz_db)
 {
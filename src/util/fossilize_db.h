@@ -98,6 +98,9 @@ struct foz_db {
 bool
 foz_prepare(struct foz_db *foz_db, char *cache_path);
 
+bool
+foz_prepare_single(struct foz_db *foz_db, char *cache_path, const char *name);
+
 void
 foz_destroy(struct foz_db *foz_db);
 
@@ -0,0 +1,99 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _HASH_GROUP_H
+#define _HASH_GROUP_H
+
+#include <stdint.h>
+
+#include "util/detect_arch.h"
+
+#if DETECT_ARCH_SSE
+#include <emmintrin.h>
+#elif DETECT_ARCH_AARCH64
+#include <arm_neon.h>
+#endif
+
+/*
+ * Control bytes for the group-probed mode of hash_table and set.
+ *
+ * Every slot of the table has a control byte, and the slots are split into
+ * aligned groups of HASH_GROUP_SIZE. A lookup compares the 7-bit tag of the
+ * hash against a whole group of control bytes at once, and only touches the
+ * entries whose tag matches. A group with an empty slot ends the probe
+ * sequence, because an insert would have used that slot.
+ */
+
+#define HASH_GROUP_SIZE    16
+#define HASH_GROUP_EMPTY   0x80
+#define HASH_GROUP_DELETED 0xfe
+
+/* Index of the first group to probe, num_groups must be a power of two. */
+static inline uint32_t
+hash_group_index(uint32_t hash, uint32_t num_groups)
+{
+   return (uint32_t)(((uint64_t)(hash * 0x9e3779b1u) * num_groups) >> 32);
+}
+
+/* Tag stored in the control byte of a present entry. */
+static inline uint8_t
+hash_group_tag(uint32_t hash)
+{
+   return (hash * 0x85ebca6bu) >> 25;
+}
+
+/* Returns a mask of the slots of the group whose control byte is "value". */
+static inline unsigned
+hash_group_match(const uint8_t *ctrl, uint8_t value)
+{
+#if DETECT_ARCH_SSE
+   __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+#elif DETECT_ARCH_AARCH64
+   static const uint8_t bits[16] = {
+      1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+   };
+   uint8x16_t eq = vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(value));
+   uint8x16_t m = vandq_u8(eq, vld1q_u8(bits));
+   return vaddv_u8(vget_low_u8(m)) | (vaddv_u8(vget_high_u8(m)) << 8);
+#else
+   unsigned mask = 0;
+   for (unsigned i = 0; i < HASH_GROUP_SIZE; i++)
+      mask |= (unsigned)(ctrl[i] == value) << i;
+   return mask;
+#endif
+}
+
+/* Returns a mask of the empty and deleted slots of the group. */
+static inline unsigned
+hash_group_match_available(const uint8_t *ctrl)
+{
+#if DETECT_ARCH_SSE
+   return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+   return hash_group_match(ctrl, HASH_GROUP_EMPTY) |
+          hash_group_match(ctrl, HASH_GROUP_DELETED);
+#endif
+}
+
+#endif /* _HASH_GROUP_H */
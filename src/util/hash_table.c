@@ -45,6 +45,8 @@
 #include <assert.h>
 
 #include "hash_table.h"
+#include "hash_group.h"
+#include "bitscan.h"
 #include "ralloc.h"
 #include "macros.h"
 #include "u_memory.h"
@@ -145,6 +147,196 @@ entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
    return entry->key != NULL && entry->key != ht->deleted_key;
 }
 
+/**
+ * Group-probed mode (HASH_TABLE_GROUP_PROBE), see hash_group.h.
+ *
+ * The size is a power-of-two number of groups, and up to 7/8 of the slots
+ * are used. Entries use the same key markers as the regular mode, so
+ * iteration and the u64 wrapper don't need to know about the control bytes.
+ */
+
+static bool
+hash_table_group_alloc(struct hash_table *ht, void *mem_ctx, uint32_t size)
+{
+   struct hash_entry *table = rzalloc_array(mem_ctx, struct hash_entry, size);
+   if (table == NULL)
+      return false;
+
+   uint8_t *ctrl = ralloc_array(table, uint8_t, size);
+   if (ctrl == NULL) {
+      ralloc_free(table);
+      return false;
+   }
+   memset(ctrl, HASH_GROUP_EMPTY, size);
+
+   ht->table = table;
+   ht->ctrl = ctrl;
+   ht->size = size;
+   ht->max_entries = size - size / 8;
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+   return true;
+}
+
+static struct hash_entry *
+hash_table_group_search(struct hash_table *ht, uint32_t hash, const void *key)
+{
+   uint32_t num_groups = ht->size / HASH_GROUP_SIZE;
+   uint32_t group = hash_group_index(hash, num_groups);
+   uint8_t tag = hash_group_tag(hash);
+
+   for (uint32_t i = 1; i <= num_groups; i++) {
+      const uint8_t *ctrl = ht->ctrl + group * HASH_GROUP_SIZE;
+      unsigned match = hash_group_match(ctrl, tag);
+
+      while (match) {
+         struct hash_entry *entry =
+            ht->table + group * HASH_GROUP_SIZE + u_bit_scan(&match);
+
+         if (entry->hash == hash && entry_is_present(ht, entry) &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      if (hash_group_match(ctrl, HASH_GROUP_EMPTY))
+         return NULL;
+
+      group = (group + i) & (num_groups - 1);
+   }
+
+   return NULL;
+}
+
+static void
+hash_table_group_insert_rehash(struct hash_table *ht, uint32_t hash,
+                               const void *key, void *data)
+{
+   uint32_t num_groups = ht->size / HASH_GROUP_SIZE;
+   uint32_t group = hash_group_index(hash, num_groups);
+
+   for (uint32_t i = 1;; i++) {
+      unsigned empty = hash_group_match(ht->ctrl + group * HASH_GROUP_SIZE,
+                                        HASH_GROUP_EMPTY);
+      if (likely(empty)) {
+         uint32_t slot = group * HASH_GROUP_SIZE + u_bit_scan(&empty);
+         struct hash_entry *entry = ht->table + slot;
+
+         ht->ctrl[slot] = hash_group_tag(hash);
+         entry->hash = hash;
+         entry->key = key;
+         entry->data = data;
+         ht->entries++;
+         return;
+      }
+
+      group = (group + i) & (num_groups - 1);
+   }
+}
+
+static void
+hash_table_group_rehash(struct hash_table *ht, uint32_t new_size)
+{
+   struct hash_table old_ht = *ht;
+
+   /* The size would overflow. */
+   if (new_size < ht->size)
+      return;
+
+   if (!hash_table_group_alloc(ht, ralloc_parent(ht->table), new_size))
+      return;
+
+   hash_table_foreach(&old_ht, entry) {
+      hash_table_group_insert_rehash(ht, entry->hash, entry->key, entry->data);
+   }
+
+   ralloc_free(old_ht.table);
+}
+
+static struct hash_entry *
+hash_table_group_get_entry(struct hash_table *ht, uint32_t hash,
+                           const void *key, bool can_rehash)
+{
+   if (ht->entries >= ht->max_entries) {
+      hash_table_group_rehash(ht, ht->size * 2);
+   } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
+      hash_table_group_rehash(ht, ht->size);
+   }
+
+   uint32_t num_groups = ht->size / HASH_GROUP_SIZE;
+   uint32_t group = hash_group_index(hash, num_groups);
+   uint8_t tag = hash_group_tag(hash);
+   uint32_t available = UINT32_MAX;
+
+   for (uint32_t i = 1; i <= num_groups; i++) {
+      const uint8_t *ctrl = ht->ctrl + group * HASH_GROUP_SIZE;
+      unsigned match = hash_group_match(ctrl, tag);
+
+      /* Replace the entry with a matching key, see hash_table_get_entry. */
+      while (match) {
+         struct hash_entry *entry =
+            ht->table + group * HASH_GROUP_SIZE + u_bit_scan(&match);
+
+         if (entry->hash == hash && entry_is_present(ht, entry) &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      /* Stash the first available slot we find */
+      if (available == UINT32_MAX) {
+         unsigned free_slots = hash_group_match_available(ctrl);
+         if (free_slots)
+            available = group * HASH_GROUP_SIZE + u_bit_scan(&free_slots);
+      }
+
+      if (hash_group_match(ctrl, HASH_GROUP_EMPTY))
+         break;
+
+      group = (group + i) & (num_groups - 1);
+   }
+
+   if (available == UINT32_MAX) {
+      /* hash_table_foreach_remove clears entries without updating the
+       * control bytes, so the table can look full. Rebuild them and try
+       * again. We could also hit here if a required resize failed.
+       */
+      if (!can_rehash)
+         return NULL;
+      hash_table_group_rehash(ht, ht->size);
+      return hash_table_group_get_entry(ht, hash, key, false);
+   }
+
+   if (ht->ctrl[available] == HASH_GROUP_DELETED)
+      ht->deleted_entries--;
+   ht->ctrl[available] = tag;
+   ht->table[available].hash = hash;
+   ht->entries++;
+   return ht->table + available;
+}
+
+bool
+_mesa_hash_table_init_with_flags(struct hash_table *ht,
+                                 void *mem_ctx,
+                                 uint32_t (*key_hash_function)(const void *key),
+                                 bool (*key_equals_function)(const void *a,
+                                                             const void *b),
+                                 unsigned flags)
+{
+   if (flags & HASH_TABLE_GROUP_PROBE) {
+      ht->size_index = 0;
+      ht->rehash = 0;
+      ht->size_magic = 0;
+      ht->rehash_magic = 0;
+      ht->key_hash_function = key_hash_function;
+      ht->key_equals_function = key_equals_function;
+      ht->deleted_key = &deleted_key_value;
+
+      return hash_table_group_alloc(ht, mem_ctx, HASH_GROUP_SIZE);
+   }
+
+   return _mesa_hash_table_init(ht, mem_ctx, key_hash_function,
+                                key_equals_function);
+}
+
 bool
 _mesa_hash_table_init(struct hash_table *ht,
                       void *mem_ctx,
@@ -152,6 +344,7 @@ _mesa_hash_table_init(struct hash_table *ht,
                       bool (*key_equals_function)(const void *a,
                                                   const void *b))
 {
+   ht->ctrl = NULL;
    ht->size_index = 0;
    ht->size = hash_sizes[ht->size_index].size;
    ht->rehash = hash_sizes[ht->size_index].rehash;
@@ -169,10 +362,11 @@ _mesa_hash_table_init(struct hash_table *ht,
 }
 
 struct hash_table *
-_mesa_hash_table_create(void *mem_ctx,
-                        uint32_t (*key_hash_function)(const void *key),
-                        bool (*key_equals_function)(const void *a,
-                                                    const void *b))
+_mesa_hash_table_create_with_flags(void *mem_ctx,
+                                   uint32_t (*key_hash_function)(const void *key),
+                                   bool (*key_equals_function)(const void *a,
+                                                               const void *b),
+                                   unsigned flags)
 {
    struct hash_table *ht;
 
@@ -183,7 +377,8 @@ _mesa_hash_table_create(void *mem_ctx,
    if (ht == NULL)
       return NULL;
 
-   if (!_mesa_hash_table_init(ht, ht, key_hash_function, key_equals_function)) {
+   if (!_mesa_hash_table_init_with_flags(ht, ht, key_hash_function,
+                                         key_equals_function, flags)) {
       ralloc_free(ht);
       return NULL;
    }
@@ -191,6 +386,16 @@ _mesa_hash_table_create(void *mem_ctx,
    return ht;
 }
 
+struct hash_table *
+_mesa_hash_table_create(void *mem_ctx,
+                        uint32_t (*key_hash_function)(const void *key),
+                        bool (*key_equals_function)(const void *a,
+                                                    const void *b))
+{
+   return _mesa_hash_table_create_with_flags(mem_ctx, key_hash_function,
+                                             key_equals_function, 0);
+}
+
 static uint32_t
 key_u32_hash(const void *key)
 {
@@ -230,6 +435,16 @@ _mesa_hash_table_clone(struct hash_table *src, void *dst_mem_ctx)
 
    memcpy(ht->table, src->table, ht->size * sizeof(struct hash_entry));
 
+   if (src->ctrl) {
+      ht->ctrl = ralloc_array(ht->table, uint8_t, ht->size);
+      if (ht->ctrl == NULL) {
+         ralloc_free(ht);
+         return NULL;
+      }
+
+      memcpy(ht->ctrl, src->ctrl, ht->size);
+   }
+
    return ht;
 }
 
@@ -257,7 +472,9 @@ _mesa_hash_table_destroy(struct hash_table *ht,
 static void
 hash_table_clear_fast(struct hash_table *ht)
 {
-   memset(ht->table, 0, sizeof(struct hash_entry) * hash_sizes[ht->size_index].size);
+   memset(ht->table, 0, sizeof(struct hash_entry) * ht->size);
+   if (ht->ctrl)
+      memset(ht->ctrl, HASH_GROUP_EMPTY, ht->size);
    ht->entries = ht->deleted_entries = 0;
 }
 
@@ -283,6 +500,8 @@ _mesa_hash_table_clear(struct hash_table *ht,
 
          entry->key = NULL;
       }
+      if (ht->ctrl)
+         memset(ht->ctrl, HASH_GROUP_EMPTY, ht->size);
       ht->entries = 0;
       ht->deleted_entries = 0;
    } else
@@ -310,6 +529,9 @@ hash_table_search(struct hash_table *ht, uint32_t hash, const void *key)
 {
    assert(!key_pointer_is_reserved(ht, key));
 
+   if (ht->ctrl)
+      return hash_table_group_search(ht, hash, key);
+
    uint32_t size = ht->size;
    uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
    uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
@@ -433,6 +655,9 @@ hash_table_get_entry(struct hash_table *ht, uint32_t hash, const void *key)
 
    assert(!key_pointer_is_reserved(ht, key));
 
+   if (ht->ctrl)
+      return hash_table_group_get_entry(ht, hash, key, true);
+
    if (ht->entries >= ht->max_entries) {
       _mesa_hash_table_rehash(ht, ht->size_index + 1);
    } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
@@ -538,6 +763,22 @@ _mesa_hash_table_remove(struct hash_table *ht,
    if (!entry)
       return;
 
+   if (ht->ctrl) {
+      uint32_t slot = entry - ht->table;
+
+      /* Probes stop at groups that have an empty slot, so the slot can be
+       * freed without leaving a tombstone behind.
+       */
+      if (hash_group_match(ht->ctrl + (slot & ~(HASH_GROUP_SIZE - 1)),
+                           HASH_GROUP_EMPTY)) {
+         ht->ctrl[slot] = HASH_GROUP_EMPTY;
+         entry->key = NULL;
+         ht->entries--;
+         return;
+      }
+      ht->ctrl[slot] = HASH_GROUP_DELETED;
+   }
+
    entry->key = ht->deleted_key;
    ht->entries--;
    ht->deleted_entries++;
@@ -741,6 +982,13 @@ _mesa_hash_table_reserve(struct hash_table *ht, unsigned size)
 {
    if (size < ht->max_entries)
       return true;
+   if (ht->ctrl) {
+      uint32_t new_size = ht->size;
+      while (new_size - new_size / 8 < size && new_size < (1u << 31))
+         new_size *= 2;
+      hash_table_group_rehash(ht, new_size);
+      return ht->max_entries >= size;
+   }
    for (unsigned i = ht->size_index + 1; i < ARRAY_SIZE(hash_sizes); i++) {
       if (hash_sizes[i].max_entries >= size) {
          _mesa_hash_table_rehash(ht, i);
@@ -45,6 +45,7 @@ struct hash_entry {
 
 struct hash_table {
    struct hash_entry *table;
+   uint8_t *ctrl; /* control bytes, only with HASH_TABLE_GROUP_PROBE */
    uint32_t (*key_hash_function)(const void *key);
    bool (*key_equals_function)(const void *a, const void *b);
    const void *deleted_key;
@@ -58,12 +59,25 @@ struct hash_table {
    uint32_t deleted_entries;
 };
 
+/* Probe 16 slots at a time using a byte of metadata per slot, instead of
+ * loading the entries one by one. Lookups touch fewer cache lines, at the
+ * cost of a bigger minimum table size.
+ */
+#define HASH_TABLE_GROUP_PROBE (1 << 0)
+
 struct hash_table *
 _mesa_hash_table_create(void *mem_ctx,
                         uint32_t (*key_hash_function)(const void *key),
                         bool (*key_equals_function)(const void *a,
                                                     const void *b));
 
+struct hash_table *
+_mesa_hash_table_create_with_flags(void *mem_ctx,
+                                   uint32_t (*key_hash_function)(const void *key),
+                                   bool (*key_equals_function)(const void *a,
+                                                               const void *b),
+                                   unsigned flags);
+
 bool
 _mesa_hash_table_init(struct hash_table *ht,
                       void *mem_ctx,
@@ -71,6 +85,14 @@ _mesa_hash_table_init(struct hash_table *ht,
                       bool (*key_equals_function)(const void *a,
                                                   const void *b));
 
+bool
+_mesa_hash_table_init_with_flags(struct hash_table *ht,
+                                 void *mem_ctx,
+                                 uint32_t (*key_hash_function)(const void *key),
+                                 bool (*key_equals_function)(const void *a,
+                                                             const void *b),
+                                 unsigned flags);
+
 struct hash_table *
 _mesa_hash_table_create_u32_keys(void *mem_ctx);
 
@@ -37,6 +37,8 @@
 #include <string.h>
 
 #include "hash_table.h"
+#include "hash_group.h"
+#include "bitscan.h"
 #include "macros.h"
 #include "ralloc.h"
 #include "set.h"
@@ -116,12 +118,199 @@ entry_is_present(struct set_entry *entry)
    return entry->key != NULL && entry->key != deleted_key;
 }
 
+/**
+ * Group-probed mode (SET_GROUP_PROBE), see hash_group.h and the same code in
+ * hash_table.c.
+ */
+
+static bool
+set_group_alloc(struct set *ht, void *mem_ctx, uint32_t size)
+{
+   struct set_entry *table = rzalloc_array(mem_ctx, struct set_entry, size);
+   if (table == NULL)
+      return false;
+
+   uint8_t *ctrl = ralloc_array(table, uint8_t, size);
+   if (ctrl == NULL) {
+      ralloc_free(table);
+      return false;
+   }
+   memset(ctrl, HASH_GROUP_EMPTY, size);
+
+   ht->table = table;
+   ht->ctrl = ctrl;
+   ht->size = size;
+   ht->max_entries = size - size / 8;
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+   return true;
+}
+
+static struct set_entry *
+set_group_search(const struct set *ht, uint32_t hash, const void *key)
+{
+   uint32_t num_groups = ht->size / HASH_GROUP_SIZE;
+   uint32_t group = hash_group_index(hash, num_groups);
+   uint8_t tag = hash_group_tag(hash);
+
+   for (uint32_t i = 1; i <= num_groups; i++) {
+      const uint8_t *ctrl = ht->ctrl + group * HASH_GROUP_SIZE;
+      unsigned match = hash_group_match(ctrl, tag);
+
+      while (match) {
+         struct set_entry *entry =
+            ht->table + group * HASH_GROUP_SIZE + u_bit_scan(&match);
+
+         if (entry->hash == hash && entry_is_present(entry) &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      if (hash_group_match(ctrl, HASH_GROUP_EMPTY))
+         return NULL;
+
+      group = (group + i) & (num_groups - 1);
+   }
+
+   return NULL;
+}
+
+static void
+set_group_add_rehash(struct set *ht, uint32_t hash, const void *key)
+{
+   uint32_t num_groups = ht->size / HASH_GROUP_SIZE;
+   uint32_t group = hash_group_index(hash, num_groups);
+
+   for (uint32_t i = 1;; i++) {
+      unsigned empty = hash_group_match(ht->ctrl + group * HASH_GROUP_SIZE,
+                                        HASH_GROUP_EMPTY);
+      if (likely(empty)) {
+         uint32_t slot = group * HASH_GROUP_SIZE + u_bit_scan(&empty);
+
+         ht->ctrl[slot] = hash_group_tag(hash);
+         ht->table[slot].hash = hash;
+         ht->table[slot].key = key;
+         ht->entries++;
+         return;
+      }
+
+      group = (group + i) & (num_groups - 1);
+   }
+}
+
+static void
+set_group_rehash(struct set *ht, uint32_t new_size)
+{
+   struct set old_ht = *ht;
+
+   /* The size would overflow. */
+   if (new_size < ht->size)
+      return;
+
+   if (!set_group_alloc(ht, ralloc_parent(ht->table), new_size))
+      return;
+
+   set_foreach(&old_ht, entry) {
+      set_group_add_rehash(ht, entry->hash, entry->key);
+   }
+
+   ralloc_free(old_ht.table);
+}
+
+static struct set_entry *
+set_group_search_or_add(struct set *ht, uint32_t hash, const void *key,
+                        bool *found, bool can_rehash)
+{
+   if (ht->entries >= ht->max_entries) {
+      set_group_rehash(ht, ht->size * 2);
+   } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
+      set_group_rehash(ht, ht->size);
+   }
+
+   uint32_t num_groups = ht->size / HASH_GROUP_SIZE;
+   uint32_t group = hash_group_index(hash, num_groups);
+   uint8_t tag = hash_group_tag(hash);
+   uint32_t available = UINT32_MAX;
+
+   for (uint32_t i = 1; i <= num_groups; i++) {
+      const uint8_t *ctrl = ht->ctrl + group * HASH_GROUP_SIZE;
+      unsigned match = hash_group_match(ctrl, tag);
+
+      while (match) {
+         struct set_entry *entry =
+            ht->table + group * HASH_GROUP_SIZE + u_bit_scan(&match);
+
+         if (entry->hash == hash && entry_is_present(entry) &&
+             ht->key_equals_function(key, entry->key)) {
+            if (found)
+               *found = true;
+            return entry;
+         }
+      }
+
+      /* Stash the first available slot we find */
+      if (available == UINT32_MAX) {
+         unsigned free_slots = hash_group_match_available(ctrl);
+         if (free_slots)
+            available = group * HASH_GROUP_SIZE + u_bit_scan(&free_slots);
+      }
+
+      if (hash_group_match(ctrl, HASH_GROUP_EMPTY))
+         break;
+
+      group = (group + i) & (num_groups - 1);
+   }
+
+   if (available == UINT32_MAX) {
+      /* set_foreach_remove clears entries without updating the control
+       * bytes, so the set can look full. Rebuild them and try again.
+       */
+      if (!can_rehash)
+         return NULL;
+      set_group_rehash(ht, ht->size);
+      return set_group_search_or_add(ht, hash, key, found, false);
+   }
+
+   /* There is no matching entry, create it. */
+   if (ht->ctrl[available] == HASH_GROUP_DELETED)
+      ht->deleted_entries--;
+   ht->ctrl[available] = tag;
+   ht->table[available].hash = hash;
+   ht->table[available].key = key;
+   ht->entries++;
+   if (found)
+      *found = false;
+   return ht->table + available;
+}
+
+bool
+_mesa_set_init_with_flags(struct set *ht, void *mem_ctx,
+                          uint32_t (*key_hash_function)(const void *key),
+                          bool (*key_equals_function)(const void *a,
+                                                      const void *b),
+                          unsigned flags)
+{
+   if (flags & SET_GROUP_PROBE) {
+      ht->size_index = 0;
+      ht->rehash = 0;
+      ht->size_magic = 0;
+      ht->rehash_magic = 0;
+      ht->key_hash_function = key_hash_function;
+      ht->key_equals_function = key_equals_function;
+
+      return set_group_alloc(ht, mem_ctx, HASH_GROUP_SIZE);
+   }
+
+   return _mesa_set_init(ht, mem_ctx, key_hash_function, key_equals_function);
+}
+
 bool
 _mesa_set_init(struct set *ht, void *mem_ctx,
                  uint32_t (*key_hash_function)(const void *key),
                  bool (*key_equals_function)(const void *a,
                                              const void *b))
 {
+   ht->ctrl = NULL;
    ht->size_index = 0;
    ht->size = hash_sizes[ht->size_index].size;
    ht->rehash = hash_sizes[ht->size_index].rehash;
@@ -138,10 +327,11 @@ _mesa_set_init(struct set *ht, void *mem_ctx,
 }
 
 struct set *
-_mesa_set_create(void *mem_ctx,
-                 uint32_t (*key_hash_function)(const void *key),
-                 bool (*key_equals_function)(const void *a,
-                                             const void *b))
+_mesa_set_create_with_flags(void *mem_ctx,
+                            uint32_t (*key_hash_function)(const void *key),
+                            bool (*key_equals_function)(const void *a,
+                                                        const void *b),
+                            unsigned flags)
 {
    struct set *ht;
 
@@ -149,7 +339,8 @@ _mesa_set_create(void *mem_ctx,
    if (ht == NULL)
       return NULL;
 
-   if (!_mesa_set_init(ht, ht, key_hash_function, key_equals_function)) {
+   if (!_mesa_set_init_with_flags(ht, ht, key_hash_function,
+                                  key_equals_function, flags)) {
       ralloc_free(ht);
       return NULL;
    }
@@ -157,6 +348,16 @@ _mesa_set_create(void *mem_ctx,
    return ht;
 }
 
+struct set *
+_mesa_set_create(void *mem_ctx,
+                 uint32_t (*key_hash_function)(const void *key),
+                 bool (*key_equals_function)(const void *a,
+                                             const void *b))
+{
+   return _mesa_set_create_with_flags(mem_ctx, key_hash_function,
+                                      key_equals_function, 0);
+}
+
 static uint32_t
 key_u32_hash(const void *key)
 {
@@ -196,6 +397,16 @@ _mesa_set_clone(struct set *set, void *dst_mem_ctx)
 
    memcpy(clone->table, set->table, clone->size * sizeof(struct set_entry));
 
+   if (set->ctrl) {
+      clone->ctrl = ralloc_array(clone->table, uint8_t, clone->size);
+      if (clone->ctrl == NULL) {
+         ralloc_free(clone);
+         return NULL;
+      }
+
+      memcpy(clone->ctrl, set->ctrl, clone->size);
+   }
+
    return clone;
 }
 
@@ -224,7 +435,9 @@ _mesa_set_destroy(struct set *ht, void (*delete_function)(struct set_entry *entr
 static void
 set_clear_fast(struct set *ht)
 {
-   memset(ht->table, 0, sizeof(struct set_entry) * hash_sizes[ht->size_index].size);
+   memset(ht->table, 0, sizeof(struct set_entry) * ht->size);
+   if (ht->ctrl)
+      memset(ht->ctrl, HASH_GROUP_EMPTY, ht->size);
    ht->entries = ht->deleted_entries = 0;
 }
 
@@ -249,6 +462,8 @@ _mesa_set_clear(struct set *set, void (*delete_function)(struct set_entry *entry
 
          entry->key = NULL;
       }
+      if (set->ctrl)
+         memset(set->ctrl, HASH_GROUP_EMPTY, set->size);
       set->entries = 0;
       set->deleted_entries = 0;
    } else
@@ -265,6 +480,9 @@ set_search(const struct set *ht, uint32_t hash, const void *key)
 {
    assert(!key_pointer_is_reserved(key));
 
+   if (ht->ctrl)
+      return set_group_search(ht, hash, key);
+
    uint32_t size = ht->size;
    uint32_t start_address = util_fast_urem32(hash, size, ht->size_magic);
    uint32_t double_hash = util_fast_urem32(hash, ht->rehash,
@@ -375,6 +593,14 @@ _mesa_set_resize(struct set *set, uint32_t entries)
    if (set->entries > entries)
       entries = set->entries;
 
+   if (set->ctrl) {
+      uint32_t new_size = HASH_GROUP_SIZE;
+      while (new_size - new_size / 8 < entries && new_size < (1u << 31))
+         new_size *= 2;
+      set_group_rehash(set, new_size);
+      return;
+   }
+
    unsigned size_index = 0;
    while (hash_sizes[size_index].max_entries < entries)
       size_index++;
@@ -396,6 +622,9 @@ set_search_or_add(struct set *ht, uint32_t hash, const void *key, bool *found)
 
    assert(!key_pointer_is_reserved(key));
 
+   if (ht->ctrl)
+      return set_group_search_or_add(ht, hash, key, found, true);
+
    if (ht->entries >= ht->max_entries) {
       set_rehash(ht, ht->size_index + 1);
    } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
@@ -546,6 +775,22 @@ _mesa_set_remove(struct set *ht, struct set_entry *entry)
    if (!entry)
       return;
 
+   if (ht->ctrl) {
+      uint32_t slot = entry - ht->table;
+
+      /* Probes stop at groups that have an empty slot, so the slot can be
+       * freed without leaving a tombstone behind.
+       */
+      if (hash_group_match(ht->ctrl + (slot & ~(HASH_GROUP_SIZE - 1)),
+                           HASH_GROUP_EMPTY)) {
+         ht->ctrl[slot] = HASH_GROUP_EMPTY;
+         entry->key = NULL;
+         ht->entries--;
+         return;
+      }
+      ht->ctrl[slot] = HASH_GROUP_DELETED;
+   }
+
    entry->key = deleted_key;
    ht->entries--;
    ht->deleted_entries++;
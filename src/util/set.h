@@ -43,6 +43,7 @@ struct set_entry {
 struct set {
    void *mem_ctx;
    struct set_entry *table;
+   uint8_t *ctrl; /* control bytes, only with SET_GROUP_PROBE */
    uint32_t (*key_hash_function)(const void *key);
    bool (*key_equals_function)(const void *a, const void *b);
    uint32_t size;
@@ -61,12 +62,28 @@ _mesa_set_init(struct set *ht, void *mem_ctx,
                  bool (*key_equals_function)(const void *a,
                                              const void *b));
 
+/* Same as HASH_TABLE_GROUP_PROBE. */
+#define SET_GROUP_PROBE (1 << 0)
+
+bool
+_mesa_set_init_with_flags(struct set *ht, void *mem_ctx,
+                          uint32_t (*key_hash_function)(const void *key),
+                          bool (*key_equals_function)(const void *a,
+                                                      const void *b),
+                          unsigned flags);
+
 struct set *
 _mesa_set_create(void *mem_ctx,
                  uint32_t (*key_hash_function)(const void *key),
                  bool (*key_equals_function)(const void *a,
                                              const void *b));
 struct set *
+_mesa_set_create_with_flags(void *mem_ctx,
+                            uint32_t (*key_hash_function)(const void *key),
+                            bool (*key_equals_function)(const void *a,
+                                                        const void *b),
+                            unsigned flags);
+struct set *
 _mesa_set_create_u32_keys(void *mem_ctx);
 
 struct set *
@@ -0,0 +1,164 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#undef NDEBUG
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "util/hash_table.h"
+
+#define SIZE 10000
+
+static uint32_t
+key_value(const void *key)
+{
+   return *(const uint32_t *)key;
+}
+
+static bool
+uint32_t_key_equals(const void *a, const void *b)
+{
+   return key_value(a) == key_value(b);
+}
+
+static uint32_t
+bad_hash(const void *key)
+{
+   /* Only a few distinct hashes, to exercise long probe sequences. */
+   return key_value(key) & 0x30;
+}
+
+static void
+check_table(struct hash_table *ht, uint32_t *keys, bool *present)
+{
+   uint32_t count = 0;
+
+   for (uint32_t i = 0; i < SIZE; i++) {
+      struct hash_entry *entry = _mesa_hash_table_search(ht, keys + i);
+
+      if (present[i]) {
+         assert(entry);
+         assert(entry->key == keys + i);
+         assert(entry->data == (void *)(uintptr_t)(i + 1));
+         count++;
+      } else {
+         assert(!entry);
+      }
+   }
+   assert(ht->entries == count);
+
+   hash_table_foreach(ht, entry) {
+      uint32_t i = key_value(entry->key);
+      assert(present[i]);
+      count--;
+   }
+   assert(count == 0);
+}
+
+static void
+test_table(uint32_t (*hash)(const void *key), uint32_t size)
+{
+   struct hash_table *ht, *clone;
+   static uint32_t keys[SIZE];
+   static bool present[SIZE];
+
+   ht = _mesa_hash_table_create_with_flags(NULL, hash, uint32_t_key_equals,
+                                           HASH_TABLE_GROUP_PROBE);
+   assert(ht->ctrl);
+
+   for (uint32_t i = 0; i < size; i++) {
+      keys[i] = i;
+      present[i] = true;
+      _mesa_hash_table_insert(ht, keys + i, (void *)(uintptr_t)(i + 1));
+   }
+   for (uint32_t i = size; i < SIZE; i++) {
+      keys[i] = i;
+      present[i] = false;
+   }
+   check_table(ht, keys, present);
+
+   /* Remove every third entry, then insert them back in a different
+    * order, which reuses deleted slots.
+    */
+   for (uint32_t i = 0; i < size; i += 3) {
+      _mesa_hash_table_remove_key(ht, keys + i);
+      present[i] = false;
+   }
+   check_table(ht, keys, present);
+
+   clone = _mesa_hash_table_clone(ht, NULL);
+   check_table(clone, keys, present);
+   _mesa_hash_table_destroy(clone, NULL);
+
+   for (uint32_t i = size - 1; i < size; i--) {
+      if (!present[i]) {
+         _mesa_hash_table_insert(ht, keys + i, (void *)(uintptr_t)(i + 1));
+         present[i] = true;
+      }
+   }
+   check_table(ht, keys, present);
+
+   /* Replacement keeps the number of entries. */
+   _mesa_hash_table_insert(ht, keys, (void *)(uintptr_t)1);
+   check_table(ht, keys, present);
+
+   _mesa_hash_table_clear(ht, NULL);
+   memset(present, 0, sizeof(present));
+   check_table(ht, keys, present);
+
+   assert(_mesa_hash_table_reserve(ht, size));
+   for (uint32_t i = 0; i < size; i++) {
+      _mesa_hash_table_insert(ht, keys + i, (void *)(uintptr_t)(i + 1));
+      present[i] = true;
+   }
+   check_table(ht, keys, present);
+
+   /* hash_table_foreach_remove leaves the control bytes behind. */
+   hash_table_foreach_remove(ht, entry) {
+      present[key_value(entry->key)] = false;
+   }
+   check_table(ht, keys, present);
+
+   for (uint32_t i = 0; i < size; i++) {
+      _mesa_hash_table_insert(ht, keys + i, (void *)(uintptr_t)(i + 1));
+      present[i] = true;
+   }
+   check_table(ht, keys, present);
+
+   _mesa_hash_table_destroy(ht, NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+   (void) argc;
+   (void) argv;
+
+   test_table(key_value, SIZE);
+   test_table(key_value, 10);
+   test_table(bad_hash, 500);
+
+   return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ *
+ * Compares the regular hash_table/set probing with HASH_TABLE_GROUP_PROBE on
+ * the kinds of keys drivers use: heap pointers (resource tracking), small
+ * integer ids, fixed-size struct keys hashed with _mesa_hash_data (pipeline
+ * and descriptor layout caches) and strings.
+ *
+ * usage: hash_table_bench [max_entries]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/set.h"
+
+#define LOOKUP_ROUNDS 8
+#define MAX_CHURN_OPS 4096
+
+struct layout_key {
+   uint32_t num_bindings;
+   uint32_t flags;
+   uint64_t bindings[5];
+};
+
+static uint32_t
+layout_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct layout_key));
+}
+
+static bool
+layout_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct layout_key)) == 0;
+}
+
+static uint32_t
+id_key_hash(const void *key)
+{
+   uint32_t u = (uint32_t)(uintptr_t)key;
+   return _mesa_hash_u32(&u);
+}
+
+static bool
+id_key_equal(const void *a, const void *b)
+{
+   return a == b;
+}
+
+struct distribution {
+   const char *name;
+   uint32_t (*hash)(const void *key);
+   bool (*equal)(const void *a, const void *b);
+   /* keys[0..n) are inserted, keys[n..2n) are only used for misses */
+   const void **keys;
+};
+
+static void
+shuffle(const void **keys, unsigned n)
+{
+   for (unsigned i = n - 1; i > 0; i--) {
+      unsigned j = rand() % (i + 1);
+      const void *tmp = keys[i];
+      keys[i] = keys[j];
+      keys[j] = tmp;
+   }
+}
+
+static void
+make_keys(struct distribution *dists, unsigned n)
+{
+   unsigned count = 2 * n;
+
+   for (unsigned d = 0; d < 4; d++)
+      dists[d].keys = malloc(count * sizeof(void *));
+
+   for (unsigned i = 0; i < count; i++) {
+      /* Heap objects of a typical driver struct size. */
+      dists[0].keys[i] = malloc(96);
+
+      /* GL names and similar ids, 0 and 1 are reserved. */
+      dists[1].keys[i] = (const void *)(uintptr_t)(i + 2);
+
+      struct layout_key *layout = calloc(1, sizeof(*layout));
+      layout->num_bindings = 1 + i % 5;
+      layout->flags = i & 3;
+      for (unsigned b = 0; b < layout->num_bindings; b++)
+         layout->bindings[b] = ((uint64_t)(i >> 2) << 16) | (b << 8) | 0x7;
+      dists[2].keys[i] = layout;
+
+      char *str = malloc(32);
+      snprintf(str, 32, "shader_%u_variant_%u", i / 7, i % 7);
+      dists[3].keys[i] = str;
+   }
+
+   shuffle(dists[0].keys, count);
+   shuffle(dists[1].keys, count);
+   shuffle(dists[2].keys, count);
+   shuffle(dists[3].keys, count);
+}
+
+static double
+ns_per_op(int64_t start, unsigned ops)
+{
+   return (double)(os_time_get_nano() - start) / ops;
+}
+
+static void
+bench_hash_table(const struct distribution *dist, unsigned n, unsigned flags)
+{
+   struct hash_table *ht =
+      _mesa_hash_table_create_with_flags(NULL, dist->hash, dist->equal, flags);
+   unsigned found = 0;
+
+   int64_t start = os_time_get_nano();
+   for (unsigned i = 0; i < n; i++)
+      _mesa_hash_table_insert(ht, dist->keys[i], (void *)dist->keys[i]);
+   double insert = ns_per_op(start, n);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < LOOKUP_ROUNDS; r++) {
+      for (unsigned i = 0; i < n; i++)
+         found += _mesa_hash_table_search(ht, dist->keys[(i * 7919) % n]) != NULL;
+   }
+   double hit = ns_per_op(start, n * LOOKUP_ROUNDS);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < LOOKUP_ROUNDS; r++) {
+      for (unsigned i = 0; i < n; i++)
+         found += _mesa_hash_table_search(ht, dist->keys[n + i]) != NULL;
+   }
+   double miss = ns_per_op(start, n * LOOKUP_ROUNDS);
+
+   /* Cache eviction pattern: remove an old entry, add a new one. */
+   unsigned churn_ops = MIN2(n, MAX_CHURN_OPS);
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < churn_ops; i++) {
+      _mesa_hash_table_remove_key(ht, dist->keys[i]);
+      _mesa_hash_table_insert(ht, dist->keys[n + i], NULL);
+   }
+   double churn = ns_per_op(start, churn_ops);
+
+   if (found != n * LOOKUP_ROUNDS)
+      fprintf(stderr, "%s: lookup mismatch\n", dist->name);
+
+   printf("  hash_table %-6s %-8s insert %6.1f  hit %6.1f  miss %6.1f  churn %6.1f ns\n",
+          flags ? "group" : "linear", dist->name, insert, hit, miss, churn);
+
+   _mesa_hash_table_destroy(ht, NULL);
+}
+
+static void
+bench_set(const struct distribution *dist, unsigned n, unsigned flags)
+{
+   struct set *set =
+      _mesa_set_create_with_flags(NULL, dist->hash, dist->equal, flags);
+   unsigned found = 0;
+
+   int64_t start = os_time_get_nano();
+   for (unsigned i = 0; i < n; i++)
+      _mesa_set_add(set, dist->keys[i]);
+   double insert = ns_per_op(start, n);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < LOOKUP_ROUNDS; r++) {
+      for (unsigned i = 0; i < n; i++) {
+         found += _mesa_set_search(set, dist->keys[(i * 7919) % n]) != NULL;
+         found += _mesa_set_search(set, dist->keys[n + i]) != NULL;
+      }
+   }
+   double lookup = ns_per_op(start, 2 * n * LOOKUP_ROUNDS);
+
+   if (found != n * LOOKUP_ROUNDS)
+      fprintf(stderr, "%s: lookup mismatch\n", dist->name);
+
+   printf("  set        %-6s %-8s insert %6.1f  lookup (50%% hits) %6.1f ns\n",
+          flags ? "group" : "linear", dist->name, insert, lookup);
+
+   _mesa_set_destroy(set, NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned max_n = argc > 1 ? atoi(argv[1]) : 3 << 16;
+   struct distribution dists[4] = {
+      { "pointer", _mesa_hash_pointer, _mesa_key_pointer_equal },
+      { "id", id_key_hash, id_key_equal },
+      { "struct", layout_key_hash, layout_key_equal },
+      { "string", _mesa_hash_string, _mesa_key_string_equal },
+   };
+
+   srand(1);
+   make_keys(dists, max_n);
+
+   /* Start at 3/4 of a power of two, so neither mode is right at a resize. */
+   for (unsigned n = 48; n <= max_n; n *= 16) {
+      printf("%u entries\n", n);
+      for (unsigned d = 0; d < ARRAY_SIZE(dists); d++) {
+         bench_hash_table(&dists[d], n, 0);
+         bench_hash_table(&dists[d], n, HASH_TABLE_GROUP_PROBE);
+      }
+      for (unsigned d = 0; d < ARRAY_SIZE(dists); d++) {
+         bench_set(&dists[d], n, 0);
+         bench_set(&dists[d], n, SET_GROUP_PROBE);
+      }
+   }
+
+   return 0;
+}
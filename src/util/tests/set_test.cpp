@@ -171,3 +171,55 @@ TEST(set, search_or_add)
 
    _mesa_set_destroy(s, NULL);
 }
+
+TEST(set, group_probe)
+{
+   struct set *s = _mesa_set_create_with_flags(NULL, hash_int, cmp_int,
+                                               SET_GROUP_PROBE);
+   static int keys[1000];
+
+   for (int i = 0; i < 1000; i++) {
+      keys[i] = i;
+      _mesa_set_add(s, &keys[i]);
+   }
+   EXPECT_EQ(s->entries, 1000);
+
+   for (int i = 0; i < 1000; i += 2)
+      _mesa_set_remove_key(s, &keys[i]);
+   EXPECT_EQ(s->entries, 500);
+
+   for (int i = 0; i < 1000; i++)
+      EXPECT_EQ(_mesa_set_search(s, &keys[i]) != NULL, (i & 1) != 0);
+
+   struct set *clone = _mesa_set_clone(s, NULL);
+   EXPECT_EQ(clone->entries, 500);
+   EXPECT_TRUE(_mesa_set_search(clone, &keys[1]));
+   EXPECT_FALSE(_mesa_set_search(clone, &keys[2]));
+   _mesa_set_destroy(clone, NULL);
+
+   bool found;
+   int other = 3;
+   struct set_entry *entry = _mesa_set_search_or_add(s, &other, &found);
+   EXPECT_TRUE(found);
+   EXPECT_EQ(entry->key, &keys[3]);
+
+   entry = _mesa_set_search_or_add(s, &keys[4], &found);
+   EXPECT_FALSE(found);
+   EXPECT_EQ(s->entries, 501);
+
+   unsigned count = 0;
+   set_foreach(s, he)
+      count++;
+   EXPECT_EQ(count, 501);
+
+   _mesa_set_resize(s, 4000);
+   EXPECT_GE(s->max_entries, 4000);
+   EXPECT_EQ(s->entries, 501);
+   EXPECT_TRUE(_mesa_set_search(s, &keys[4]));
+
+   _mesa_set_clear(s, NULL);
+   EXPECT_EQ(s->entries, 0);
+   EXPECT_FALSE(_mesa_set_search(s, &keys[1]));
+
+   _mesa_set_destroy(s, NULL);
+}
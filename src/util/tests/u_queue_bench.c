@@ -0,0 +1,91 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ *
+ * Compares the throughput of the mutex-based util_queue with
+ * UTIL_QUEUE_INIT_LOCKLESS for small jobs.
+ *
+ * usage: u_queue_bench [num_producers] [jobs_per_producer]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+
+#define MAX_PRODUCERS 16
+
+struct bench_state {
+   struct util_queue queue;
+   unsigned jobs_per_producer;
+   unsigned counter;
+};
+
+static void
+bench_execute(void *data, void *gdata, int thread_index)
+{
+   unsigned *counter = data;
+   p_atomic_inc(counter);
+}
+
+static int
+bench_producer(void *data)
+{
+   struct bench_state *state = data;
+
+   for (unsigned i = 0; i < state->jobs_per_producer; i++) {
+      util_queue_add_job(&state->queue, &state->counter, NULL, bench_execute,
+                         NULL, 0);
+   }
+   return 0;
+}
+
+static void
+run_bench(const char *name, unsigned flags, unsigned num_producers,
+          unsigned jobs_per_producer)
+{
+   struct bench_state state = {0};
+   thrd_t threads[MAX_PRODUCERS];
+
+   state.jobs_per_producer = jobs_per_producer;
+   if (!util_queue_init(&state.queue, "bench", 64, 1, flags, NULL)) {
+      fprintf(stderr, "%s: util_queue_init failed\n", name);
+      return;
+   }
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < num_producers; i++)
+      thrd_create(&threads[i], bench_producer, &state);
+   for (unsigned i = 0; i < num_producers; i++)
+      thrd_join(threads[i], NULL);
+   util_queue_finish(&state.queue);
+
+   int64_t elapsed = os_time_get_nano() - start;
+   unsigned total = num_producers * jobs_per_producer;
+
+   printf("%-10s %2u producers: %9u jobs in %8.2f ms, %7.1f ns/job%s\n",
+          name, num_producers, total, elapsed / 1000000.0,
+          (double)elapsed / total,
+          p_atomic_read(&state.counter) == total ? "" : " (MISMATCH)");
+
+   util_queue_destroy(&state.queue);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_producers = argc > 1 ? atoi(argv[1]) : 4;
+   unsigned jobs_per_producer = argc > 2 ? atoi(argv[2]) : 250000;
+
+   num_producers = CLAMP(num_producers, 1, MAX_PRODUCERS);
+
+   for (unsigned n = 1; n <= num_producers; n *= 2) {
+      run_bench("mutex", 0, n, jobs_per_producer);
+      run_bench("lockless", UTIL_QUEUE_INIT_LOCKLESS, n, jobs_per_producer);
+   }
+   return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ *
+ * Testing u_queue.h
+ */
+
+#include <gtest/gtest.h>
+
+#include "c11/threads.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+
+#define NUM_PRODUCERS 4
+#define JOBS_PER_PRODUCER 2000
+
+struct counter_job {
+   struct util_queue_fence fence;
+   unsigned *counter;
+};
+
+static void
+count_execute(void *data, void *gdata, int thread_index)
+{
+   struct counter_job *job = (struct counter_job *)data;
+   p_atomic_inc(job->counter);
+}
+
+class UtilQueue : public ::testing::TestWithParam<unsigned> {
+};
+
+TEST_P(UtilQueue, FencesAndFinish)
+{
+   struct util_queue queue;
+   unsigned counter = 0;
+   struct counter_job jobs[64];
+
+   ASSERT_TRUE(util_queue_init(&queue, "test", 8, 1, GetParam(), NULL));
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      jobs[i].counter = &counter;
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, count_execute,
+                         NULL, 0);
+   }
+
+   util_queue_fence_wait(&jobs[ARRAY_SIZE(jobs) - 1].fence);
+   util_queue_finish(&queue);
+   EXPECT_EQ(p_atomic_read(&counter), ARRAY_SIZE(jobs));
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      EXPECT_TRUE(util_queue_fence_is_signalled(&jobs[i].fence));
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+
+   util_queue_destroy(&queue);
+}
+
+struct producer_state {
+   struct util_queue *queue;
+   unsigned *counter;
+};
+
+static int
+producer_func(void *data)
+{
+   struct producer_state *state = (struct producer_state *)data;
+   struct counter_job job;
+
+   util_queue_fence_init(&job.fence);
+   job.counter = state->counter;
+
+   for (unsigned i = 0; i < JOBS_PER_PRODUCER; i++) {
+      util_queue_add_job(state->queue, &job, &job.fence, count_execute,
+                         NULL, 0);
+      util_queue_fence_wait(&job.fence);
+   }
+
+   util_queue_fence_destroy(&job.fence);
+   return 0;
+}
+
+TEST_P(UtilQueue, MultipleProducers)
+{
+   struct util_queue queue;
+   unsigned counter = 0;
+   struct producer_state state = { &queue, &counter };
+   thrd_t threads[NUM_PRODUCERS];
+
+   ASSERT_TRUE(util_queue_init(&queue, "test", 4, 1, GetParam(), NULL));
+
+   for (unsigned i = 0; i < NUM_PRODUCERS; i++)
+      ASSERT_EQ(thrd_create(&threads[i], producer_func, &state), thrd_success);
+   for (unsigned i = 0; i < NUM_PRODUCERS; i++)
+      thrd_join(threads[i], NULL);
+
+   util_queue_finish(&queue);
+   EXPECT_EQ(p_atomic_read(&counter), NUM_PRODUCERS * JOBS_PER_PRODUCER);
+
+   util_queue_destroy(&queue);
+}
+
+TEST_P(UtilQueue, DropJob)
+{
+   struct util_queue queue;
+   unsigned counter = 0;
+   struct counter_job jobs[16];
+
+   ASSERT_TRUE(util_queue_init(&queue, "test", 16, 1, GetParam(), NULL));
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      jobs[i].counter = &counter;
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, count_execute,
+                         NULL, 0);
+   }
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      util_queue_drop_job(&queue, &jobs[i].fence);
+      EXPECT_TRUE(util_queue_fence_is_signalled(&jobs[i].fence));
+   }
+
+   util_queue_finish(&queue);
+   EXPECT_LE(p_atomic_read(&counter), ARRAY_SIZE(jobs));
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++)
+      util_queue_fence_destroy(&jobs[i].fence);
+
+   util_queue_destroy(&queue);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+   Modes, UtilQueue,
+   ::testing::Values(0u, (unsigned)UTIL_QUEUE_INIT_LOCKLESS)
+);
@@ -5,17 +5,32 @@
  */
 
 #include "thread_sched.h"
+#include "bitscan.h"
 #include "u_cpu_detect.h"
 #include "u_debug.h"
 
 DEBUG_GET_ONCE_BOOL_OPTION(pin_threads, "mesa_pin_threads", false)
 
+#if DETECT_ARCH_ARM || DETECT_ARCH_AARCH64
+static unsigned
+cpu_mask_count(const util_affinity_mask mask)
+{
+   unsigned count = 0;
+
+   for (unsigned i = 0; i < UTIL_MAX_CPUS / 32; i++)
+      count += util_bitcount(mask[i]);
+   return count;
+}
+#endif
+
 bool
 util_thread_scheduler_enabled(void)
 {
 #if DETECT_ARCH_X86 || DETECT_ARCH_X86_64
    return util_get_cpu_caps()->num_L3_caches > 1 ||
           debug_get_option_pin_threads();
+#elif DETECT_ARCH_ARM || DETECT_ARCH_AARCH64
+   return util_get_cpu_caps()->num_cpu_clusters > 1;
 #else
    return false;
 #endif
@@ -46,6 +61,9 @@ util_thread_sched_apply_policy(thrd_t thread, enum util_thread_name name,
                                unsigned app_thread_cpu, unsigned *sched_state)
 {
 #if DETECT_ARCH_X86 || DETECT_ARCH_X86_64
+   if (name == UTIL_THREAD_BACKGROUND)
+      return false;
+
    if (debug_get_option_pin_threads()) {
       /* Pin threads to a specific CPU. This is done only once. *sched_state
        * is true if this is the first time we are doing it.
@@ -85,6 +103,48 @@ util_thread_sched_apply_policy(thrd_t thread, enum util_thread_name name,
 
    return util_set_thread_affinity(thread, caps->L3_affinity_mask[L3_cache],
                                    NULL, caps->num_cpu_mask_bits);
+#elif DETECT_ARCH_ARM || DETECT_ARCH_AARCH64
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   if (caps->num_cpu_clusters <= 1)
+      return false;
+
+   /* Background threads stay on the little cores and leave the big ones to
+    * the threads the app is waiting for.
+    */
+   if (name == UTIL_THREAD_BACKGROUND) {
+      return util_set_thread_affinity(thread, caps->little_affinity_mask,
+                                      NULL, caps->num_cpu_mask_bits);
+   }
+
+   if (name == UTIL_THREAD_APP_CALLER)
+      return false;
+
+   /* Keep latency-critical threads on the big cluster where the app thread
+    * resides, so that they share its caches. If the app thread is on a
+    * little core or alone in its cluster (e.g. a single prime core), use
+    * all big cores instead. (*sched_state contains the last set cluster
+    * index, or num_cpu_clusters for all big cores)
+    */
+   unsigned cluster = caps->cpu_to_cluster[app_thread_cpu];
+   if (cluster == U_CPU_INVALID_CLUSTER)
+      return false;
+
+   if (cluster >= caps->num_big_clusters ||
+       cpu_mask_count(caps->cluster_affinity_mask[cluster]) < 2)
+      cluster = caps->num_cpu_clusters;
+
+   if (sched_state && cluster == *sched_state)
+      return false;
+
+   if (sched_state)
+      *sched_state = cluster;
+
+   return util_set_thread_affinity(thread,
+                                   cluster < caps->num_cpu_clusters ?
+                                      caps->cluster_affinity_mask[cluster] :
+                                      caps->big_affinity_mask,
+                                   NULL, caps->num_cpu_mask_bits);
 #else
    return false;
 #endif
@@ -16,6 +16,8 @@ enum util_thread_name
    UTIL_THREAD_GLTHREAD,
    UTIL_THREAD_THREADED_CONTEXT,
    UTIL_THREAD_DRIVER_SUBMIT,
+   /* shader compilation, disk cache, etc. */
+   UTIL_THREAD_BACKGROUND,
 };
 
 bool
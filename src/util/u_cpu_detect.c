@@ -471,6 +471,129 @@ check_os_mips64_support(void)
 #endif /* DETECT_ARCH_MIPS64 */
 
 
+#if DETECT_OS_LINUX
+#define UTIL_MAX_CPU_CLUSTERS 8
+
+static uint64_t
+read_cpu_max_freq(unsigned cpu)
+{
+   char name[PATH_MAX];
+   size_t size = 0;
+   uint64_t freq;
+
+   snprintf(name, sizeof(name),
+            "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", cpu);
+   char *str = os_read_file(name, &size);
+   if (!str)
+      return 0;
+   freq = strtoull(str, NULL, 10);
+   free(str);
+   return freq;
+}
+
+/* Group CPUs into big.LITTLE clusters by capacity and maximum frequency,
+ * the latter separates e.g. prime cores from the other big cores.
+ */
+static void
+get_cpu_clusters(const uint64_t *caps, uint64_t big_cap)
+{
+   uint64_t cluster_cap[UTIL_MAX_CPU_CLUSTERS];
+   uint64_t cluster_freq[UTIL_MAX_CPU_CLUSTERS];
+   unsigned num_clusters = 0, num_big_clusters = 0;
+   unsigned max_cpus = MIN2(util_cpu_caps.max_cpus, UTIL_MAX_CPUS);
+   uint64_t *freqs = malloc(sizeof(uint64_t) * max_cpus);
+
+   if (!freqs)
+      return;
+
+   for (unsigned i = 0; i < max_cpus; i++) {
+      unsigned c;
+
+      freqs[i] = read_cpu_max_freq(i);
+      for (c = 0; c < num_clusters; c++) {
+         if (cluster_cap[c] == caps[i] && cluster_freq[c] == freqs[i])
+            break;
+      }
+      if (c < num_clusters)
+         continue;
+
+      if (num_clusters == UTIL_MAX_CPU_CLUSTERS) {
+         free(freqs);
+         return;
+      }
+
+      /* Insert the new cluster, keeping them sorted from the fastest. */
+      for (c = num_clusters; c > 0; c--) {
+         if (cluster_cap[c - 1] > caps[i] ||
+             (cluster_cap[c - 1] == caps[i] && cluster_freq[c - 1] > freqs[i]))
+            break;
+         cluster_cap[c] = cluster_cap[c - 1];
+         cluster_freq[c] = cluster_freq[c - 1];
+      }
+      cluster_cap[c] = caps[i];
+      cluster_freq[c] = freqs[i];
+      num_clusters++;
+   }
+
+   if (num_clusters < 2) {
+      free(freqs);
+      return;
+   }
+
+   util_affinity_mask *masks = calloc(num_clusters, sizeof(util_affinity_mask));
+   if (!masks) {
+      free(freqs);
+      return;
+   }
+
+   for (unsigned c = 0; c < num_clusters; c++) {
+      if (cluster_cap[c] >= big_cap / 2)
+         num_big_clusters++;
+   }
+
+   bool has_little = false;
+   for (unsigned i = 0; i < max_cpus; i++) {
+      uint32_t cpu_bit = 1u << (i % 32);
+      unsigned c;
+
+      for (c = 0; c < num_clusters; c++) {
+         if (cluster_cap[c] == caps[i] && cluster_freq[c] == freqs[i])
+            break;
+      }
+
+      util_cpu_caps.cpu_to_cluster[i] = c;
+      masks[c][i / 32] |= cpu_bit;
+      if (c < num_big_clusters) {
+         util_cpu_caps.big_affinity_mask[i / 32] |= cpu_bit;
+      } else {
+         util_cpu_caps.little_affinity_mask[i / 32] |= cpu_bit;
+         has_little = true;
+      }
+   }
+   free(freqs);
+
+   if (!has_little)
+      memcpy(util_cpu_caps.little_affinity_mask, masks[num_clusters - 1],
+             sizeof(util_affinity_mask));
+
+   util_cpu_caps.num_cpu_clusters = num_clusters;
+   util_cpu_caps.num_big_clusters = num_big_clusters;
+   util_cpu_caps.cluster_affinity_mask = masks;
+
+   if (debug_get_option_dump_cpu()) {
+      fprintf(stderr, "CPU clusters:\n");
+      for (unsigned c = 0; c < num_clusters; c++) {
+         fprintf(stderr, "  - cluster %u (capacity %" PRIu64 ", %" PRIu64
+                 " kHz%s) mask = ", c, cluster_cap[c], cluster_freq[c],
+                 c < num_big_clusters ? ", big" : "");
+         for (int j = max_cpus - 1; j >= 0; j -= 32)
+            fprintf(stderr, "%08x ", masks[c][j / 32]);
+         fprintf(stderr, "\n");
+      }
+   }
+}
+#endif
+
 static void
 get_cpu_topology(void)
 {
@@ -478,6 +601,8 @@ get_cpu_topology(void)
    util_cpu_caps.num_L3_caches = 1;
 
    memset(util_cpu_caps.cpu_to_L3, 0xff, sizeof(util_cpu_caps.cpu_to_L3));
+   memset(util_cpu_caps.cpu_to_cluster, 0xff,
+          sizeof(util_cpu_caps.cpu_to_cluster));
 
 #if DETECT_OS_LINUX
    uint64_t big_cap = 0;
@@ -508,6 +633,8 @@ get_cpu_topology(void)
          if (caps[i] >= big_cap / 2)
             num_big_cpus++;
       }
+      if (caps)
+         get_cpu_clusters(caps, big_cap);
    }
    free(caps);
    util_cpu_caps.nr_big_cpus = num_big_cpus;
@@ -991,6 +1118,7 @@ _util_cpu_detect_once(void)
       printf("util_cpu_caps.has_avx512vbmi = %u\n", util_cpu_caps.has_avx512vbmi);
       printf("util_cpu_caps.has_clflushopt = %u\n", util_cpu_caps.has_clflushopt);
       printf("util_cpu_caps.num_L3_caches = %u\n", util_cpu_caps.num_L3_caches);
+      printf("util_cpu_caps.num_cpu_clusters = %u\n", util_cpu_caps.num_cpu_clusters);
       printf("util_cpu_caps.num_cpu_mask_bits = %u\n", util_cpu_caps.num_cpu_mask_bits);
    }
    _util_cpu_caps_state.caps = util_cpu_caps;
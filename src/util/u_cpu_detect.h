@@ -140,6 +140,20 @@ struct util_cpu_caps_t {
     * A value of zero indicates that CPUs are homogeneous.
     */
    int16_t nr_big_cpus;
+
+   /**
+    * big.LITTLE clusters: CPUs with the same capacity and maximum frequency,
+    * ordered from the fastest to the slowest. Only set when there is more
+    * than one cluster.
+    */
+   unsigned num_cpu_clusters;
+   /* the first num_big_clusters clusters only have "big" CPUs */
+   unsigned num_big_clusters;
+   uint16_t cpu_to_cluster[UTIL_MAX_CPUS];
+   util_affinity_mask *cluster_affinity_mask;
+   util_affinity_mask big_affinity_mask;
+   /* the non-big CPUs, or the slowest cluster if all CPUs are big */
+   util_affinity_mask little_affinity_mask;
 };
 
 struct _util_cpu_caps_state_t {
@@ -153,6 +167,7 @@ struct _util_cpu_caps_state_t {
 };
 
 #define U_CPU_INVALID_L3 0xffff
+#define U_CPU_INVALID_CLUSTER 0xffff
 
 static inline ATTRIBUTE_CONST const struct util_cpu_caps_t *
 util_get_cpu_caps(void)
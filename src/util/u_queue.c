@@ -27,10 +27,13 @@
 #include "u_queue.h"
 
 #include "c11/threads.h"
+#include "util/detect_arch.h"
 #include "util/u_cpu_detect.h"
+#include "util/u_math.h"
 #include "util/os_time.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
+#include "util/thread_sched.h"
 #include "u_process.h"
 
 #if defined(__linux__)
@@ -246,6 +249,201 @@ struct thread_input {
    int thread_index;
 };
 
+#ifdef UTIL_QUEUE_FENCE_FUTEX
+/****************************************************************************
+ * UTIL_QUEUE_INIT_LOCKLESS
+ *
+ * A bounded multi-producer single-consumer ring. Every slot has a sequence
+ * number: producers claim a write position with cmpxchg when the slot's
+ * sequence matches it, and publish the job by setting the sequence to the
+ * position + 1. The worker consumes slots in order and frees them by
+ * advancing the sequence by the ring size.
+ */
+
+#define UTIL_QUEUE_MIN_SPIN 64
+#define UTIL_QUEUE_MAX_SPIN 4096
+
+static inline void
+util_queue_cpu_relax(void)
+{
+#if defined(__GNUC__) && (DETECT_ARCH_X86 || DETECT_ARCH_X86_64)
+   __builtin_ia32_pause();
+#elif defined(__GNUC__) && (DETECT_ARCH_AARCH64 || DETECT_ARCH_ARM)
+   __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static inline bool
+lockless_job_ready(struct util_queue *queue, uint32_t pos)
+{
+   return p_atomic_read(&queue->slots[pos & queue->slot_mask].seq) == pos + 1;
+}
+
+static inline bool
+lockless_thread_killed(struct util_queue *queue, int thread_index)
+{
+   return thread_index >= p_atomic_read(&queue->num_threads);
+}
+
+/* Wait until the job at "pos" is published or the thread should exit. */
+static void
+lockless_wait_for_job(struct util_queue *queue, uint32_t pos, int thread_index)
+{
+   unsigned spin = queue->spin_count;
+
+   if (spin) {
+      for (unsigned i = 0; i < spin; i++) {
+         if (lockless_job_ready(queue, pos)) {
+            /* Spinning paid off, spin longer next time. */
+            queue->spin_count = MIN2(spin * 2, UTIL_QUEUE_MAX_SPIN);
+            return;
+         }
+         util_queue_cpu_relax();
+      }
+      queue->spin_count = MAX2(spin / 2, UTIL_QUEUE_MIN_SPIN);
+   }
+
+   /* Both sides use xchg on worker_sleeping, so either the producer sees 1
+    * and wakes us up, or we see its job here.
+    */
+   p_atomic_xchg(&queue->worker_sleeping, 1);
+   if (lockless_job_ready(queue, pos) ||
+       lockless_thread_killed(queue, thread_index)) {
+      p_atomic_set(&queue->worker_sleeping, 0);
+      return;
+   }
+   futex_wait(&queue->worker_sleeping, 1, NULL);
+}
+
+static int
+util_queue_lockless_thread_loop(struct util_queue *queue, int thread_index)
+{
+   while (1) {
+      uint32_t pos = queue->lockless_read_pos;
+
+      /* only kill threads that are above "num_threads" */
+      if (lockless_thread_killed(queue, thread_index))
+         break;
+
+      if (!lockless_job_ready(queue, pos)) {
+         lockless_wait_for_job(queue, pos, thread_index);
+         continue;
+      }
+
+      struct util_queue_lockless_slot *slot =
+         &queue->slots[pos & queue->slot_mask];
+      struct util_queue_job job = slot->job;
+
+      /* Give the slot back to the producers. */
+      p_atomic_set(&slot->seq, pos + queue->slot_mask + 1);
+      queue->lockless_read_pos = pos + 1;
+
+      /* Wake up blocked producers once half of the ring is free or when
+       * running out of work, so that they fill it in batches.
+       */
+      if (p_atomic_read(&queue->space_waiters) &&
+          ((pos & (queue->slot_mask >> 1)) == 0 ||
+           !lockless_job_ready(queue, pos + 1))) {
+         p_atomic_inc(&queue->space_seq);
+         futex_wake(&queue->space_seq, INT32_MAX);
+      }
+
+      job.execute(job.job, job.global_data, thread_index);
+      if (job.fence)
+         util_queue_fence_signal(job.fence);
+      if (job.cleanup)
+         job.cleanup(job.job, job.global_data, thread_index);
+   }
+
+   /* signal remaining jobs, nothing is going to execute them */
+   while (lockless_job_ready(queue, queue->lockless_read_pos)) {
+      uint32_t pos = queue->lockless_read_pos;
+      struct util_queue_lockless_slot *slot =
+         &queue->slots[pos & queue->slot_mask];
+
+      if (slot->job.fence)
+         util_queue_fence_signal(slot->job.fence);
+      p_atomic_set(&slot->seq, pos + queue->slot_mask + 1);
+      queue->lockless_read_pos = pos + 1;
+   }
+   return 0;
+}
+
+/* Wait until the worker frees the slot that write position "pos" maps to. */
+static void
+lockless_wait_for_space(struct util_queue *queue,
+                        struct util_queue_lockless_slot *slot, uint32_t pos)
+{
+   p_atomic_inc(&queue->space_waiters);
+
+   while (1) {
+      uint32_t v = p_atomic_read(&queue->space_seq);
+
+      if ((int32_t)(p_atomic_read(&slot->seq) - pos) >= 0)
+         break;
+
+      /* The worker can miss space_waiters if it races with the increment,
+       * so don't sleep for too long.
+       */
+      int64_t abs_timeout = os_time_get_nano() + 1000000;
+      struct timespec ts;
+      ts.tv_sec = abs_timeout / (1000*1000*1000);
+      ts.tv_nsec = abs_timeout % (1000*1000*1000);
+      futex_wait(&queue->space_seq, v, &ts);
+   }
+
+   p_atomic_dec(&queue->space_waiters);
+}
+
+static void
+util_queue_add_job_lockless(struct util_queue *queue,
+                            void *job,
+                            struct util_queue_fence *fence,
+                            util_queue_execute_func execute,
+                            util_queue_execute_func cleanup,
+                            const size_t job_size)
+{
+   struct util_queue_lockless_slot *slot;
+   uint32_t pos;
+
+   if (!p_atomic_read(&queue->num_threads))
+      return;
+
+   if (fence)
+      util_queue_fence_reset(fence);
+
+   pos = p_atomic_read_relaxed(&queue->lockless_write_pos);
+   while (1) {
+      slot = &queue->slots[pos & queue->slot_mask];
+      int32_t diff = (int32_t)(p_atomic_read(&slot->seq) - pos);
+
+      if (diff == 0) {
+         uint32_t old = p_atomic_cmpxchg(&queue->lockless_write_pos, pos,
+                                         pos + 1);
+         if (old == pos)
+            break;
+         pos = old;
+      } else {
+         /* The queue is full, or another producer took this position. */
+         if (diff < 0)
+            lockless_wait_for_space(queue, slot, pos);
+         pos = p_atomic_read_relaxed(&queue->lockless_write_pos);
+      }
+   }
+
+   slot->job.job = job;
+   slot->job.global_data = queue->global_data;
+   slot->job.fence = fence;
+   slot->job.execute = execute;
+   slot->job.cleanup = cleanup;
+   slot->job.job_size = job_size;
+   p_atomic_set(&slot->seq, pos + 1);
+
+   if (p_atomic_xchg(&queue->worker_sleeping, 0))
+      futex_wake(&queue->worker_sleeping, 1);
+}
+#endif
+
 static int
 util_queue_thread_func(void *input)
 {
@@ -266,6 +464,12 @@ util_queue_thread_func(void *input)
                                        util_get_cpu_caps()->num_cpu_mask_bits);
    }
 
+   if (queue->flags & UTIL_QUEUE_INIT_BACKGROUND_THREADS &&
+       util_thread_scheduler_enabled()) {
+      util_thread_sched_apply_policy(thrd_current(), UTIL_THREAD_BACKGROUND,
+                                     0, NULL);
+   }
+
 #if defined(__linux__)
    if (queue->flags & UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY) {
       /* The nice() function can only set a maximum of 19. */
@@ -279,6 +483,11 @@ util_queue_thread_func(void *input)
       u_thread_setname(name);
    }
 
+#ifdef UTIL_QUEUE_FENCE_FUTEX
+   if (queue->flags & UTIL_QUEUE_INIT_LOCKLESS)
+      return util_queue_lockless_thread_loop(queue, thread_index);
+#endif
+
    while (1) {
       struct util_queue_job job;
 
@@ -366,6 +575,10 @@ void
 util_queue_adjust_num_threads(struct util_queue *queue, unsigned num_threads,
                               bool locked)
 {
+   /* The lockless ring has a single consumer. */
+   if (queue->flags & UTIL_QUEUE_INIT_LOCKLESS)
+      return;
+
    num_threads = MIN2(num_threads, queue->max_threads);
    num_threads = MAX2(num_threads, 1);
 
@@ -449,16 +662,43 @@ util_queue_init(struct util_queue *queue,
    queue->max_jobs = max_jobs;
    queue->global_data = global_data;
 
+#ifdef UTIL_QUEUE_FENCE_FUTEX
+   if (flags & UTIL_QUEUE_INIT_LOCKLESS) {
+      /* Single consumer, fixed power-of-two size. */
+      queue->flags &= ~UTIL_QUEUE_INIT_RESIZE_IF_FULL;
+      queue->create_threads_on_demand = false;
+      queue->max_threads = 1;
+      queue->max_jobs = util_next_power_of_two(MAX2(max_jobs, 2));
+      queue->slot_mask = queue->max_jobs - 1;
+      /* Spinning only helps if the producers can run at the same time. */
+      queue->spin_count = util_get_cpu_caps()->nr_cpus > 1 ?
+                          UTIL_QUEUE_MIN_SPIN : 0;
+   }
+#else
+   queue->flags &= ~UTIL_QUEUE_INIT_LOCKLESS;
+#endif
+
    (void) mtx_init(&queue->lock, mtx_plain);
 
    queue->num_queued = 0;
    cnd_init(&queue->has_queued_cond);
    cnd_init(&queue->has_space_cond);
 
-   queue->jobs = (struct util_queue_job*)
-                 calloc(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
-      goto fail;
+   /* The lockless ring replaces the job array. */
+   if (queue->flags & UTIL_QUEUE_INIT_LOCKLESS) {
+      queue->slots = (struct util_queue_lockless_slot*)
+                     calloc(queue->max_jobs, sizeof(*queue->slots));
+      if (!queue->slots)
+         goto fail;
+
+      for (i = 0; i < queue->max_jobs; i++)
+         queue->slots[i].seq = i;
+   } else {
+      queue->jobs = (struct util_queue_job*)
+                    calloc(max_jobs, sizeof(struct util_queue_job));
+      if (!queue->jobs)
+         goto fail;
+   }
 
    queue->threads = (thrd_t*) calloc(queue->max_threads, sizeof(thrd_t));
    if (!queue->threads)
@@ -483,13 +723,12 @@ util_queue_init(struct util_queue *queue,
 
 fail:
    free(queue->threads);
+   free(queue->slots);
+   free(queue->jobs);
 
-   if (queue->jobs) {
-      cnd_destroy(&queue->has_space_cond);
-      cnd_destroy(&queue->has_queued_cond);
-      mtx_destroy(&queue->lock);
-      free(queue->jobs);
-   }
+   cnd_destroy(&queue->has_space_cond);
+   cnd_destroy(&queue->has_queued_cond);
+   mtx_destroy(&queue->lock);
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
    return false;
@@ -512,9 +751,16 @@ util_queue_kill_threads(struct util_queue *queue, unsigned keep_num_threads,
    unsigned old_num_threads = queue->num_threads;
    /* Setting num_threads is what causes the threads to terminate.
     * Then cnd_broadcast wakes them up and they will exit their function.
+    * The lockless worker reads it without the lock.
     */
-   queue->num_threads = keep_num_threads;
+   p_atomic_set(&queue->num_threads, keep_num_threads);
    cnd_broadcast(&queue->has_queued_cond);
+#ifdef UTIL_QUEUE_FENCE_FUTEX
+   if (queue->flags & UTIL_QUEUE_INIT_LOCKLESS) {
+      p_atomic_xchg(&queue->worker_sleeping, 0);
+      futex_wake(&queue->worker_sleeping, 1);
+   }
+#endif
 
    /* Wait for threads to terminate. */
    if (keep_num_threads < old_num_threads) {
@@ -552,6 +798,7 @@ util_queue_destroy(struct util_queue *queue)
    mtx_destroy(&queue->lock);
    free(queue->jobs);
    free(queue->threads);
+   free(queue->slots);
 }
 
 static void
@@ -565,6 +812,14 @@ util_queue_add_job_locked(struct util_queue *queue,
 {
    struct util_queue_job *ptr;
 
+#ifdef UTIL_QUEUE_FENCE_FUTEX
+   if (queue->flags & UTIL_QUEUE_INIT_LOCKLESS) {
+      util_queue_add_job_lockless(queue, job, fence, execute, cleanup,
+                                  job_size);
+      return;
+   }
+#endif
+
    if (!locked)
       mtx_lock(&queue->lock);
    if (queue->num_threads == 0) {
@@ -672,6 +927,12 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
    if (util_queue_fence_is_signalled(fence))
       return;
 
+   /* Jobs can't be removed from the lockless ring. */
+   if (queue->flags & UTIL_QUEUE_INIT_LOCKLESS) {
+      util_queue_fence_wait(fence);
+      return;
+   }
+
    mtx_lock(&queue->lock);
    for (unsigned i = queue->read_idx; i != queue->write_idx;
         i = (i + 1) % queue->max_jobs) {
@@ -50,6 +50,15 @@ extern "C" {
 #define UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY      (1 << 0)
 #define UTIL_QUEUE_INIT_RESIZE_IF_FULL            (1 << 1)
 #define UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY  (1 << 2)
+/* Keep the threads on the little cores of big.LITTLE CPUs. */
+#define UTIL_QUEUE_INIT_BACKGROUND_THREADS        (1 << 3)
+/* Use a bounded lock-free ring with a single worker thread, for queues that
+ * get a lot of small jobs. Adding a job doesn't take the queue mutex, and
+ * the worker spins for a short while before sleeping on a futex. The queue
+ * is never resized, adding a job to a full queue waits for a free slot.
+ * Ignored without futex support.
+ */
+#define UTIL_QUEUE_INIT_LOCKLESS                  (1 << 4)
 
 #if UTIL_FUTEX_SUPPORTED
 #define UTIL_QUEUE_FENCE_FUTEX
@@ -219,6 +228,14 @@ struct util_queue_job {
    util_queue_execute_func cleanup;
 };
 
+/* A slot of the UTIL_QUEUE_INIT_LOCKLESS ring. "seq" is the write position
+ * the slot is free for, or that position + 1 once the job is published.
+ */
+struct util_queue_lockless_slot {
+   uint32_t seq;
+   struct util_queue_job job;
+};
+
 /* Put this into your context. */
 struct util_queue {
    char name[14]; /* 13 characters = the thread name without the index */
@@ -237,6 +254,16 @@ struct util_queue {
    struct util_queue_job *jobs;
    void *global_data;
 
+   /* UTIL_QUEUE_INIT_LOCKLESS */
+   struct util_queue_lockless_slot *slots;
+   uint32_t slot_mask;
+   uint32_t lockless_write_pos; /* claimed by producers with cmpxchg */
+   uint32_t lockless_read_pos;  /* only used by the worker thread */
+   uint32_t worker_sleeping;    /* futex, 1 when the worker may sleep */
+   uint32_t space_seq;          /* futex, bumped when a slot is freed */
+   uint32_t space_waiters;
+   unsigned spin_count;         /* adaptive spin before sleeping */
+
    /* for cleanup at exit(), protected by exit_mutex */
    struct list_head head;
 };
@@ -82,6 +82,9 @@
 #define VCMD_SYNC_WRITE 22
 #define VCMD_SYNC_WAIT 23
 #define VCMD_SUBMIT_CMD2 24
+/* shared memory command ring, VCMD_PARAM_SHM_RING */
+#define VCMD_RING_INIT 25
+#define VCMD_RING_KICK 26
 #endif /* VIRGL_RENDERER_UNSTABLE_APIS */
 
 #define VCMD_RES_CREATE_SIZE 10
@@ -154,6 +157,8 @@
 
 enum vcmd_param  {
    VCMD_PARAM_MAX_TIMELINE_COUNT = 1,
+   /* max ring size in bytes, 0 when VCMD_RING_INIT is not supported */
+   VCMD_PARAM_SHM_RING = 2,
 };
 #define VCMD_GET_PARAM_SIZE 1
 #define VCMD_GET_PARAM_PARAM 0
@@ -241,6 +246,41 @@ struct vcmd_submit_cmd2_batch {
 #define VCMD_SUBMIT_CMD2_BATCH_SYNC_COUNT(n)       (1 + 8 * (n) + 4)
 #define VCMD_SUBMIT_CMD2_BATCH_RING_IDX(n)         (1 + 8 * (n) + 5)
 
+/* The ring is a memfd holding a struct vcmd_ring_header followed by size
+ * bytes of data at VCMD_RING_DATA_OFFSET; size is a power of two and head
+ * and tail are free-running byte counters.
+ *
+ * The client copies complete commands (header and payload, exactly as they
+ * would be written to the socket) into the ring and stores tail with
+ * release semantics.  The server loads tail with acquire semantics and
+ * stores head with release semantics as it consumes data.  Before reading
+ * any command from the socket, the server executes every command up to
+ * tail, so the client may send any command on the socket at any time, e.g.
+ * commands with a reply or an fd, or one that doesn't fit in the ring.
+ *
+ * Once the ring is drained and before blocking on the socket, the server
+ * sets VCMD_RING_STATUS_IDLE, checks tail again, and clears the bit when it
+ * wakes up.  A client that finds the bit set after storing tail clears it
+ * and sends VCMD_RING_KICK, so doorbells are only sent to an idle server.
+ */
+struct vcmd_ring_header {
+   uint32_t head;
+   uint32_t pad0[15];
+   uint32_t tail;
+   uint32_t pad1[15];
+   uint32_t status;
+   uint32_t pad2[15];
+};
+#define VCMD_RING_DATA_OFFSET 192
+
+#define VCMD_RING_STATUS_IDLE (1u << 0)
+
+#define VCMD_RING_INIT_SIZE 1
+#define VCMD_RING_INIT_RING_SIZE 0
+/* followed by the ring memfd */
+
+#define VCMD_RING_KICK_SIZE 0
+
 #endif /* VIRGL_RENDERER_UNSTABLE_APIS */
 
 #endif /* VTEST_PROTOCOL */